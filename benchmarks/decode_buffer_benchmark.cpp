@@ -0,0 +1,189 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+// Measures the UTF-16 and UTF-32 paths that decode into a buffer of
+// codepoints and pass it to std_width_calc_func: with a destination whose
+// recycle() is virtual ( and a buffer of 16 codepoints ), and with the
+// statically dispatched decrementers of several buffer sizes.
+//
+// Usage: decode_buffer_benchmark [--quick]
+
+#include <string_width.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+template <typename T>
+inline void do_not_optimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile T sink;
+    sink = value;
+#endif
+}
+
+// The former design of the width decrementer
+class virtual_decrementer: public string_width::detail::destination<char32_t> {
+public:
+    explicit virtual_decrementer(int initial_width) noexcept
+        : string_width::detail::destination<char32_t>(buff_, buff_size_)
+        , width_{initial_width}
+    {
+        this->set_good(initial_width != 0);
+    }
+    void recycle() noexcept override {
+        if (this->good()) {
+            auto res = string_width::detail::std_width_calc_func
+                (buff_, this->pointer(), width_, state_, false);
+            width_ = res.width;
+            state_ = res.state;
+            if (width_ == 0) {
+                this->set_good(false);
+            }
+        }
+        this->set_pointer(buff_);
+    }
+    int get_remaining_width() noexcept {
+        if (width_ != 0 && this->pointer() != buff_) {
+            return string_width::detail::std_width_calc_func
+                (buff_, this->pointer(), width_, state_, false).width;
+        }
+        return width_;
+    }
+
+private:
+    int width_;
+    unsigned state_ = 0;
+    static constexpr std::size_t buff_size_ = 16;
+    char32_t buff_[buff_size_];
+};
+
+template <typename CharT>
+int virtual_width(int limit, const CharT* str, std::size_t len)
+{
+    virtual_decrementer decr{limit};
+    // through a reference to the base class, as it used to be
+    string_width::detail::destination<char32_t>& dest = decr;
+    string_width::detail::decode(dest, str, len, string_width::surrogate_policy::strict);
+    return limit - decr.get_remaining_width();
+}
+
+template <std::size_t BuffSize, typename CharT>
+int static_width(int limit, const CharT* str, std::size_t len)
+{
+    string_width::detail::basic_std_width_decrementer<BuffSize> decr{limit};
+    return string_width::detail::str_width
+        (decr, limit, str, len, string_width::surrogate_policy::strict);
+}
+
+template <typename Func>
+double ns_per_call(Func func)
+{
+    using clock = std::chrono::steady_clock;
+    double best = 1e300;
+    for (int round = 0; round < 3; ++round) {
+        long long calls = 0;
+        long long batch = 1;
+        const auto t0 = clock::now();
+        auto t1 = t0;
+        while (t1 - t0 < std::chrono::milliseconds(20)) {
+            for (long long i = 0; i < batch; ++i) {
+                func();
+            }
+            calls += batch;
+            batch *= 2;
+            t1 = clock::now();
+        }
+        const double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / calls;
+        best = ns < best ? ns : best;
+    }
+    return best;
+}
+
+template <typename CharT>
+void bench(const char* corpus, const char* encoding, const std::basic_string<CharT>& str, int limit)
+{
+    const CharT* data = str.data();
+    const std::size_t len = str.size();
+    const double t[] = {
+        ns_per_call([&]{ do_not_optimize(virtual_width(limit, data, len)); }),
+        ns_per_call([&]{ do_not_optimize(static_width<8>(limit, data, len)); }),
+        ns_per_call([&]{ do_not_optimize(static_width<16>(limit, data, len)); }),
+        ns_per_call([&]{ do_not_optimize(static_width<32>(limit, data, len)); }),
+        ns_per_call([&]{ do_not_optimize(static_width<64>(limit, data, len)); }),
+        ns_per_call([&]{ do_not_optimize(static_width<128>(limit, data, len)); }),
+        ns_per_call([&]{ do_not_optimize(static_width<256>(limit, data, len)); }),
+    };
+    std::printf( "%-10s %-7s %7zu %9s", corpus, encoding, len
+               , limit == (1 << 30) ? "unlimited" : "80" );
+    for (double x: t) {
+        std::printf(" %10.1f", x);
+    }
+    std::printf("\n");
+}
+
+std::u32string repeat(const std::u32string& piece, std::size_t size)
+{
+    std::u32string str;
+    while (str.size() < size) {
+        str += piece;
+    }
+    str.resize(size);
+    return str;
+}
+
+std::u16string to_utf16(const std::u32string& str)
+{
+    std::u16string out;
+    for (char32_t ch: str) {
+        if (ch < 0x10000) {
+            out.push_back(static_cast<char16_t>(ch));
+        } else {
+            out.push_back(static_cast<char16_t>(0xD7C0 + (ch >> 10)));
+            out.push_back(static_cast<char16_t>(0xDC00 + (ch & 0x3FF)));
+        }
+    }
+    return out;
+}
+
+} // unnamed namespace
+
+int main(int argc, char** argv)
+{
+    const bool quick = argc > 1 && std::strcmp(argv[1], "--quick") == 0;
+    struct corpus {
+        const char* name;
+        std::u32string piece;
+    };
+    const corpus corpora[] = {
+        {"ascii",    U"The quick brown fox jumps over the lazy dog. "},
+        {"cyrillic", U"Съешь же ещё "},
+        {"cjk",      U"漢字仮名交じり文"},
+        {"emoji",    U"\U0001F469‍\U0001F4BB\U0001F44D\U0001F3FD\U0001F1E7\U0001F1F7"},
+    };
+    std::vector<std::size_t> sizes = {8, 64, 1024, 65536};
+    if (quick) {
+        sizes = {64, 1024};
+    }
+    std::printf( "%-10s %-7s %7s %9s %10s %10s %10s %10s %10s %10s %10s   ( ns per call )\n"
+               , "corpus", "enc", "length", "limit", "virtual16"
+               , "static8", "static16", "static32", "static64", "static128", "static256" );
+    for (auto& c: corpora) {
+        for (auto size: sizes) {
+            const auto u32 = repeat(c.piece, size);
+            const auto u16 = to_utf16(u32);
+            for (int limit: {1 << 30, 80}) {
+                bench(c.name, "UTF-16", u16, limit);
+                bench(c.name, "UTF-32", u32, limit);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,476 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+// Measures str_width and str_width_and_pos on UTF-8, UTF-16 and UTF-32
+// strings of several scripts and lengths, and compares them with
+// glibc's wcswidth and with per-codepoint ICU property lookups.
+//
+// Usage: str_width_benchmark [--quick] [--corpus NAME] [--max-size BYTES] [--simd LEVEL]
+
+#include <string_width.hpp>
+#include <string_width/parallel.hpp>
+#include <string_width/column_index.hpp>
+#include <string_width/grapheme_clusters.hpp>
+#include <string_width/line_wrap.hpp>
+#include <string_width/table.hpp>
+#include <string_width/width_cache.hpp>
+#include <unicode/uchar.h>
+#include <unicode/utf8.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__GLIBC__)
+#  include <clocale>
+#  include <cwchar>
+#endif
+
+namespace {
+
+struct corpus_spec {
+    const char* name;
+    std::u32string pattern;     // repeated to fill the requested size
+    const char* invalid_utf8;   // if not null, used instead of pattern for UTF-8
+};
+
+template <typename T>
+void do_not_optimize(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(value) : "memory");
+#else
+    static volatile T sink;
+    sink = value;
+#endif
+}
+
+void append_utf8(std::string& dest, char32_t ch)
+{
+    if (ch < 0x80) {
+        dest.push_back(static_cast<char>(ch));
+    } else if (ch < 0x800) {
+        dest.push_back(static_cast<char>(0xC0 | (ch >> 6)));
+        dest.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+    } else if (ch < 0x10000) {
+        dest.push_back(static_cast<char>(0xE0 | (ch >> 12)));
+        dest.push_back(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
+        dest.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+    } else {
+        dest.push_back(static_cast<char>(0xF0 | (ch >> 18)));
+        dest.push_back(static_cast<char>(0x80 | ((ch >> 12) & 0x3F)));
+        dest.push_back(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
+        dest.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+    }
+}
+
+void append_utf16(std::u16string& dest, char32_t ch)
+{
+    if (ch < 0x10000) {
+        dest.push_back(static_cast<char16_t>(ch));
+    } else {
+        dest.push_back(static_cast<char16_t>(0xD7C0 + (ch >> 10)));
+        dest.push_back(static_cast<char16_t>(0xDC00 + (ch & 0x3FF)));
+    }
+}
+
+// The same text in the three encodings. The size of the UTF-8 version is
+// the nominal size; the other two contain the same codepoints.
+struct sample {
+    std::string u8;
+    std::u16string u16;
+    std::u32string u32;
+};
+
+sample make_sample(const corpus_spec& spec, std::size_t size)
+{
+    sample s;
+    if (spec.invalid_utf8) {
+        const std::size_t piece_len = std::strlen(spec.invalid_utf8);
+        while (s.u8.size() < size) {
+            s.u8.append(spec.invalid_utf8, std::min(piece_len, size - s.u8.size()));
+        }
+        // lone surrogates and out of range values
+        for (std::size_t i = 0; s.u16.size() * 2 < size; ++i) {
+            s.u16.push_back(i % 3 == 0 ? 0xD800 : i % 3 == 1 ? u'a' : 0xDFFF);
+        }
+        for (std::size_t i = 0; s.u32.size() * 4 < size; ++i) {
+            s.u32.push_back(i % 2 == 0 ? 0x110000 : 0xD800);
+        }
+        return s;
+    }
+    for (std::size_t i = 0; ; i = (i + 1) % spec.pattern.size()) {
+        const auto ch = spec.pattern[i];
+        std::string tmp;
+        append_utf8(tmp, ch);
+        if (s.u8.size() + tmp.size() > size) {
+            break;
+        }
+        s.u8 += tmp;
+        append_utf16(s.u16, ch);
+        s.u32.push_back(ch);
+    }
+    return s;
+}
+
+struct timing {
+    double ns_per_call;
+    double gb_per_s;
+};
+
+// Repeats `func` until at least `min_time` elapses and returns the
+// average time per call
+template <typename Func>
+timing measure(std::size_t bytes, Func func)
+{
+    using clock = std::chrono::steady_clock;
+    const auto min_time = std::chrono::milliseconds(20);
+    long long calls = 0;
+    long long batch = 1;
+    const auto t0 = clock::now();
+    auto t1 = t0;
+    while (t1 - t0 < min_time) {
+        for (long long i = 0; i < batch; ++i) {
+            func();
+        }
+        calls += batch;
+        batch *= 2;
+        t1 = clock::now();
+    }
+    const double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / calls;
+    return {ns, static_cast<double>(bytes) / ns};
+}
+
+void report
+    ( const char* corpus, const char* encoding, std::size_t size
+    , const char* function, const char* limit, timing t )
+{
+    std::printf( "%-14s %-7s %9zu  %-22s %-9s %12.1f ns %8.3f GB/s\n"
+               , corpus, encoding, size, function, limit, t.ns_per_call, t.gb_per_s );
+}
+
+template <typename CharT>
+void bench_encoding
+    ( const char* corpus, const char* encoding, std::size_t nominal_size
+    , const std::basic_string<CharT>& str, bool quick )
+{
+    const auto* data = str.data();
+    const auto len = str.size();
+    const int full = string_width::str_width(1 << 30, data, len);
+
+    struct limit_spec {
+        const char* name;
+        int value;
+    };
+    std::vector<limit_spec> limits = {{"unlimited", 1 << 30}};
+    if (! quick) {
+        limits.push_back({"half", full / 2});
+        limits.push_back({"80", 80});
+    }
+    for (auto& lim: limits) {
+        const int limit = lim.value;
+        // throughput is computed over the part of the string that is
+        // actually consumed before the limit is reached
+        const std::size_t bytes = string_width::str_width_and_pos(limit, data, len).pos * sizeof(CharT);
+        report( corpus, encoding, nominal_size, "str_width", lim.name
+              , measure(bytes, [&]{
+                    do_not_optimize(string_width::str_width(limit, data, len));
+                }) );
+        report( corpus, encoding, nominal_size, "str_width_and_pos", lim.name
+              , measure(bytes, [&]{
+                    do_not_optimize(string_width::str_width_and_pos(limit, data, len).pos);
+                }) );
+        const auto tail = string_width::str_tail_width_and_pos(limit, data, len);
+        report( corpus, encoding, nominal_size, "str_tail_width_and_pos", lim.name
+              , measure((len - tail.pos) * sizeof(CharT), [&]{
+                    do_not_optimize(string_width::str_tail_width_and_pos(limit, data, len).pos);
+                }) );
+        if (lim.value == (1 << 30)) {
+            report( corpus, encoding, nominal_size, "column_index build", lim.name
+                  , measure(bytes, [&]{
+                        string_width::column_index<CharT> index(data, len);
+                        do_not_optimize(index.width());
+                    }) );
+        }
+        if (lim.value == (1 << 30)) {
+            report( corpus, encoding, nominal_size, "grapheme_clusters", lim.name
+                  , measure(bytes, [&]{
+                        int w = 0;
+                        for (auto& c: string_width::grapheme_clusters<CharT>(data, len)) {
+                            w += c.width;
+                        }
+                        do_not_optimize(w);
+                    }) );
+            report( corpus, encoding, nominal_size, "wrap_lines", "80"
+                  , measure(bytes, [&]{
+                        std::size_t lines = 0;
+                        string_width::wrap_lines
+                            ( 80, data, len
+                            , [&](const string_width::line_span<CharT>&) { ++lines; } );
+                        do_not_optimize(lines);
+                    }) );
+        }
+        if (bytes >= (1 << 20)) {
+            report( corpus, encoding, nominal_size, "parallel_str_width", lim.name
+                  , measure(bytes, [&]{
+                        do_not_optimize(string_width::parallel_str_width(limit, data, len));
+                    }) );
+            static string_width::worker_pool pool;
+            report( corpus, encoding, nominal_size, "parallel with pool", lim.name
+                  , measure(bytes, [&]{
+                        do_not_optimize(string_width::parallel_str_width(pool, limit, data, len));
+                    }) );
+        }
+    }
+}
+
+// Baseline: one ICU lookup of the East Asian Width and one of the
+// Grapheme Cluster Break property for each codepoint
+int icu_width(const std::string& str)
+{
+    const auto* s = reinterpret_cast<const std::uint8_t*>(str.data());
+    const auto len = static_cast<std::int32_t>(str.size());
+    int width = 0;
+    for (std::int32_t i = 0; i < len; ) {
+        UChar32 ch;
+        U8_NEXT_OR_FFFD(s, i, len, ch);
+        auto gcb = u_getIntPropertyValue(ch, UCHAR_GRAPHEME_CLUSTER_BREAK);
+        if (gcb != U_GCB_EXTEND && gcb != U_GCB_ZWJ && gcb != U_GCB_SPACING_MARK) {
+            auto eaw = u_getIntPropertyValue(ch, UCHAR_EAST_ASIAN_WIDTH);
+            width += (eaw == U_EA_WIDE || eaw == U_EA_FULLWIDTH) ? 2 : 1;
+        }
+    }
+    return width;
+}
+
+void bench_baselines(const char* corpus, std::size_t nominal_size, const sample& s)
+{
+    report( corpus, "UTF-8", nominal_size, "ICU properties", "unlimited"
+          , measure(s.u8.size(), [&]{ do_not_optimize(icu_width(s.u8)); }) );
+
+#if defined(__GLIBC__)
+    static_assert(sizeof(wchar_t) == 4, "");
+    const std::wstring wstr(s.u32.begin(), s.u32.end());
+    report( corpus, "UTF-32", nominal_size, "glibc wcswidth", "unlimited"
+          , measure(wstr.size() * 4, [&]{
+                do_not_optimize(wcswidth(wstr.data(), wstr.size()));
+            }) );
+#endif
+}
+
+// Many short strings, as the cells of a table: one call per string
+// versus the batch functions
+template <typename CharT>
+void bench_cells(const char* encoding, const std::vector<std::basic_string<CharT>>& cells)
+{
+    std::vector<string_width::width_query<CharT>> queries;
+    std::size_t bytes = 0;
+    for (auto& c: cells) {
+        queries.push_back({c.data(), c.size(), 1 << 30});
+        bytes += c.size() * sizeof(CharT);
+    }
+    std::vector<string_width::width_t> widths(queries.size());
+    const auto size = queries.size();
+    report( "cells", encoding, size, "str_width loop", "unlimited"
+          , measure(bytes, [&]{
+                for (std::size_t i = 0; i < size; ++i) {
+                    widths[i] = string_width::str_width(queries[i].limit, queries[i].str, queries[i].str_len);
+                }
+                do_not_optimize(widths[0]);
+            }) );
+    report( "cells", encoding, size, "str_width_batch", "unlimited"
+          , measure(bytes, [&]{
+                string_width::str_width_batch(queries.data(), size, widths.data());
+                do_not_optimize(widths[0]);
+            }) );
+    report( "cells", encoding, size, "max_str_width", "unlimited"
+          , measure(bytes, [&]{
+                do_not_optimize(string_width::max_str_width(queries.data(), size, 1 << 30).width);
+            }) );
+}
+
+// Renders the cells as a table of 4 columns whose maximum width is 12:
+// measuring each cell to size the columns and then again to cut and pad
+// it, versus table_layout
+template <typename CharT>
+void bench_table(const char* encoding, const std::vector<std::basic_string<CharT>>& cells)
+{
+    const std::size_t cols = 4;
+    const int max_width = 12;
+    std::size_t bytes = 0;
+    for (auto& c: cells) {
+        bytes += c.size() * sizeof(CharT);
+    }
+    std::basic_string<CharT> out;
+    report( "table", encoding, cells.size(), "measure twice", "12"
+          , measure(bytes, [&]{
+                out.clear();
+                int widths[cols] = {0, 0, 0, 0};
+                for (std::size_t i = 0; i < cells.size(); ++i) {
+                    const auto w = string_width::str_width(max_width, cells[i].data(), cells[i].size());
+                    widths[i % cols] = std::max(widths[i % cols], w);
+                }
+                for (std::size_t i = 0; i < cells.size(); ++i) {
+                    const auto res = string_width::str_width_and_pos
+                        (max_width, cells[i].data(), cells[i].size());
+                    out.append(cells[i].data(), res.pos);
+                    out.append(static_cast<std::size_t>(widths[i % cols] - res.width), ' ');
+                    out.push_back(i % cols + 1 == cols ? '\n' : ' ');
+                }
+                do_not_optimize(out.size());
+            }) );
+    report( "table", encoding, cells.size(), "table_layout", "12"
+          , measure(bytes, [&]{
+                out.clear();
+                string_width::table_layout<CharT> table(cols);
+                table.reserve_rows(cells.size() / cols);
+                for (std::size_t c = 0; c < cols; ++c) {
+                    table.set_column(c, max_width);
+                }
+                for (auto& c: cells) {
+                    table.add_cell(c.data(), c.size());
+                }
+                table.write([&](const CharT* str, std::size_t len) { out.append(str, len); });
+                do_not_optimize(out.size());
+            }) );
+}
+
+// The same few hundred cells measured over and over: str_width versus
+// width_cache ( after the first round, all calls are hits or bypassed )
+template <typename CharT>
+void bench_cache(const char* encoding, const std::vector<std::basic_string<CharT>>& cells)
+{
+    const std::size_t count = 512;
+    std::size_t bytes = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        bytes += cells[i].size() * sizeof(CharT);
+    }
+    string_width::width_cache<CharT> cache;
+    report( "repeated", encoding, count, "str_width loop", "unlimited"
+          , measure(bytes, [&]{
+                int w = 0;
+                for (std::size_t i = 0; i < count; ++i) {
+                    w += string_width::str_width(1 << 30, cells[i].data(), cells[i].size());
+                }
+                do_not_optimize(w);
+            }) );
+    report( "repeated", encoding, count, "width_cache", "unlimited"
+          , measure(bytes, [&]{
+                int w = 0;
+                for (std::size_t i = 0; i < count; ++i) {
+                    w += cache.str_width(1 << 30, cells[i].data(), cells[i].size());
+                }
+                do_not_optimize(w);
+            }) );
+}
+
+void bench_cells(const corpus_spec* corpora, std::size_t corpora_count)
+{
+    std::vector<std::string> u8;
+    std::vector<std::u16string> u16;
+    std::vector<std::u32string> u32;
+    for (std::size_t i = 0; i < 10000; ++i) {
+        const auto& spec = corpora[i % corpora_count];
+        const auto s = make_sample(spec, 4 + (i * 7) % 29);
+        u8.push_back(s.u8);
+        u16.push_back(s.u16);
+        u32.push_back(s.u32);
+    }
+    bench_cells("UTF-8", u8);
+    bench_cells("UTF-16", u16);
+    bench_cells("UTF-32", u32);
+    bench_table("UTF-8", u8);
+    bench_table("UTF-16", u16);
+    bench_table("UTF-32", u32);
+    bench_cache("UTF-8", u8);
+    bench_cache("UTF-16", u16);
+    bench_cache("UTF-32", u32);
+}
+
+} // unnamed namespace
+
+int main(int argc, char** argv)
+{
+    bool quick = false;
+    const char* only_corpus = nullptr;
+    std::size_t max_size = std::size_t(16) << 20;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+            max_size = std::size_t(64) << 10;
+        } else if (std::strcmp(argv[i], "--corpus") == 0 && i + 1 < argc) {
+            only_corpus = argv[++i];
+        } else if (std::strcmp(argv[i], "--max-size") == 0 && i + 1 < argc) {
+            max_size = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--simd") == 0 && i + 1 < argc) {
+            // scalar, sse2, sse4.2, avx2 or avx512
+            const char* const names[] = {"scalar", "sse2", "sse4.2", "avx2", "avx512"};
+            const char* name = argv[++i];
+            int level = 0;
+            while (level < 5 && std::strcmp(names[level], name) != 0) {
+                ++level;
+            }
+            if (level == 5) {
+                std::fprintf(stderr, "unknown simd level: %s\n", name);
+                return 1;
+            }
+            const auto set = string_width::set_simd_level(static_cast<string_width::simd_level>(level));
+            std::printf("simd level: %s\n", names[static_cast<int>(set)]);
+        } else {
+            std::fprintf( stderr, "usage: %s [--quick] [--corpus NAME] [--max-size BYTES] [--simd LEVEL]\n"
+                        , argv[0] );
+            return 1;
+        }
+    }
+#if defined(__GLIBC__)
+    if (! std::setlocale(LC_ALL, "C.UTF-8")) {
+        std::setlocale(LC_ALL, "en_US.UTF-8");
+    }
+#endif
+
+    const corpus_spec corpora[] = {
+        {"ascii",      U"The quick brown fox jumps over the lazy dog. 0123456789 ", nullptr},
+        {"latin",      U"Cr\u00E8me br\u00FBl\u00E9e, na\u00EFve fa\u00E7ade, \u00E0 la carte. ", nullptr},
+        {"cyrillic",   U"\u0421\u044A\u0435\u0448\u044C \u0436\u0435 \u0435\u0449\u0451 ", nullptr},
+        {"cjk",        U"\u6F22\u5B57\u4EEE\u540D\u4EA4\u3058\u308A\u6587\u3002", nullptr},
+        // ideographs only, and precomposed Hangul syllables between spaces
+        {"chinese",    U"\u4E2D\u6587\u6587\u672C\u5904\u7406\u901F\u5EA6\u6D4B\u8BD5", nullptr},
+        {"korean",     U"\uD55C\uAD6D\uC5B4 \uD14D\uC2A4\uD2B8\uB97C \uCC98\uB9AC\uD569\uB2C8\uB2E4. ", nullptr},
+        {"devanagari", U"\u0915\u094D\u0937\u093F \u0928\u092E\u0938\u094D\u0924\u0947 ", nullptr},
+        // conjoining jamo ( L V T sequences ) and precomposed syllables
+        {"hangul",     U"\u1112\u1161\u11AB\u1100\u1173\u11AF \uD55C\uAE00 ", nullptr},
+        {"emoji_zwj",  U"\U0001F469\u200D\U0001F4BB\U0001F44D\U0001F3FD"
+                       U"\U0001F1E7\U0001F1F7\U0001F468\u200D\U0001F469\u200D\U0001F467", nullptr},
+        {"invalid",    U"", "\xE0\x80" "a" "\xF0\x90\x80" "\xFF" "\xC3" "b" "\xED\xA0\x80"},
+    };
+    const std::size_t sizes[] = {
+        4, 64, 1 << 10, 16 << 10, 64 << 10, 256 << 10, 1 << 20, 4 << 20, 16 << 20
+    };
+
+    std::printf( "%-14s %-7s %9s  %-22s %-9s %15s %13s\n"
+               , "corpus", "enc", "bytes", "function", "limit", "time/call", "throughput" );
+    for (auto& spec: corpora) {
+        if (only_corpus && std::strcmp(only_corpus, spec.name) != 0) {
+            continue;
+        }
+        for (auto size: sizes) {
+            if (size > max_size) {
+                break;
+            }
+            const auto s = make_sample(spec, size);
+            bench_encoding(spec.name, "UTF-8", size, s.u8, quick);
+            bench_encoding(spec.name, "UTF-16", size, s.u16, quick);
+            bench_encoding(spec.name, "UTF-32", size, s.u32, quick);
+            bench_baselines(spec.name, size, s);
+        }
+    }
+    if (! only_corpus || std::strcmp(only_corpus, "cells") == 0) {
+        bench_cells(corpora, sizeof(corpora) / sizeof(corpora[0]));
+    }
+    return 0;
+}
@@ -0,0 +1,728 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+// Differential fuzzer: measures arbitrary strings with every engine of
+// string_width, and compares the results with each other and with a slow
+// reference built on ICU's grapheme cluster break iterator.
+//
+// Each input is a sequence of bytes. The first one selects the encoding
+// ( bits 0 and 1: UTF-8, UTF-16 or UTF-32 ) and the surrogate policy
+// ( bit 2 ), the second one selects the width limit, and the others are
+// the code units of the string, in the native byte order.
+//
+// When compiled with STRING_WIDTH_LIBFUZZER, this file only provides
+// LLVMFuzzerTestOneInput, for libFuzzer. Otherwise it is a standalone
+// program that generates random inputs, or checks the files passed as
+// arguments ( like the crash files saved by libFuzzer ):
+//
+//     differential_fuzzer [--iterations N] [--seed S] [FILE...]
+//
+// When an input fails, it is minimized ( by removing code units,
+// simplifying the remaining ones and lowering the limit while it still
+// fails ) and printed.
+//
+// The reference only covers the std_format width profile. The other
+// profiles are only compared between the engines. An input is not compared with the reference if it
+// contains a codepoint for which ICU does not have the same grapheme
+// cluster break category or width as string_width, since the Unicode
+// version of ICU may be different ( tests/ch32_width_gcb_prop_tree.cpp
+// reports such codepoints ), nor if ICU may split it by a segmentation
+// rule that is newer than the ones string_width follows.
+
+#include <unicode/uchar.h>
+#include <unicode/ubrk.h>
+#include <unicode/utf8.h>
+#include <unicode/utf16.h>
+#include <string_width.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+enum class encoding { utf8, utf16, utf32 };
+
+struct fuzz_input {
+    ::encoding enc;
+    string_width::surrogate_policy surr_poli;
+    string_width::width_t limit;
+    std::vector<unsigned char> payload;
+};
+
+fuzz_input parse_input(const std::uint8_t* data, std::size_t size)
+{
+    fuzz_input in = { encoding::utf8, string_width::surrogate_policy::strict, 0, {} };
+    if (size >= 1) {
+        const unsigned enc_bits = data[0] & 3;
+        in.enc = enc_bits == 1 ? encoding::utf16 : enc_bits == 2 ? encoding::utf32 : encoding::utf8;
+        in.surr_poli = (data[0] & 4) ? string_width::surrogate_policy::lax
+                                     : string_width::surrogate_policy::strict;
+    }
+    if (size >= 2) {
+        // mostly small limits, but also negative and unreachable ones
+        in.limit = data[1] < 0xF0 ? data[1]
+                 : data[1] < 0xF8 ? -1 - (data[1] & 7)
+                 : (1 << 20);
+    }
+    if (size > 2) {
+        in.payload.assign(data + 2, data + size);
+    }
+    return in;
+}
+
+std::vector<unsigned char> serialize(const fuzz_input& in)
+{
+    std::vector<unsigned char> data;
+    data.reserve(2 + in.payload.size());
+    data.push_back(static_cast<unsigned char>
+        ( (in.enc == encoding::utf16 ? 1 : in.enc == encoding::utf32 ? 2 : 0)
+        | (in.surr_poli == string_width::surrogate_policy::lax ? 4 : 0) ));
+    data.push_back(static_cast<unsigned char>
+        ( in.limit >= 0 && in.limit < 0xF0 ? in.limit
+        : in.limit < 0 ? 0xF0 + ((-1 - in.limit) & 7)
+        : 0xF8 ));
+    data.insert(data.end(), in.payload.begin(), in.payload.end());
+    return data;
+}
+
+std::size_t unit_size(encoding enc)
+{
+    return enc == encoding::utf8 ? 1 : enc == encoding::utf16 ? 2 : 4;
+}
+
+// ---------------------------------------------------------------------------
+// Reference
+// ---------------------------------------------------------------------------
+
+struct reference_codepoint {
+    UChar32 ch;
+    std::size_t pos; // in code units
+};
+
+// Decodes like the library documents it: each maximal subpart of an
+// ill-formed sequence becomes one U+FFFD, and, with the lax policy,
+// surrogates are codepoints like any other.
+template <typename CharT>
+std::vector<reference_codepoint> reference_decode
+    ( const CharT* str
+    , std::size_t len
+    , string_width::surrogate_policy surr_poli )
+{
+    const bool lax = surr_poli == string_width::surrogate_policy::lax;
+    std::vector<reference_codepoint> cps;
+    std::size_t i = 0;
+    while (i < len) {
+        const std::size_t pos = i;
+        UChar32 ch;
+        if (sizeof(CharT) == 1) {
+            const auto* s = reinterpret_cast<const std::uint8_t*>(str);
+            if ( lax && s[i] == 0xED && i + 1 < len
+              && s[i + 1] >= 0xA0 && s[i + 1] <= 0xBF ) {
+                // U8_NEXT would see an ill-formed sequence of one byte
+                if (i + 2 < len && (s[i + 2] & 0xC0) == 0x80) {
+                    ch = 0xD000 | ((s[i + 1] & 0x3F) << 6) | (s[i + 2] & 0x3F);
+                    i += 3;
+                } else {
+                    ch = 0xFFFD;
+                    i += 2;
+                }
+            } else {
+                U8_NEXT(s, i, len, ch);
+                if (ch < 0) {
+                    ch = 0xFFFD;
+                }
+            }
+        } else if (sizeof(CharT) == 2) {
+            const auto* s = reinterpret_cast<const UChar*>(str);
+            U16_NEXT(s, i, len, ch);
+            if (U_IS_SURROGATE(ch) && ! lax) {
+                ch = 0xFFFD;
+            }
+        } else {
+            const auto value = static_cast<std::uint32_t>(str[i]);
+            ch = value < 0x110000 ? static_cast<UChar32>(value) : 0xFFFD;
+            ++i;
+        }
+        cps.push_back({ch, pos});
+    }
+    return cps;
+}
+
+// The same rule as in tests/ch32_width_gcb_prop_tree.cpp
+bool is_fullwidth(UChar32 ch)
+{
+    return  (0x1100 <= ch && ch <= 0x115F)
+        ||  (0x2329 <= ch && ch <= 0x232A)
+        ||  (0x2E80 <= ch && ch <= 0x303E)
+        ||  (0x3040 <= ch && ch <= 0xA4CF)
+        ||  (0xAC00 <= ch && ch <= 0xD7A3)
+        ||  (0xF900 <= ch && ch <= 0xFAFF)
+        ||  (0xFE10 <= ch && ch <= 0xFE19)
+        ||  (0xFE30 <= ch && ch <= 0xFE6F)
+        ||  (0xFF00 <= ch && ch <= 0xFF60)
+        ||  (0xFFE0 <= ch && ch <= 0xFFE6)
+        || (0x1F300 <= ch && ch <= 0x1F64F)
+        || (0x1F900 <= ch && ch <= 0x1F9FF)
+        || (0x20000 <= ch && ch <= 0x2FFFD)
+        || (0x30000 <= ch && ch <= 0x3FFFD);
+}
+
+std::uint8_t icu_category(UChar32 ch)
+{
+    namespace prop = string_width::detail::prop;
+    if (u_getIntPropertyValue(ch, UCHAR_EXTENDED_PICTOGRAPHIC)) {
+        return prop::extended_picto;
+    }
+    switch (u_getIntPropertyValue(ch, UCHAR_GRAPHEME_CLUSTER_BREAK)) {
+        case U_GCB_CONTROL: return prop::control;
+        case U_GCB_CR: return prop::cr;
+        case U_GCB_LF: return prop::lf;
+        case U_GCB_EXTEND: return prop::extend;
+        case U_GCB_ZWJ: return prop::zwj;
+        case U_GCB_SPACING_MARK: return prop::spacing_mark;
+        case U_GCB_PREPEND: return prop::prepend;
+        case U_GCB_L: return prop::hangul_l;
+        case U_GCB_V: return prop::hangul_v;
+        case U_GCB_T: return prop::hangul_t;
+        case U_GCB_LV: return prop::hangul_lv;
+        case U_GCB_LVT: return prop::hangul_lvt;
+        case U_GCB_REGIONAL_INDICATOR: return prop::regional_indicator;
+        default: return prop::other;
+    }
+}
+
+// Whether ICU and string_width agree on the properties of `ch`
+bool same_properties(UChar32 ch)
+{
+    namespace prop = string_width::detail::prop;
+    const auto props = string_width::detail::ch32_props(static_cast<char32_t>(ch));
+    return (props & prop::category_mask) == icu_category(ch)
+        && ((props & prop::double_width) != 0) == is_fullwidth(ch);
+}
+
+// Whether ICU may split `cps` by rules that string_width does not follow.
+// string_width follows revision 37 of UAX #29. ICU 74 ( Unicode 15.1 ) added
+// rule GB9c, which does not break between Indic consonants joined by
+// a linker ( like U+0915 U+094D U+0937 ). So the strings that contain
+// a linker are not compared with ICU 74 or later.
+bool icu_has_newer_rules_for(const std::vector<reference_codepoint>& cps)
+{
+#if U_ICU_VERSION_MAJOR_NUM >= 74
+    for (const auto& cp: cps) {
+        if (u_getIntPropertyValue(cp.ch, UCHAR_INDIC_CONJUNCT_BREAK) == U_INCB_LINKER) {
+            return true;
+        }
+    }
+#else
+    (void) cps;
+#endif
+    return false;
+}
+
+// The positions, in codepoints, where the grapheme clusters start,
+// followed by the number of codepoints. ICU's break iterator works on
+// UTF-16, where a high surrogate codepoint followed by a low one would be
+// taken as a pair. So the text is split between them. There is always a
+// boundary there anyway, since surrogates are not extending characters.
+std::vector<std::size_t> reference_clusters(const std::vector<reference_codepoint>& cps)
+{
+    std::vector<std::size_t> starts;
+    std::size_t first = 0;
+    while (first < cps.size()) {
+        std::size_t last = first;
+        std::vector<UChar> text;
+        std::vector<std::size_t> cp_index; // indexed by UTF-16 offset
+        while ( last < cps.size()
+             && ( last == first || ! U_IS_TRAIL(cps[last].ch)
+               || ! U_IS_LEAD(cps[last - 1].ch) ) ) {
+            UChar units[2];
+            std::size_t n = 0;
+            U16_APPEND_UNSAFE(units, n, cps[last].ch);
+            for (std::size_t k = 0; k < n; ++k) {
+                text.push_back(units[k]);
+                cp_index.push_back(last);
+            }
+            ++last;
+        }
+        cp_index.push_back(last);
+        UErrorCode status = U_ZERO_ERROR;
+        UBreakIterator* bi = ubrk_open
+            ( UBRK_CHARACTER, "", text.data(), static_cast<int32_t>(text.size()), &status );
+        if (U_FAILURE(status)) {
+            std::fprintf(stderr, "ubrk_open failed: %s\n", u_errorName(status));
+            std::abort();
+        }
+        for (int32_t b = ubrk_first(bi); b != UBRK_DONE; b = ubrk_next(bi)) {
+            if (static_cast<std::size_t>(b) < text.size()) {
+                starts.push_back(cp_index[static_cast<std::size_t>(b)]);
+            }
+        }
+        ubrk_close(bi);
+        first = last;
+    }
+    starts.push_back(cps.size());
+    return starts;
+}
+
+// ---------------------------------------------------------------------------
+// Checks
+// ---------------------------------------------------------------------------
+
+struct fuzz_stats {
+    std::uint64_t inputs = 0;
+    std::uint64_t compared_with_icu = 0;
+    bool minimizing = false;
+};
+
+fuzz_stats stats;
+
+struct checker {
+    std::string failure;
+
+    void fail(const char* engine, const char* what, long got, long expected)
+    {
+        if (failure.empty()) {
+            char buff[256];
+            std::snprintf( buff, sizeof(buff), "%s: %s is %ld ( expected %ld )"
+                         , engine, what, got, expected );
+            failure = buff;
+        }
+    }
+
+    void compare
+        ( const char* engine
+        , string_width::width_and_pos got
+        , string_width::width_and_pos expected )
+    {
+        if (got.width != expected.width) {
+            fail(engine, "width", got.width, expected.width);
+        }
+        if (got.pos != expected.pos) {
+            fail(engine, "pos", (long)got.pos, (long)expected.pos);
+        }
+    }
+
+    void compare_width(const char* engine, string_width::width_t got, string_width::width_t expected)
+    {
+        if (got != expected) {
+            fail(engine, "width", got, expected);
+        }
+    }
+};
+
+const string_width::simd_level simd_levels[] = {
+    string_width::simd_level::scalar,
+    string_width::simd_level::sse2,
+    string_width::simd_level::sse4_2,
+    string_width::simd_level::avx2,
+    string_width::simd_level::avx512 };
+
+const char* simd_level_name(string_width::simd_level level)
+{
+    switch (level) {
+        case string_width::simd_level::scalar: return "scalar";
+        case string_width::simd_level::sse2: return "sse2";
+        case string_width::simd_level::sse4_2: return "sse4_2";
+        case string_width::simd_level::avx2: return "avx2";
+        default: return "avx512";
+    }
+}
+
+// Compares the engines of a width profile other than std_format with
+// each other.
+template <string_width::width_profile Profile, typename CharT>
+void check_profile
+    ( checker& chk
+    , const char* profile_name
+    , const CharT* str
+    , std::size_t len
+    , string_width::width_t limit
+    , string_width::surrogate_policy surr_poli
+    , bool well_formed )
+{
+    namespace sw = string_width;
+    const auto detected = sw::detected_simd_level();
+    sw::set_simd_level(sw::simd_level::scalar);
+    const auto expected = sw::str_width_and_pos<Profile>(limit, str, len, surr_poli);
+    const auto calc = sw::detail::std_width_calc<true, false, Profile>
+        (str, str + len, limit, sw::detail::grapheme_state::initial, surr_poli);
+    char engine[64];
+    std::snprintf(engine, sizeof(engine), "%s std_width_calc", profile_name);
+    chk.compare(engine, {limit - calc.width, static_cast<std::size_t>(calc.ptr - str)}, expected);
+    for (auto level: simd_levels) {
+        if (level > detected) {
+            break;
+        }
+        sw::set_simd_level(level);
+        std::snprintf(engine, sizeof(engine), "%s str_width_and_pos, %s", profile_name, simd_level_name(level));
+        chk.compare(engine, sw::str_width_and_pos<Profile>(limit, str, len, surr_poli), expected);
+        std::snprintf(engine, sizeof(engine), "%s str_width, %s", profile_name, simd_level_name(level));
+        chk.compare_width(engine, sw::str_width<Profile>(limit, str, len, surr_poli), expected.width);
+        if (well_formed) {
+            std::snprintf(engine, sizeof(engine), "%s assume_valid, %s", profile_name, simd_level_name(level));
+            chk.compare( engine
+                       , sw::str_width_and_pos<Profile>(limit, str, len, sw::validation_policy::assume_valid)
+                       , expected );
+        }
+    }
+    sw::set_simd_level(detected);
+}
+
+template <typename CharT>
+std::string check_string
+    ( const CharT* str
+    , std::size_t len
+    , string_width::width_t limit
+    , string_width::surrogate_policy surr_poli )
+{
+    namespace sw = string_width;
+    checker chk;
+
+    const auto cps = reference_decode(str, len, surr_poli);
+    bool comparable = ! icu_has_newer_rules_for(cps);
+    for (std::size_t i = 0; comparable && i < cps.size(); ++i) {
+        comparable = same_properties(cps[i].ch);
+    }
+    const bool well_formed = surr_poli == sw::surrogate_policy::strict
+        && sw::detail::is_well_formed(str, str + len);
+
+    // the engine used in constant evaluation serves as the baseline of
+    // the other ones
+    const auto calc = sw::detail::std_width_calc<true>
+        (str, str + len, limit, sw::detail::grapheme_state::initial, surr_poli);
+    const sw::width_and_pos expected = {limit - calc.width, static_cast<std::size_t>(calc.ptr - str)};
+
+    if (comparable) {
+        stats.compared_with_icu += ! stats.minimizing;
+        const auto starts = reference_clusters(cps);
+        sw::width_and_pos ref = {0, 0};
+        for (std::size_t c = 0; c + 1 < starts.size(); ++c) {
+            const sw::width_t w = is_fullwidth(cps[starts[c]].ch) ? 2 : 1;
+            if (ref.width + w > limit) {
+                // the library reports the limit as the width then
+                ref.width = limit;
+                break;
+            }
+            ref.width += w;
+            ref.pos = starts[c + 1] < cps.size() ? cps[starts[c + 1]].pos : len;
+        }
+        chk.compare("std_width_calc, against ICU", expected, ref);
+    }
+
+    const auto detected = sw::detected_simd_level();
+    char engine[64];
+    for (auto level: simd_levels) {
+        if (level > detected) {
+            break;
+        }
+        sw::set_simd_level(level);
+        const char* level_name = simd_level_name(level);
+        std::snprintf(engine, sizeof(engine), "str_width_and_pos, %s", level_name);
+        chk.compare(engine, sw::str_width_and_pos(limit, str, len, surr_poli), expected);
+        std::snprintf(engine, sizeof(engine), "str_width, %s", level_name);
+        chk.compare_width(engine, sw::str_width(limit, str, len, surr_poli), expected.width);
+        if (well_formed) {
+            std::snprintf(engine, sizeof(engine), "str_width_and_pos assume_valid, %s", level_name);
+            chk.compare( engine
+                       , sw::str_width_and_pos(limit, str, len, sw::validation_policy::assume_valid)
+                       , expected );
+            std::snprintf(engine, sizeof(engine), "str_width assume_valid, %s", level_name);
+            chk.compare_width( engine
+                             , sw::str_width(limit, str, len, sw::validation_policy::assume_valid)
+                             , expected.width );
+        }
+        std::snprintf(engine, sizeof(engine), "count_codepoints, %s", level_name);
+        const auto count = sw::count_codepoints(str, len, surr_poli);
+        if (count != cps.size()) {
+            chk.fail(engine, "count", (long)count, (long)cps.size());
+        }
+    }
+    sw::set_simd_level(detected);
+
+    if (limit > 0) {
+        // the width decrementers, which decode into a buffer
+        sw::detail::std_width_decrementer decr{0};
+        chk.compare_width( "std_width_decrementer"
+                         , sw::detail::str_width(decr, limit, str, len, surr_poli)
+                         , expected.width );
+        sw::detail::std_width_decrementer_with_pos decr_pos{0};
+        chk.compare( "std_width_decrementer_with_pos"
+                   , sw::detail::str_width_and_pos(decr_pos, limit, str, len, surr_poli)
+                   , expected );
+    }
+
+    check_profile<sw::width_profile::east_asian_wide>
+        (chk, "east_asian_wide", str, len, limit, surr_poli, well_formed);
+    check_profile<sw::width_profile::wcwidth>
+        (chk, "wcwidth", str, len, limit, surr_poli, well_formed);
+    return chk.failure;
+}
+
+// Returns a description of the failure, or an empty string
+std::string check(const fuzz_input& in)
+{
+    const std::size_t usize = unit_size(in.enc);
+    const std::size_t len = in.payload.size() / usize;
+    if (in.enc == encoding::utf8) {
+        return check_string(reinterpret_cast<const char*>(in.payload.data()), len, in.limit, in.surr_poli);
+    }
+    if (in.enc == encoding::utf16) {
+        std::vector<char16_t> str(len);
+        std::memcpy(str.data(), in.payload.data(), len * usize);
+        return check_string(str.data(), len, in.limit, in.surr_poli);
+    }
+    std::vector<char32_t> str(len);
+    std::memcpy(str.data(), in.payload.data(), len * usize);
+    return check_string(str.data(), len, in.limit, in.surr_poli);
+}
+
+// ---------------------------------------------------------------------------
+// Minimization
+// ---------------------------------------------------------------------------
+
+void minimize(fuzz_input& in)
+{
+    const std::size_t usize = unit_size(in.enc);
+    in.payload.resize(in.payload.size() / usize * usize);
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        // remove chunks of code units, from large to small ones
+        for (std::size_t chunk = in.payload.size() / usize; chunk > 0; chunk /= 2) {
+            for (std::size_t i = 0; i + chunk * usize <= in.payload.size(); ) {
+                fuzz_input candidate = in;
+                candidate.payload.erase
+                    ( candidate.payload.begin() + static_cast<std::ptrdiff_t>(i)
+                    , candidate.payload.begin() + static_cast<std::ptrdiff_t>(i + chunk * usize) );
+                if (! check(candidate).empty()) {
+                    in = candidate;
+                    progress = true;
+                } else {
+                    i += usize;
+                }
+            }
+        }
+        // replace code units by 'a'
+        for (std::size_t i = 0; i < in.payload.size(); i += usize) {
+            fuzz_input candidate = in;
+            std::memset(&candidate.payload[i], 0, usize);
+            std::memset(&candidate.payload[i], 'a', 1); // little-endian
+            if (candidate.payload != in.payload && ! check(candidate).empty()) {
+                in = candidate;
+                progress = true;
+            }
+        }
+        // lower the limit, but only to the values that serialize encodes
+        // as they are, so that the printed input fails the same way
+        const string_width::width_t max_small_limit = 0xEF;
+        const string_width::width_t limits[] =
+            { 0, (std::min)(in.limit / 2, max_small_limit)
+            , (std::min)(in.limit - 1, max_small_limit) };
+        for (auto limit: limits) {
+            if (limit >= 0 && limit < in.limit) {
+                fuzz_input candidate = in;
+                candidate.limit = limit;
+                if (! check(candidate).empty()) {
+                    in = candidate;
+                    progress = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void print_counterexample(const fuzz_input& in, const std::string& failure)
+{
+    const std::size_t usize = unit_size(in.enc);
+    std::printf( "Counterexample ( %s, surrogate_policy::%s, limit %d ):\n    "
+               , in.enc == encoding::utf8 ? "UTF-8" : in.enc == encoding::utf16 ? "UTF-16" : "UTF-32"
+               , in.surr_poli == string_width::surrogate_policy::lax ? "lax" : "strict"
+               , in.limit );
+    for (std::size_t i = 0; i + usize <= in.payload.size(); i += usize) {
+        std::uint32_t unit = 0;
+        std::memcpy(&unit, &in.payload[i], usize);
+        std::printf("%0*X ", static_cast<int>(usize * 2), unit);
+    }
+    std::printf("\n    %s\n    input bytes:", failure.c_str());
+    for (auto byte: serialize(in)) {
+        std::printf(" %02X", byte);
+    }
+    std::printf("\n");
+}
+
+// Returns whether the input passed. Otherwise, prints it minimized.
+bool run_one(const std::uint8_t* data, std::size_t size)
+{
+    ++stats.inputs;
+    auto in = parse_input(data, size);
+    const auto failure = check(in);
+    if (failure.empty()) {
+        return true;
+    }
+    stats.minimizing = true;
+    minimize(in);
+    print_counterexample(in, check(in));
+    stats.minimizing = false;
+    return false;
+}
+
+} // unnamed namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+    if (! run_one(data, size)) {
+        std::abort();
+    }
+    return 0;
+}
+
+#if ! defined(STRING_WIDTH_LIBFUZZER)
+
+namespace {
+
+void append_codepoint(std::vector<unsigned char>& payload, encoding enc, char32_t ch)
+{
+    if (enc == encoding::utf8) {
+        if (ch < 0x80) {
+            payload.push_back(static_cast<unsigned char>(ch));
+        } else if (ch < 0x800) {
+            payload.push_back(static_cast<unsigned char>(0xC0 | (ch >> 6)));
+            payload.push_back(static_cast<unsigned char>(0x80 | (ch & 0x3F)));
+        } else if (ch < 0x10000) {
+            payload.push_back(static_cast<unsigned char>(0xE0 | (ch >> 12)));
+            payload.push_back(static_cast<unsigned char>(0x80 | ((ch >> 6) & 0x3F)));
+            payload.push_back(static_cast<unsigned char>(0x80 | (ch & 0x3F)));
+        } else {
+            payload.push_back(static_cast<unsigned char>(0xF0 | (ch >> 18)));
+            payload.push_back(static_cast<unsigned char>(0x80 | ((ch >> 12) & 0x3F)));
+            payload.push_back(static_cast<unsigned char>(0x80 | ((ch >> 6) & 0x3F)));
+            payload.push_back(static_cast<unsigned char>(0x80 | (ch & 0x3F)));
+        }
+    } else if (enc == encoding::utf16) {
+        char16_t units[2];
+        std::size_t n = 1;
+        if (ch < 0x10000) {
+            units[0] = static_cast<char16_t>(ch);
+        } else {
+            units[0] = static_cast<char16_t>(0xD800 + ((ch - 0x10000) >> 10));
+            units[1] = static_cast<char16_t>(0xDC00 + ((ch - 0x10000) & 0x3FF));
+            n = 2;
+        }
+        const auto* bytes = reinterpret_cast<const unsigned char*>(units);
+        payload.insert(payload.end(), bytes, bytes + n * 2);
+    } else {
+        const auto* bytes = reinterpret_cast<const unsigned char*>(&ch);
+        payload.insert(payload.end(), bytes, bytes + 4);
+    }
+}
+
+// Codepoints that are relevant to the grapheme cluster rules or to the
+// SIMD fast paths, mixed with arbitrary ones.
+char32_t random_codepoint(std::mt19937& rng)
+{
+    static const char32_t samples[] = {
+        U'a', U' ', U'\r', U'\n', 0x7F, 0xAD, 0x0301, 0x0903, 0x0600, 0x200D,
+        0x1100, 0x1160, 0x11A8, 0xAC00, 0xAC01, 0x4E00, 0x9FFF, 0xD7A3, 0xFFFD,
+        0x1F1E6, 0x1F1E7, 0x1F3FB, 0x1F468, 0x1F600, 0x2764, 0xFE0F, 0xE0100,
+        0x2E80, 0x3000, 0x1F300 };
+    switch (rng() % 6) {
+        case 0:
+        case 1:  return samples[rng() % (sizeof(samples) / sizeof(samples[0]))];
+        case 2:  return 0x20 + rng() % 0x5F;
+        case 3:  return rng() % 0x3000;
+        case 4:  return rng() % 0x10000;
+        default: return rng() % 0x110000;
+    }
+}
+
+std::vector<unsigned char> random_input(std::mt19937& rng)
+{
+    fuzz_input in;
+    const unsigned enc_bits = rng() % 3;
+    in.enc = enc_bits == 1 ? encoding::utf16 : enc_bits == 2 ? encoding::utf32 : encoding::utf8;
+    in.surr_poli = rng() % 2 ? string_width::surrogate_policy::lax
+                             : string_width::surrogate_policy::strict;
+    const std::size_t count = rng() % 4 == 0 ? rng() % 200 : rng() % 24;
+    for (std::size_t i = 0; i < count; ++i) {
+        const char32_t ch = random_codepoint(rng);
+        const int repeat = rng() % 4 == 0 ? 1 + rng() % 40 : 1;
+        for (int r = 0; r < repeat; ++r) {
+            append_codepoint(in.payload, in.enc, ch);
+        }
+    }
+    // corrupt some bytes
+    if (! in.payload.empty() && rng() % 3 == 0) {
+        const int n = 1 + rng() % 3;
+        for (int i = 0; i < n; ++i) {
+            in.payload[rng() % in.payload.size()] = static_cast<unsigned char>(rng());
+        }
+    }
+    // cut the last codepoint
+    const std::size_t cut = unit_size(in.enc) * (1 + rng() % 3);
+    if (rng() % 4 == 0 && in.payload.size() >= cut) {
+        in.payload.resize(in.payload.size() - cut);
+    }
+    switch (rng() % 4) {
+        case 0:  in.limit = static_cast<string_width::width_t>(rng() % 8); break;
+        case 1:  in.limit = static_cast<string_width::width_t>(rng() % 0xF0); break;
+        case 2:  in.limit = -1; break;
+        default: in.limit = 1 << 20;
+    }
+    return serialize(in);
+}
+
+} // unnamed namespace
+
+int main(int argc, char** argv)
+{
+    unsigned long iterations = 100000;
+    unsigned long seed = 1;
+    std::vector<const char*> files;
+    for (int i = 1; i < argc; ++i) {
+        if (0 == std::strcmp(argv[i], "--iterations") && i + 1 < argc) {
+            iterations = std::strtoul(argv[++i], nullptr, 10);
+        } else if (0 == std::strcmp(argv[i], "--seed") && i + 1 < argc) {
+            seed = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    int failures = 0;
+    if (! files.empty()) {
+        for (const char* filename: files) {
+            std::FILE* f = std::fopen(filename, "rb");
+            if (f == nullptr) {
+                std::printf("Could not open %s\n", filename);
+                return 1;
+            }
+            std::vector<std::uint8_t> data;
+            int c;
+            while ((c = std::fgetc(f)) != EOF) {
+                data.push_back(static_cast<std::uint8_t>(c));
+            }
+            std::fclose(f);
+            failures += ! run_one(data.data(), data.size());
+        }
+    } else {
+        std::mt19937 rng(static_cast<std::mt19937::result_type>(seed));
+        for (unsigned long i = 0; i < iterations && failures < 10; ++i) {
+            const auto data = random_input(rng);
+            failures += ! run_one(data.data(), data.size());
+        }
+    }
+    std::printf( "%llu inputs, %llu of them compared with ICU\n"
+               , (unsigned long long)stats.inputs
+               , (unsigned long long)stats.compared_with_icu );
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
+
+#endif // ! defined(STRING_WIDTH_LIBFUZZER)
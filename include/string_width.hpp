@@ -7,6 +7,7 @@
 //  http://www.boost.org/LICENSE_1_0.txt)
 
 #include <type_traits>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 
@@ -19,6 +20,13 @@
 #  endif
 #endif // ! defined(STRING_WIDTH_ASSERT)
 
+// The number of codepoints that decode writes into the buffer of the
+// width decrementers before each call to std_width_calc_func. The public
+// functions do not use the decrementers, so it does not affect them.
+#if ! defined(STRING_WIDTH_DECODE_BUFFER_SIZE)
+#  define STRING_WIDTH_DECODE_BUFFER_SIZE 16
+#endif
+
 #if defined(STRING_WIDTH_SOURCE) && !defined(STRING_WIDTH_SEPARATE_COMPILATION)
 #define STRING_WIDTH_SEPARATE_COMPILATION
 #endif
@@ -47,6 +55,82 @@
 #  define STRING_WIDTH_IF_UNLIKELY(x) if(x)
 #endif
 
+#if ! defined(STRING_WIDTH_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64))
+#  define STRING_WIDTH_X86_SIMD
+#  include <immintrin.h>
+#  if defined(_MSC_VER) && ! defined(__clang__)
+#    include <intrin.h>
+#  endif
+#endif
+
+#if defined(__cpp_lib_is_constant_evaluated)
+#  define STRING_WIDTH_CONSTEXPR_IN_CXX20 constexpr
+#else
+#  define STRING_WIDTH_CONSTEXPR_IN_CXX20 inline
+#endif
+
+#if defined(__GNUC__) || defined (__clang__)
+#  define STRING_WIDTH_TARGET_AVX2 __attribute__((target("avx2")))
+#  define STRING_WIDTH_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#else
+#  define STRING_WIDTH_TARGET_AVX2
+#  define STRING_WIDTH_TARGET_AVX512
+#endif
+
+// When STRING_WIDTH_INSTRUMENTATION is defined, the probes below count what
+// the library goes through, in counters of the calling thread. They are read
+// by the call sites of <string_width/instrumentation.hpp>. Otherwise, the
+// probes expand to nothing. The macro must be defined equally in all
+// translation units.
+#if defined(STRING_WIDTH_INSTRUMENTATION)
+
+namespace string_width {
+namespace instrumentation {
+
+struct counters {
+    std::uint64_t bytes;             // of the strings passed to the engines
+    std::uint64_t codepoints;
+    std::uint64_t clusters;
+    std::uint64_t invalid_sequences;
+    std::uint64_t wide_chars;        // grapheme clusters of width 2
+    std::uint64_t bulk_codepoints;   // measured in runs of printable ASCII
+                                     // or of wide BMP characters
+};
+
+// They only increase. The call sites take their difference.
+inline string_width::instrumentation::counters& thread_counters() noexcept
+{
+    static thread_local string_width::instrumentation::counters c = {0, 0, 0, 0, 0, 0};
+    return c;
+}
+
+} // namespace instrumentation
+
+namespace detail {
+
+STRING_WIDTH_CONSTEXPR_IN_CXX20 void probe
+    ( std::uint64_t string_width::instrumentation::counters::* counter
+    , std::uint64_t n ) noexcept
+{
+#if defined(__cpp_lib_is_constant_evaluated)
+    if (std::is_constant_evaluated()) {
+        return;
+    }
+#endif
+    string_width::instrumentation::thread_counters().*counter += n;
+}
+
+} // namespace detail
+} // namespace string_width
+
+#  define STRING_WIDTH_PROBE(COUNTER, N)                                     \
+    string_width::detail::probe                                             \
+        ( &string_width::instrumentation::counters::COUNTER                 \
+        , static_cast<std::uint64_t>(N) )
+#else
+#  define STRING_WIDTH_PROBE(COUNTER, N)
+#endif // defined(STRING_WIDTH_INSTRUMENTATION)
+
 #if defined(__GNUC__)
 #  pragma GCC diagnostic push
 #  pragma GCC diagnostic ignored "-Warray-bounds"
@@ -81,8 +165,30 @@ enum class surrogate_policy : bool {
     strict = false, lax = true
 };
 
+// assume_valid tells that the string has no invalid sequence, so that
+// it is decoded without being checked ( the result is undefined otherwise ).
+// In debug builds, such precondition is verified by STRING_WIDTH_ASSERT.
+enum class validation_policy : bool {
+    check = false, assume_valid = true
+};
+
+// Which codepoints have width 2:
+//   std_format:      the ones listed in the specification of std::format
+//   east_asian_wide: the same, plus the ones whose East Asian Width is
+//                    Ambiguous ( except combining marks )
+//   wcwidth:         the ones whose East Asian Width is Wide or Fullwidth,
+//                    like glibc's wcwidth
+enum class width_profile {
+    std_format, east_asian_wide, wcwidth
+};
+
 using width_t = int;
 
+struct width_and_pos {
+    string_width::width_t width;
+    std::size_t pos;
+};
+
 namespace detail {
 
 #if defined(__GNUC__)
@@ -175,6 +281,87 @@ private:
     bool good_ = true;
 };
 
+// Same interface as destination, but without virtual functions:
+// Derived must define a `recycle()` member function, which is called
+// directly. Since decode is a template on the destination type, it can
+// then be inlined together with the code that consumes the codepoints.
+template <typename CharT, typename Derived>
+class static_destination
+{
+public:
+
+    using char_type = CharT;
+
+    static_destination(const static_destination&) = delete;
+    static_destination(static_destination&&) = delete;
+    static_destination& operator=(const static_destination&) = delete;
+    static_destination& operator=(static_destination&&) = delete;
+
+    char_type* pointer() const noexcept
+    {
+        return pointer_;
+    }
+    char_type* end() const noexcept
+    {
+        return end_;
+    }
+    std::size_t space() const noexcept
+    {
+        STRING_WIDTH_ASSERT(pointer_ <= end_);
+        return end_ - pointer_;
+    }
+    bool good() const noexcept
+    {
+        return good_;
+    }
+    void advance_to(char_type* p) noexcept
+    {
+        STRING_WIDTH_ASSERT(pointer_ <= p);
+        STRING_WIDTH_ASSERT(p <= end_);
+        pointer_ = p;
+    }
+    void advance(std::size_t n) noexcept
+    {
+        STRING_WIDTH_ASSERT(pointer() + n <= end());
+        pointer_ += n;
+    }
+    void advance() noexcept
+    {
+        STRING_WIDTH_ASSERT(pointer() < end());
+        ++pointer_;
+    }
+    void require(std::size_t s) noexcept
+    {
+        STRING_WIDTH_IF_UNLIKELY (pointer() + s > end()) {
+            static_cast<Derived*>(this)->recycle();
+        }
+        STRING_WIDTH_ASSERT(pointer() + s <= end());
+    }
+    void ensure(std::size_t s) noexcept
+    {
+        require(s);
+    }
+
+protected:
+
+    ~static_destination() = default;
+
+    static_destination(char_type* p, std::size_t s) noexcept
+        : pointer_(p), end_(p + s)
+    { }
+
+    void set_pointer(char_type* p) noexcept
+    { pointer_ = p; };
+    void set_good(bool g) noexcept
+    { good_ = g; };
+
+private:
+
+    char_type* pointer_;
+    char_type* end_;
+    bool good_ = true;
+};
+
 #if defined(__GNUC__)
 #  pragma GCC diagnostic pop
 #  pragma GCC diagnostic ignored "-Warray-bounds"
@@ -218,7 +405,7 @@ constexpr std::uint32_t utf8_decode(std::uint32_t ch0, std::uint32_t ch1, std::u
             ((ch2 & 0x3F) <<  6) |
             ((ch3 & 0x3F) <<  0));
 }
-inline unsigned utf8_decode_first_2_of_3(std::uint8_t ch0, std::uint8_t ch1) noexcept
+constexpr unsigned utf8_decode_first_2_of_3(std::uint8_t ch0, std::uint8_t ch1) noexcept
 {
     return ((ch0 & 0x0F) << 6) | (ch1 & 0x3F);
 }
@@ -227,12 +414,12 @@ constexpr bool is_utf8_continuation(std::uint8_t ch) noexcept
     return (ch & 0xC0) == 0x80;
 }
 
-inline bool first_2_of_3_are_valid(unsigned x, string_width::surrogate_policy surr_poli) noexcept
+constexpr bool first_2_of_3_are_valid(unsigned x, string_width::surrogate_policy surr_poli) noexcept
 {
     return ( surr_poli == string_width::surrogate_policy::lax
           || (x >> 5) != 0x1B );
 }
-inline bool first_2_of_3_are_valid
+constexpr bool first_2_of_3_are_valid
     ( std::uint8_t ch0
     , std::uint8_t ch1
     , string_width::surrogate_policy surr_poli ) noexcept
@@ -240,7 +427,7 @@ inline bool first_2_of_3_are_valid
     return first_2_of_3_are_valid(utf8_decode_first_2_of_3(ch0, ch1), surr_poli);
 }
 
-inline unsigned utf8_decode_first_2_of_4(std::uint8_t ch0, std::uint8_t ch1) noexcept
+constexpr unsigned utf8_decode_first_2_of_4(std::uint8_t ch0, std::uint8_t ch1) noexcept
 {
     return ((ch0 ^ 0xF0) << 6) | (ch1 & 0x3F);
 }
@@ -250,145 +437,104 @@ inline unsigned utf8_decode_last_2_of_4(unsigned long x, unsigned ch2, unsigned
     return (x << 12) | ((ch2 & 0x3F) <<  6) | (ch3 & 0x3F);
 }
 
-inline bool first_2_of_4_are_valid(unsigned x) noexcept
+constexpr bool first_2_of_4_are_valid(unsigned x) noexcept
 {
     return 0xF < x && x < 0x110;
 }
 
-inline bool first_2_of_4_are_valid(std::uint8_t ch0, std::uint8_t ch1) noexcept
+constexpr bool first_2_of_4_are_valid(std::uint8_t ch0, std::uint8_t ch1) noexcept
 {
     return first_2_of_4_are_valid(utf8_decode_first_2_of_4(ch0, ch1));
 }
 
-template <typename SrcCharT, typename DestCharT>
-typename std::enable_if<sizeof(SrcCharT) == 1, void>::type decode
-    ( string_width::detail::destination<DestCharT>& dest
-    , const SrcCharT* src
-    , std::size_t src_size
-    , string_width::surrogate_policy surr_poli ) noexcept
+inline unsigned countr_zero(std::uint32_t x) noexcept
 {
-    using string_width::detail::utf8_decode;
-    using string_width::detail::utf8_decode_first_2_of_3;
-    using string_width::detail::utf8_decode_first_2_of_4;
-    using string_width::detail::utf8_decode_last_2_of_4;
-    using string_width::detail::first_2_of_3_are_valid;
-    using string_width::detail::first_2_of_4_are_valid;
-    using string_width::detail::is_utf8_continuation;
+    STRING_WIDTH_ASSERT(x != 0);
+#if defined(__GNUC__) || defined (__clang__)
+    return static_cast<unsigned>(__builtin_ctz(x));
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return static_cast<unsigned>(index);
+#else
+    unsigned n = 0;
+    for (; (x & 1) == 0; x >>= 1) {
+        ++n;
+    }
+    return n;
+#endif
+}
 
-    std::uint8_t ch0, ch1, ch2, ch3;
-    unsigned long x;
-    auto src_it = src;
-    auto src_end = src + src_size;
-    auto dest_it = dest.pointer();
-    auto dest_end = dest.end();
-    DestCharT ch32;
+inline unsigned countr_zero(std::uint64_t x) noexcept
+{
+    STRING_WIDTH_ASSERT(x != 0);
+#if defined(__GNUC__) || defined (__clang__)
+    return static_cast<unsigned>(__builtin_ctzll(x));
+#else
+    const auto low = static_cast<std::uint32_t>(x);
+    return low != 0
+        ? countr_zero(low)
+        : 32 + countr_zero(static_cast<std::uint32_t>(x >> 32));
+#endif
+}
 
-    while(src_it != src_end) {
-        ch0 = (*src_it);
-        ++src_it;
-        if (ch0 < 0x80) {
-            ch32 = ch0;
-        } else if (0xC0 == (ch0 & 0xE0)) {
-            if(ch0 > 0xC1 && src_it != src_end && is_utf8_continuation(ch1 = * src_it)) {
-                ch32 = utf8_decode(ch0, ch1);
-                ++src_it;
-            } else goto invalid_sequence;
-        } else if (0xE0 == ch0) {
-            if (   src_it != src_end && (((ch1 = * src_it) & 0xE0) == 0xA0)
-              && ++src_it != src_end && is_utf8_continuation(ch2 = * src_it) )
-            {
-                ch32 = ((ch1 & 0x3F) << 6) | (ch2 & 0x3F);
-                ++src_it;
-            } else goto invalid_sequence;
-        } else if (0xE0 == (ch0 & 0xF0)) {
-            if (   src_it != src_end && is_utf8_continuation(ch1 = * src_it)
-              && first_2_of_3_are_valid( x = utf8_decode_first_2_of_3(ch0, ch1)
-                                       , surr_poli )
-              && ++src_it != src_end && is_utf8_continuation(ch2 = * src_it) )
-            {
-                ch32 = (x << 6) | (ch2 & 0x3F);
-                ++src_it;
-            } else goto invalid_sequence;
-        } else if ( src_it != src_end
-                 && is_utf8_continuation(ch1 = * src_it)
-                 && first_2_of_4_are_valid(x = utf8_decode_first_2_of_4(ch0, ch1))
-                 && ++src_it != src_end && is_utf8_continuation(ch2 = * src_it)
-                 && ++src_it != src_end && is_utf8_continuation(ch3 = * src_it) )
-        {
-            ch32 = utf8_decode_last_2_of_4(x, ch2, ch3);
-            ++src_it;
-        } else {
-            invalid_sequence:
-            ch32 = 0xFFFD;
-        }
+inline unsigned popcount(std::uint64_t x) noexcept
+{
+#if defined(__GNUC__) || defined (__clang__)
+    return static_cast<unsigned>(__builtin_popcountll(x));
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ull);
+    x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return static_cast<unsigned>((x * 0x0101010101010101ull) >> 56);
+#endif
+}
 
-        STRING_WIDTH_CHECK_DEST;
-        *dest_it = ch32;
-        ++dest_it;
+// Returns the number of leading bytes in [begin, end) that are printable
+// ASCII characters ( U+0020 .. U+007E ).
+
+inline std::size_t printable_ascii_run_length_scalar
+    ( const std::uint8_t* begin
+    , const std::uint8_t* end ) noexcept
+{
+    auto it = begin;
+    while (it != end && static_cast<std::uint8_t>(*it - 0x20) < 0x5F) {
+        ++it;
     }
-    dest.advance_to(dest_it);
+    return static_cast<std::size_t>(it - begin);
 }
 
-template <typename SrcCharT, typename DestCharT>
-typename std::enable_if<sizeof(SrcCharT) == 2, void>::type decode
-    ( string_width::detail::destination<DestCharT>& dest
-    , const SrcCharT* src
-    , std::size_t src_size
-    , string_width::surrogate_policy surr_poli ) noexcept
+// Whether `ch` is a CJK Unified Ideograph ( U+4E00 .. U+9FFF ) or a Hangul
+// syllable ( U+AC00 .. U+D7A3 ). All of them have width 2 and none of them
+// joins the previous one in a grapheme cluster.
+constexpr bool is_wide_bmp(std::uint32_t ch) noexcept
 {
-    unsigned long ch, ch2;
-    DestCharT ch32;
-    const SrcCharT* src_it_next;
-    auto src_end = src + src_size;
-    auto dest_it = dest.pointer();
-    auto dest_end = dest.end();
-    for(auto src_it = src; src_it != src_end; src_it = src_it_next) {
-        src_it_next = src_it + 1;
-        ch = *src_it;
-        src_it_next = src_it + 1;
-
-        STRING_WIDTH_IF_LIKELY (string_width::detail::not_surrogate(ch)) {
-            ch32 = ch;
-        } else if ( string_width::detail::is_high_surrogate(ch)
-               && src_it_next != src_end
-               && string_width::detail::is_low_surrogate(ch2 = *src_it_next)) {
-            ch32 = 0x10000 + (((ch & 0x3FF) << 10) | (ch2 & 0x3FF));
-            ++src_it_next;
-        } else if (surr_poli == string_width::surrogate_policy::lax) {
-            ch32 = ch;
-        } else {
-            ch32 = 0xFFFD;
-        }
+    return ch - 0x4E00u < 0x5200u || ch - 0xAC00u < 0x2BA4u;
+}
 
-        STRING_WIDTH_CHECK_DEST;
-        *dest_it = ch32;
-        ++dest_it;
+// The same as printable_ascii_run_length_scalar, but for UTF-16
+inline std::size_t printable_ascii_run_length_u16_scalar
+    ( const std::uint16_t* begin
+    , const std::uint16_t* end ) noexcept
+{
+    auto it = begin;
+    while (it != end && static_cast<std::uint16_t>(*it - 0x20) < 0x5F) {
+        ++it;
     }
-    dest.advance_to(dest_it);
+    return static_cast<std::size_t>(it - begin);
 }
 
-template <typename SrcCharT, typename DestCharT>
-typename std::enable_if<sizeof(SrcCharT) == 4, void>::type decode
-    ( string_width::detail::destination<DestCharT>& dest
-    , const SrcCharT* src
-    , std::size_t src_size
-    , string_width::surrogate_policy ) noexcept
+// Returns the number of leading code units in [begin, end) for which
+// is_wide_bmp is true
+inline std::size_t wide_bmp_run_length_u16_scalar
+    ( const std::uint16_t* begin
+    , const std::uint16_t* end ) noexcept
 {
-    // to-do : optimize ( not need to sanitize )
-
-    const auto src_end = src + src_size;
-    auto dest_it = dest.pointer();
-    auto dest_end = dest.end();
-    for (auto src_it = src; src_it < src_end; ++src_it) {
-        auto ch = *src_it;
-        STRING_WIDTH_IF_UNLIKELY (ch >= 0x110000) {
-            ch = 0xFFFD;
-        }
-        STRING_WIDTH_CHECK_DEST;
-        *dest_it = ch;
-        ++dest_it;
+    auto it = begin;
+    while (it != end && string_width::detail::is_wide_bmp(*it)) {
+        ++it;
     }
-    dest.advance_to(dest_it);
+    return static_cast<std::size_t>(it - begin);
 }
 
 struct codepoints_count_result {
@@ -396,476 +542,2745 @@ struct codepoints_count_result {
     std::size_t pos;
 };
 
-template <typename CharT>
-typename std::enable_if
-    < sizeof(CharT) == 1
-    , string_width::detail::codepoints_count_result >::type
-count_codepoints
-    ( const CharT* src
-    , std::size_t src_size
-    , std::size_t max_count
-    , string_width::surrogate_policy surr_poli ) noexcept
-{
-    using string_width::detail::utf8_decode;
-    using string_width::detail::is_utf8_continuation;
-    using string_width::detail::first_2_of_3_are_valid;
-    using string_width::detail::first_2_of_4_are_valid;
+// Which bytes of a block of 64 bytes of UTF-8 are of each kind.
+// Bit i of each mask corresponds to the byte i.
+struct utf8_block_masks {
+    std::uint64_t cont;       // 0x80 .. 0xBF
+    std::uint64_t lead2;      // 0xC2 .. 0xDF
+    std::uint64_t lead3;      // 0xE0 .. 0xEF
+    std::uint64_t lead4;      // 0xF0 .. 0xF4
+    std::uint64_t e0, ed, f0, f4;
+    std::uint64_t from_a0;    // 0xA0 .. 0xBF
+    std::uint64_t from_90;    // 0x90 .. 0xBF
+};
 
-    std::uint8_t ch0, ch1;
-    std::size_t count = 0;
-    auto it = src;
-    auto end = src + src_size;
-    while (it != end && count != max_count) {
-        ch0 = (*it);
-        ++it;
-        ++count;
-        if (0xC0 == (ch0 & 0xE0)) {
-            if (ch0 > 0xC1 && it != end && is_utf8_continuation(*it)) {
-                ++it;
-            }
-        } else if (0xE0 == ch0) {
-            if (   it != end && ((*it & 0xE0) == 0xA0)
-              && ++it != end && is_utf8_continuation(*it) )
-            {
-                ++it;
-            }
-        } else if (0xE0 == (ch0 & 0xF0)) {
-            if ( it != end && is_utf8_continuation(ch1 = *it)
-              && first_2_of_3_are_valid( ch0, ch1, surr_poli )
-              && ++it != end && is_utf8_continuation(*it) )
-            {
-                ++it;
-            }
-        } else if (   it != end && is_utf8_continuation(ch1 = * it)
-                 && first_2_of_4_are_valid(ch0, ch1)
-                 && ++it != end && is_utf8_continuation(*it)
-                 && ++it != end && is_utf8_continuation(*it) )
-        {
-            ++it;
-        }
+// What the last bytes of a block of UTF-8 require from the first ones of
+// the next block: each mask tells which of them must be continuation
+// bytes, or be in a narrower range, like the second byte after 0xE0.
+struct utf8_block_carry {
+    std::uint64_t cont;
+    std::uint64_t e0, ed, f0, f4;
+    unsigned tail; // the length of the sequence that is incomplete at the end
+};
+
+// If the block described by `m` ( which follows the one that left `carry` )
+// has no invalid sequence, adds to `count` the number of codepoints that start
+// in it, updates `carry` and returns true. Otherwise returns false and leaves
+// `count` and `carry` unchanged.
+//
+// Each valid sequence is a codepoint, so the number of codepoints is the
+// number of bytes that are not continuation bytes. Bytes that can not start
+// a sequence ( 0xC0, 0xC1, 0xF5 .. 0xFF ) are also one codepoint each, unless
+// they are followed by continuation bytes. Such continuation bytes, as well
+// as the ones of invalid sequences, are left to the scalar code.
+inline bool utf8_block_count
+    ( const utf8_block_masks& m
+    , string_width::surrogate_policy surr_poli
+    , utf8_block_carry& carry
+    , std::size_t& count ) noexcept
+{
+    const std::uint64_t leads = m.lead2 | m.lead3 | m.lead4;
+    const std::uint64_t leads34 = m.lead3 | m.lead4;
+    const std::uint64_t expected_cont = (leads << 1) | (leads34 << 2) | (m.lead4 << 3) | carry.cont;
+    std::uint64_t bad_second = ( (((m.e0 << 1) | carry.e0) & ~m.from_a0)
+                               | (((m.f0 << 1) | carry.f0) & ~m.from_90)
+                               | (((m.f4 << 1) | carry.f4) & m.from_90) );
+    if (surr_poli == string_width::surrogate_policy::strict) {
+        bad_second |= ((m.ed << 1) | carry.ed) & m.from_a0;
     }
-    return {count, static_cast<std::size_t>(it - src)};
+    if (((expected_cont ^ m.cont) | bad_second) != 0) {
+        return false;
+    }
+    count += 64 - popcount(m.cont);
+    carry.cont = (leads >> 63) | (leads34 >> 62) | (m.lead4 >> 61);
+    carry.e0 = m.e0 >> 63;
+    carry.ed = m.ed >> 63;
+    carry.f0 = m.f0 >> 63;
+    carry.f4 = m.f4 >> 63;
+    const std::uint64_t incomplete = ( (leads & (std::uint64_t(1) << 63))
+                                     | (leads34 & (std::uint64_t(1) << 62))
+                                     | (m.lead4 & (std::uint64_t(1) << 61)) );
+    carry.tail = incomplete != 0 ? 64 - countr_zero(incomplete) : 0;
+    return true;
 }
 
-template <typename CharT>
-typename std::enable_if
-    < sizeof(CharT) == 2
-    , string_width::detail::codepoints_count_result >::type
-count_codepoints
-    ( const CharT* src
-    , std::size_t src_size
-    , std::size_t max_count
+// Adds to `count` the number of codepoints that start in a block of 32
+// UTF-16 code units whose high and low surrogates are given by the masks.
+// `carry` tells whether the previous block ends with a high surrogate.
+inline void utf16_block_count
+    ( std::uint32_t high
+    , std::uint32_t low
+    , std::uint32_t& carry
+    , std::size_t& count ) noexcept
+{
+    count += 32 - popcount(low & ((high << 1) | carry));
+    carry = high >> 31;
+}
+
+// The kernels that count codepoints go through blocks of 64 bytes or of 32
+// code units, and return the number of codepoints and of code units covered.
+// They stop before a block that has an invalid UTF-8 sequence, or when there
+// are fewer than a block of code units left, or when `max_count` could be
+// exceeded. Then they give back the sequence that is incomplete at the end of
+// the last block, if any. Without SIMD, they cover nothing.
+
+inline string_width::detail::codepoints_count_result utf8_codepoints_run_scalar
+    ( const std::uint8_t*
+    , const std::uint8_t*
+    , std::size_t
     , string_width::surrogate_policy ) noexcept
 {
-    std::size_t count = 0;
-    const CharT* it = src;
-    const auto end = src + src_size;
-    unsigned long ch;
-    while (it != end && count < max_count) {
-        ch = *it;
-        ++ it;
-        ++ count;
-        if ( string_width::detail::is_high_surrogate(ch) && it != end
-          && string_width::detail::is_low_surrogate(*it)) {
-            ++ it;
+    return {0, 0};
+}
+
+inline string_width::detail::codepoints_count_result utf16_codepoints_run_scalar
+    ( const std::uint16_t*
+    , const std::uint16_t*
+    , std::size_t ) noexcept
+{
+    return {0, 0};
+}
+
+#if defined(STRING_WIDTH_X86_SIMD)
+
+inline std::size_t printable_ascii_run_length_sse2
+    ( const std::uint8_t* begin
+    , const std::uint8_t* end ) noexcept
+{
+    const __m128i lower_bound = _mm_set1_epi8(0x1F);
+    const __m128i upper_bound = _mm_set1_epi8(0x7F);
+    auto it = begin;
+    while (end - it >= 16) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it));
+        const __m128i printable = _mm_and_si128
+            ( _mm_cmpgt_epi8(chunk, lower_bound)
+            , _mm_cmplt_epi8(chunk, upper_bound) );
+        const auto mask = ~static_cast<std::uint32_t>(_mm_movemask_epi8(printable)) & 0xFFFF;
+        if (mask != 0) {
+            return static_cast<std::size_t>(it - begin) + countr_zero(mask);
         }
+        it += 16;
     }
-    return {count, static_cast<std::size_t>(it - src)};
+    return static_cast<std::size_t>(it - begin) + printable_ascii_run_length_scalar(it, end);
 }
 
-template <typename CharT>
-typename std::enable_if
-    < sizeof(CharT) == 4
-    , string_width::detail::codepoints_count_result >::type
-count_codepoints
-    ( const CharT*
-    , std::size_t src_size
-    , std::size_t max_count
-    , string_width::surrogate_policy ) noexcept
+STRING_WIDTH_TARGET_AVX2
+inline std::size_t printable_ascii_run_length_avx2
+    ( const std::uint8_t* begin
+    , const std::uint8_t* end ) noexcept
 {
-    if (max_count <= src_size) {
-        return {max_count, max_count};
+    const __m256i lower_bound = _mm256_set1_epi8(0x1F);
+    const __m256i upper_bound = _mm256_set1_epi8(0x7F);
+    auto it = begin;
+    while (end - it >= 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(it));
+        const __m256i printable = _mm256_and_si256
+            ( _mm256_cmpgt_epi8(chunk, lower_bound)
+            , _mm256_cmpgt_epi8(upper_bound, chunk) );
+        const auto mask = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(printable));
+        if (mask != 0) {
+            return static_cast<std::size_t>(it - begin) + countr_zero(mask);
+        }
+        it += 32;
     }
-    return {src_size, src_size};
+    return static_cast<std::size_t>(it - begin) + printable_ascii_run_length_sse2(it, end);
 }
 
+STRING_WIDTH_TARGET_AVX512
+inline std::size_t printable_ascii_run_length_avx512
+    ( const std::uint8_t* begin
+    , const std::uint8_t* end ) noexcept
+{
+    const __m512i offset = _mm512_set1_epi8(0x20);
+    const __m512i count = _mm512_set1_epi8(0x5F);
+    auto it = begin;
+    while (end - it >= 64) {
+        const __m512i chunk = _mm512_loadu_si512(reinterpret_cast<const void*>(it));
+        const std::uint64_t printable = _mm512_cmplt_epu8_mask(_mm512_sub_epi8(chunk, offset), count);
+        if (printable != ~std::uint64_t(0)) {
+            return static_cast<std::size_t>(it - begin) + countr_zero(~printable);
+        }
+        it += 64;
+    }
+    return static_cast<std::size_t>(it - begin) + printable_ascii_run_length_avx2(it, end);
+}
 
-#if ! defined(STRING_WIDTH_OMIT_IMPL)
+// The UTF-16 kernels. A code unit x is in [first, first + count) when
+// the unsigned difference x - first is less than count.
 
-struct std_width_calc_func_return {
+inline __m128i u16_in_range_sse2(__m128i x, std::uint16_t first, std::uint16_t count) noexcept
+{
+    const __m128i diff = _mm_sub_epi16(x, _mm_set1_epi16(static_cast<short>(first)));
+    const __m128i excess = _mm_subs_epu16(diff, _mm_set1_epi16(static_cast<short>(count - 1)));
+    return _mm_cmpeq_epi16(excess, _mm_setzero_si128());
+}
 
-    std_width_calc_func_return
-        ( string_width::width_t width_
-        , unsigned state_
-        , const char32_t* ptr_ ) noexcept
-        : width(width_)
-        , state(state_)
-        , ptr(ptr_)
-    {
+inline std::size_t printable_ascii_run_length_u16_sse2
+    ( const std::uint16_t* begin
+    , const std::uint16_t* end ) noexcept
+{
+    auto it = begin;
+    while (end - it >= 8) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it));
+        const __m128i ok = u16_in_range_sse2(chunk, 0x20, 0x5F);
+        const auto mask = ~static_cast<std::uint32_t>(_mm_movemask_epi8(ok)) & 0xFFFF;
+        if (mask != 0) {
+            return static_cast<std::size_t>(it - begin) + countr_zero(mask) / 2;
+        }
+        it += 8;
     }
+    return static_cast<std::size_t>(it - begin) + printable_ascii_run_length_u16_scalar(it, end);
+}
 
-    std_width_calc_func_return(const std_width_calc_func_return&) = default;
+inline std::size_t wide_bmp_run_length_u16_sse2
+    ( const std::uint16_t* begin
+    , const std::uint16_t* end ) noexcept
+{
+    auto it = begin;
+    while (end - it >= 8) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it));
+        const __m128i ok = _mm_or_si128
+            ( u16_in_range_sse2(chunk, 0x4E00, 0x5200)
+            , u16_in_range_sse2(chunk, 0xAC00, 0x2BA4) );
+        const auto mask = ~static_cast<std::uint32_t>(_mm_movemask_epi8(ok)) & 0xFFFF;
+        if (mask != 0) {
+            return static_cast<std::size_t>(it - begin) + countr_zero(mask) / 2;
+        }
+        it += 8;
+    }
+    return static_cast<std::size_t>(it - begin) + wide_bmp_run_length_u16_scalar(it, end);
+}
 
-    string_width::width_t width;
-    unsigned state;
-    const char32_t* ptr;
-};
+STRING_WIDTH_TARGET_AVX2
+inline __m256i u16_in_range_avx2(__m256i x, std::uint16_t first, std::uint16_t count) noexcept
+{
+    const __m256i diff = _mm256_sub_epi16(x, _mm256_set1_epi16(static_cast<short>(first)));
+    const __m256i excess = _mm256_subs_epu16(diff, _mm256_set1_epi16(static_cast<short>(count - 1)));
+    return _mm256_cmpeq_epi16(excess, _mm256_setzero_si256());
+}
 
-STRING_WIDTH_FUNC_IMPL std_width_calc_func_return std_width_calc_func
-    ( const char32_t* str
-    , const char32_t* end
-    , string_width::width_t width
-    , unsigned state
-    , bool return_pos ) noexcept
+STRING_WIDTH_TARGET_AVX2
+inline std::size_t printable_ascii_run_length_u16_avx2
+    ( const std::uint16_t* begin
+    , const std::uint16_t* end ) noexcept
 {
-    // following http://www.unicode.org/reports/tr29/tr29-37.html#Grapheme_Cluster_Boundaries
+    auto it = begin;
+    while (end - it >= 16) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(it));
+        const __m256i ok = u16_in_range_avx2(chunk, 0x20, 0x5F);
+        const auto mask = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(ok));
+        if (mask != 0) {
+            return static_cast<std::size_t>(it - begin) + countr_zero(mask) / 2;
+        }
+        it += 16;
+    }
+    return static_cast<std::size_t>(it - begin) + printable_ascii_run_length_u16_sse2(it, end);
+}
 
-    using state_t = unsigned;
-    constexpr state_t initial          = 0;
-    constexpr state_t after_prepend    = 1;
-    constexpr state_t after_core       = 1 << 1;
-    constexpr state_t after_ri         = after_core | (1 << 2);
-    constexpr state_t after_xpic       = after_core | (1 << 3);
-    constexpr state_t after_xpic_zwj   = after_core | (1 << 4);
-    constexpr state_t after_hangul     = after_core | (1 << 5);
-    constexpr state_t after_hangul_l   = after_hangul | (1 << 6);
-    constexpr state_t after_hangul_v   = after_hangul | (1 << 7);
-    constexpr state_t after_hangul_t   = after_hangul | (1 << 8);
-    constexpr state_t after_hangul_lv  = after_hangul | (1 << 9);
-    constexpr state_t after_hangul_lvt = after_hangul | (1 << 10);
-    constexpr state_t after_poscore    = 1 << 11;
-    constexpr state_t after_cr         = 1 << 12;
+STRING_WIDTH_TARGET_AVX2
+inline std::size_t wide_bmp_run_length_u16_avx2
+    ( const std::uint16_t* begin
+    , const std::uint16_t* end ) noexcept
+{
+    auto it = begin;
+    while (end - it >= 16) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(it));
+        const __m256i ok = _mm256_or_si256
+            ( u16_in_range_avx2(chunk, 0x4E00, 0x5200)
+            , u16_in_range_avx2(chunk, 0xAC00, 0x2BA4) );
+        const auto mask = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(ok));
+        if (mask != 0) {
+            return static_cast<std::size_t>(it - begin) + countr_zero(mask) / 2;
+        }
+        it += 16;
+    }
+    return static_cast<std::size_t>(it - begin) + wide_bmp_run_length_u16_sse2(it, end);
+}
 
-    string_width::width_t ch_width;
-    char32_t ch;
-    goto next_codepoint;
+STRING_WIDTH_TARGET_AVX512
+inline std::uint32_t u16_in_range_avx512(__m512i x, std::uint16_t first, std::uint16_t count) noexcept
+{
+    const __m512i diff = _mm512_sub_epi16(x, _mm512_set1_epi16(static_cast<short>(first)));
+    return _mm512_cmplt_epu16_mask(diff, _mm512_set1_epi16(static_cast<short>(count)));
+}
 
-    handle_other:
-    if (state == after_prepend) {
-        state = after_core;
-        goto next_codepoint;
+STRING_WIDTH_TARGET_AVX512
+inline std::size_t printable_ascii_run_length_u16_avx512
+    ( const std::uint16_t* begin
+    , const std::uint16_t* end ) noexcept
+{
+    auto it = begin;
+    while (end - it >= 32) {
+        const __m512i chunk = _mm512_loadu_si512(reinterpret_cast<const void*>(it));
+        const std::uint32_t mask = ~u16_in_range_avx512(chunk, 0x20, 0x5F);
+        if (mask != 0) {
+            return static_cast<std::size_t>(it - begin) + countr_zero(mask);
+        }
+        it += 32;
     }
-    state = after_core;
+    return static_cast<std::size_t>(it - begin) + printable_ascii_run_length_u16_avx2(it, end);
+}
 
-    decrement_width:
-    // should come here after the first codepoint of every grapheme cluster
-    if (ch_width >= width) {
-        if (! return_pos) {
-            return {0, 0, nullptr};
-        }
-        if (ch_width > width) {
-            return {0, 0, str -1};
+STRING_WIDTH_TARGET_AVX512
+inline std::size_t wide_bmp_run_length_u16_avx512
+    ( const std::uint16_t* begin
+    , const std::uint16_t* end ) noexcept
+{
+    auto it = begin;
+    while (end - it >= 32) {
+        const __m512i chunk = _mm512_loadu_si512(reinterpret_cast<const void*>(it));
+        const std::uint32_t mask = ~( u16_in_range_avx512(chunk, 0x4E00, 0x5200)
+                                    | u16_in_range_avx512(chunk, 0xAC00, 0x2BA4) );
+        if (mask != 0) {
+            return static_cast<std::size_t>(it - begin) + countr_zero(mask);
         }
-        width = 0;
-        goto next_codepoint; // because there might be more codepoints in this grapheme cluster
+        it += 32;
     }
-    width -= ch_width;
+    return static_cast<std::size_t>(it - begin) + wide_bmp_run_length_u16_avx2(it, end);
+}
 
-    next_codepoint:
-    if (str == end) {
-        return {width, state, str};
-    }
-    ch = *str;
-    ++str;
-    ch_width = 1;
-    if (ch <= 0x007E) {
-        if (0x20 <= ch) {
-            ch_width = 1;
-            goto handle_other;
+// The kernels that count codepoints
+
+inline __m128i u8_in_range_sse2(__m128i x, std::uint8_t first, std::uint8_t count) noexcept
+{
+    const __m128i diff = _mm_sub_epi8(x, _mm_set1_epi8(static_cast<char>(first)));
+    const __m128i excess = _mm_subs_epu8(diff, _mm_set1_epi8(static_cast<char>(count - 1)));
+    return _mm_cmpeq_epi8(excess, _mm_setzero_si128());
+}
+
+inline std::uint64_t movemask_at_sse2(__m128i x, unsigned shift) noexcept
+{
+    return static_cast<std::uint64_t>(static_cast<unsigned>(_mm_movemask_epi8(x))) << shift;
+}
+
+inline void add_utf8_masks_sse2
+    ( string_width::detail::utf8_block_masks& m
+    , __m128i x
+    , unsigned shift ) noexcept
+{
+    m.cont    |= movemask_at_sse2(u8_in_range_sse2(x, 0x80, 0x40), shift);
+    m.lead2   |= movemask_at_sse2(u8_in_range_sse2(x, 0xC2, 0x1E), shift);
+    m.lead3   |= movemask_at_sse2(u8_in_range_sse2(x, 0xE0, 0x10), shift);
+    m.lead4   |= movemask_at_sse2(u8_in_range_sse2(x, 0xF0, 0x05), shift);
+    m.e0      |= movemask_at_sse2(_mm_cmpeq_epi8(x, _mm_set1_epi8(static_cast<char>(0xE0))), shift);
+    m.ed      |= movemask_at_sse2(_mm_cmpeq_epi8(x, _mm_set1_epi8(static_cast<char>(0xED))), shift);
+    m.f0      |= movemask_at_sse2(_mm_cmpeq_epi8(x, _mm_set1_epi8(static_cast<char>(0xF0))), shift);
+    m.f4      |= movemask_at_sse2(_mm_cmpeq_epi8(x, _mm_set1_epi8(static_cast<char>(0xF4))), shift);
+    m.from_a0 |= movemask_at_sse2(u8_in_range_sse2(x, 0xA0, 0x20), shift);
+    m.from_90 |= movemask_at_sse2(u8_in_range_sse2(x, 0x90, 0x30), shift);
+}
+
+inline string_width::detail::codepoints_count_result utf8_codepoints_run_sse2
+    ( const std::uint8_t* begin
+    , const std::uint8_t* end
+    , std::size_t max_count
+    , string_width::surrogate_policy surr_poli ) noexcept
+{
+    auto it = begin;
+    std::size_t count = 0;
+    utf8_block_carry carry = {0, 0, 0, 0, 0, 0};
+    while (end - it >= 64 && max_count - count >= 64) {
+        const __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it));
+        const __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it + 16));
+        const __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it + 32));
+        const __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it + 48));
+        string_width::detail::utf8_block_masks m = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+        const __m128i any = _mm_or_si128(_mm_or_si128(x0, x1), _mm_or_si128(x2, x3));
+        if (_mm_movemask_epi8(any) != 0) { // not ASCII
+            add_utf8_masks_sse2(m, x0, 0);
+            add_utf8_masks_sse2(m, x1, 16);
+            add_utf8_masks_sse2(m, x2, 32);
+            add_utf8_masks_sse2(m, x3, 48);
         }
-        if (0x000D == ch) { // CR
-            goto handle_cr;
+        if (! utf8_block_count(m, surr_poli, carry, count)) {
+            break;
         }
-        if (0x000A == ch) { // LF
-            goto handle_lf;
+        it += 64;
+    }
+    if (carry.tail != 0) {
+        it -= carry.tail;
+        --count;
+    }
+    return {count, static_cast<std::size_t>(it - begin)};
+}
+
+inline string_width::detail::codepoints_count_result utf16_codepoints_run_sse2
+    ( const std::uint16_t* begin
+    , const std::uint16_t* end
+    , std::size_t max_count ) noexcept
+{
+    auto it = begin;
+    std::size_t count = 0;
+    std::uint32_t carry = 0;
+    while (end - it >= 32 && max_count - count >= 32) {
+        std::uint32_t high = 0, low = 0;
+        for (unsigned i = 0; i < 32; i += 16) {
+            const __m128i x0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it + i));
+            const __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it + i + 8));
+            const __m128i h = _mm_packs_epi16
+                ( u16_in_range_sse2(x0, 0xD800, 0x400), u16_in_range_sse2(x1, 0xD800, 0x400) );
+            const __m128i l = _mm_packs_epi16
+                ( u16_in_range_sse2(x0, 0xDC00, 0x400), u16_in_range_sse2(x1, 0xDC00, 0x400) );
+            high |= static_cast<std::uint32_t>(_mm_movemask_epi8(h)) << i;
+            low  |= static_cast<std::uint32_t>(_mm_movemask_epi8(l)) << i;
         }
-        goto handle_control;
+        utf16_block_count(high, low, carry, count);
+        it += 32;
     }
+    it -= carry;
+    count -= carry;
+    return {count, static_cast<std::size_t>(it - begin)};
+}
 
-#include <string_width/detail/ch32_width_and_gcb_prop>
+STRING_WIDTH_TARGET_AVX2
+inline __m256i u8_in_range_avx2(__m256i x, std::uint8_t first, std::uint8_t count) noexcept
+{
+    const __m256i diff = _mm256_sub_epi8(x, _mm256_set1_epi8(static_cast<char>(first)));
+    const __m256i excess = _mm256_subs_epu8(diff, _mm256_set1_epi8(static_cast<char>(count - 1)));
+    return _mm256_cmpeq_epi8(excess, _mm256_setzero_si256());
+}
 
-    handle_zwj:
-    if (state == after_xpic) {
-        state = after_xpic_zwj;
-        goto next_codepoint;
+STRING_WIDTH_TARGET_AVX2
+inline std::uint64_t movemask_at_avx2(__m256i x, unsigned shift) noexcept
+{
+    return static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(x))) << shift;
+}
+
+STRING_WIDTH_TARGET_AVX2
+inline void add_utf8_masks_avx2
+    ( string_width::detail::utf8_block_masks& m
+    , __m256i x
+    , unsigned shift ) noexcept
+{
+    m.cont    |= movemask_at_avx2(u8_in_range_avx2(x, 0x80, 0x40), shift);
+    m.lead2   |= movemask_at_avx2(u8_in_range_avx2(x, 0xC2, 0x1E), shift);
+    m.lead3   |= movemask_at_avx2(u8_in_range_avx2(x, 0xE0, 0x10), shift);
+    m.lead4   |= movemask_at_avx2(u8_in_range_avx2(x, 0xF0, 0x05), shift);
+    m.e0      |= movemask_at_avx2(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(static_cast<char>(0xE0))), shift);
+    m.ed      |= movemask_at_avx2(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(static_cast<char>(0xED))), shift);
+    m.f0      |= movemask_at_avx2(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(static_cast<char>(0xF0))), shift);
+    m.f4      |= movemask_at_avx2(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(static_cast<char>(0xF4))), shift);
+    m.from_a0 |= movemask_at_avx2(u8_in_range_avx2(x, 0xA0, 0x20), shift);
+    m.from_90 |= movemask_at_avx2(u8_in_range_avx2(x, 0x90, 0x30), shift);
+}
+
+STRING_WIDTH_TARGET_AVX2
+inline string_width::detail::codepoints_count_result utf8_codepoints_run_avx2
+    ( const std::uint8_t* begin
+    , const std::uint8_t* end
+    , std::size_t max_count
+    , string_width::surrogate_policy surr_poli ) noexcept
+{
+    auto it = begin;
+    std::size_t count = 0;
+    utf8_block_carry carry = {0, 0, 0, 0, 0, 0};
+    while (end - it >= 64 && max_count - count >= 64) {
+        const __m256i x0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(it));
+        const __m256i x1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(it + 32));
+        string_width::detail::utf8_block_masks m = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+        if (_mm256_movemask_epi8(_mm256_or_si256(x0, x1)) != 0) { // not ASCII
+            add_utf8_masks_avx2(m, x0, 0);
+            add_utf8_masks_avx2(m, x1, 32);
+        }
+        if (! utf8_block_count(m, surr_poli, carry, count)) {
+            break;
+        }
+        it += 64;
     }
-    goto handle_spacing_mark; // because the code is the same
+    if (carry.tail != 0) {
+        it -= carry.tail;
+        --count;
+    }
+    return {count, static_cast<std::size_t>(it - begin)};
+}
 
-    handle_extend:
-    handle_extend_and_control:
-    if (state == after_xpic) {
-        goto next_codepoint;
+STRING_WIDTH_TARGET_AVX2
+inline string_width::detail::codepoints_count_result utf16_codepoints_run_avx2
+    ( const std::uint16_t* begin
+    , const std::uint16_t* end
+    , std::size_t max_count ) noexcept
+{
+    auto it = begin;
+    std::size_t count = 0;
+    std::uint32_t carry = 0;
+    while (end - it >= 32 && max_count - count >= 32) {
+        const __m256i x0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(it));
+        const __m256i x1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(it + 16));
+        // _mm256_packs_epi16 interleaves the 128-bit lanes of its arguments
+        const __m256i h = _mm256_permute4x64_epi64
+            ( _mm256_packs_epi16( u16_in_range_avx2(x0, 0xD800, 0x400)
+                                , u16_in_range_avx2(x1, 0xD800, 0x400) )
+            , 0xD8 );
+        const __m256i l = _mm256_permute4x64_epi64
+            ( _mm256_packs_epi16( u16_in_range_avx2(x0, 0xDC00, 0x400)
+                                , u16_in_range_avx2(x1, 0xDC00, 0x400) )
+            , 0xD8 );
+        utf16_block_count
+            ( static_cast<std::uint32_t>(_mm256_movemask_epi8(h))
+            , static_cast<std::uint32_t>(_mm256_movemask_epi8(l))
+            , carry, count );
+        it += 32;
     }
+    it -= carry;
+    count -= carry;
+    return {count, static_cast<std::size_t>(it - begin)};
+}
 
-    handle_spacing_mark:
-    if (state & (after_prepend | after_core | after_poscore)) {
-        state = after_poscore;
-        goto next_codepoint;
+STRING_WIDTH_TARGET_AVX512
+inline std::uint64_t u8_in_range_avx512(__m512i x, std::uint8_t first, std::uint8_t count) noexcept
+{
+    const __m512i diff = _mm512_sub_epi8(x, _mm512_set1_epi8(static_cast<char>(first)));
+    return _mm512_cmplt_epu8_mask(diff, _mm512_set1_epi8(static_cast<char>(count)));
+}
+
+STRING_WIDTH_TARGET_AVX512
+inline std::uint64_t u8_equal_avx512(__m512i x, std::uint8_t value) noexcept
+{
+    return _mm512_cmpeq_epi8_mask(x, _mm512_set1_epi8(static_cast<char>(value)));
+}
+
+STRING_WIDTH_TARGET_AVX512
+inline string_width::detail::utf8_block_masks utf8_block_masks_avx512(const std::uint8_t* p) noexcept
+{
+    string_width::detail::utf8_block_masks m = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    const __m512i x = _mm512_loadu_si512(reinterpret_cast<const void*>(p));
+    if (_mm512_movepi8_mask(x) != 0) {
+        m.cont    = u8_in_range_avx512(x, 0x80, 0x40);
+        m.lead2   = u8_in_range_avx512(x, 0xC2, 0x1E);
+        m.lead3   = u8_in_range_avx512(x, 0xE0, 0x10);
+        m.lead4   = u8_in_range_avx512(x, 0xF0, 0x05);
+        m.e0      = u8_equal_avx512(x, 0xE0);
+        m.ed      = u8_equal_avx512(x, 0xED);
+        m.f0      = u8_equal_avx512(x, 0xF0);
+        m.f4      = u8_equal_avx512(x, 0xF4);
+        m.from_a0 = u8_in_range_avx512(x, 0xA0, 0x20);
+        m.from_90 = u8_in_range_avx512(x, 0x90, 0x30);
     }
-    state = after_poscore;
-    goto decrement_width;
+    return m;
+}
 
-    handle_prepend:
-    if (state == after_prepend) {
-        goto next_codepoint;
+STRING_WIDTH_TARGET_AVX512
+inline string_width::detail::codepoints_count_result utf8_codepoints_run_avx512
+    ( const std::uint8_t* begin
+    , const std::uint8_t* end
+    , std::size_t max_count
+    , string_width::surrogate_policy surr_poli ) noexcept
+{
+    auto it = begin;
+    std::size_t count = 0;
+    utf8_block_carry carry = {0, 0, 0, 0, 0, 0};
+    while ( end - it >= 64 && max_count - count >= 64
+         && utf8_block_count(utf8_block_masks_avx512(it), surr_poli, carry, count) ) {
+        it += 64;
     }
-    state = after_prepend;
-    goto decrement_width;
+    if (carry.tail != 0) {
+        it -= carry.tail;
+        --count;
+    }
+    return {count, static_cast<std::size_t>(it - begin)};
+}
 
-    handle_regional_indicator: {
-        if (state == after_ri) {
-            state = after_core;
-            goto next_codepoint;
-        }
-        if (state != after_prepend) {
-            state = after_ri;
-            goto decrement_width;
-        }
-        state = after_ri;
-        goto next_codepoint;
+STRING_WIDTH_TARGET_AVX512
+inline string_width::detail::codepoints_count_result utf16_codepoints_run_avx512
+    ( const std::uint16_t* begin
+    , const std::uint16_t* end
+    , std::size_t max_count ) noexcept
+{
+    auto it = begin;
+    std::size_t count = 0;
+    std::uint32_t carry = 0;
+    while (end - it >= 32 && max_count - count >= 32) {
+        const __m512i x = _mm512_loadu_si512(reinterpret_cast<const void*>(it));
+        utf16_block_count
+            ( u16_in_range_avx512(x, 0xD800, 0x400)
+            , u16_in_range_avx512(x, 0xDC00, 0x400)
+            , carry, count );
+        it += 32;
     }
-    handle_extended_picto: {
-        if (state == after_xpic_zwj) {
-            state = after_xpic;
-            goto next_codepoint;
-        }
-        if (state != after_prepend) {
+    it -= carry;
+    count -= carry;
+    return {count, static_cast<std::size_t>(it - begin)};
+}
+
+#endif // defined(STRING_WIDTH_X86_SIMD)
+
+} // namespace detail
+
+// The sets of instructions that the SIMD kernels may use. Each level
+// implies the previous ones. `avx512` means AVX-512 F and BW.
+enum class simd_level {
+    scalar, sse2, sse4_2, avx2, avx512
+};
+
+namespace detail {
+
+// Returns the highest level supported by both the compilation
+// ( see STRING_WIDTH_NO_SIMD ) and the running CPU.
+inline string_width::simd_level detect_simd_level() noexcept
+{
+#if defined(STRING_WIDTH_X86_SIMD) && (defined(__GNUC__) || defined (__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+        return string_width::simd_level::avx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return string_width::simd_level::avx2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return string_width::simd_level::sse4_2;
+    }
+    return string_width::simd_level::sse2;
+#elif defined(STRING_WIDTH_X86_SIMD) && defined(_MSC_VER)
+    int regs[4];
+    __cpuid(regs, 1);
+    const bool sse42 = (regs[2] & (1 << 20)) != 0;
+    const bool osxsave_and_avx = (regs[2] & (3 << 27)) == (3 << 27);
+    const auto xcr0 = osxsave_and_avx ? _xgetbv(0) : 0;
+    __cpuidex(regs, 7, 0);
+    if ((xcr0 & 0xE6) == 0xE6 && (regs[1] & (1 << 16)) && (regs[1] & (1 << 30))) {
+        return string_width::simd_level::avx512;
+    }
+    if ((xcr0 & 6) == 6 && (regs[1] & (1 << 5))) {
+        return string_width::simd_level::avx2;
+    }
+    return sse42 ? string_width::simd_level::sse4_2 : string_width::simd_level::sse2;
+#else
+    return string_width::simd_level::scalar;
+#endif
+}
+
+using printable_ascii_run_length_func = std::size_t (*)
+    ( const std::uint8_t*, const std::uint8_t* );
+using u16_run_length_func = std::size_t (*)
+    ( const std::uint16_t*, const std::uint16_t* );
+using utf8_codepoints_run_func = string_width::detail::codepoints_count_result (*)
+    ( const std::uint8_t*, const std::uint8_t*, std::size_t, string_width::surrogate_policy );
+using utf16_codepoints_run_func = string_width::detail::codepoints_count_result (*)
+    ( const std::uint16_t*, const std::uint16_t*, std::size_t );
+
+// The functions used at a given simd_level
+struct simd_kernels {
+    string_width::simd_level level;
+    printable_ascii_run_length_func printable_ascii_run_length;
+    u16_run_length_func printable_ascii_run_length_u16;
+    u16_run_length_func wide_bmp_run_length_u16;
+    utf8_codepoints_run_func utf8_codepoints_run;
+    utf16_codepoints_run_func utf16_codepoints_run;
+};
+
+inline const simd_kernels& simd_kernels_for(string_width::simd_level level) noexcept
+{
+    static const simd_kernels scalar = { string_width::simd_level::scalar
+                                       , printable_ascii_run_length_scalar
+                                       , printable_ascii_run_length_u16_scalar
+                                       , wide_bmp_run_length_u16_scalar
+                                       , utf8_codepoints_run_scalar
+                                       , utf16_codepoints_run_scalar };
+#if defined(STRING_WIDTH_X86_SIMD)
+    static const simd_kernels sse2   = { string_width::simd_level::sse2
+                                       , printable_ascii_run_length_sse2
+                                       , printable_ascii_run_length_u16_sse2
+                                       , wide_bmp_run_length_u16_sse2
+                                       , utf8_codepoints_run_sse2
+                                       , utf16_codepoints_run_sse2 };
+    // _mm_cmpestri ( SSE4.2 ) turned out to be slower than the SSE2 kernel
+    static const simd_kernels sse42  = { string_width::simd_level::sse4_2
+                                       , printable_ascii_run_length_sse2
+                                       , printable_ascii_run_length_u16_sse2
+                                       , wide_bmp_run_length_u16_sse2
+                                       , utf8_codepoints_run_sse2
+                                       , utf16_codepoints_run_sse2 };
+    static const simd_kernels avx2   = { string_width::simd_level::avx2
+                                       , printable_ascii_run_length_avx2
+                                       , printable_ascii_run_length_u16_avx2
+                                       , wide_bmp_run_length_u16_avx2
+                                       , utf8_codepoints_run_avx2
+                                       , utf16_codepoints_run_avx2 };
+    static const simd_kernels avx512 = { string_width::simd_level::avx512
+                                       , printable_ascii_run_length_avx512
+                                       , printable_ascii_run_length_u16_avx512
+                                       , wide_bmp_run_length_u16_avx512
+                                       , utf8_codepoints_run_avx512
+                                       , utf16_codepoints_run_avx512 };
+    switch (level) {
+        case string_width::simd_level::sse2:   return sse2;
+        case string_width::simd_level::sse4_2: return sse42;
+        case string_width::simd_level::avx2:   return avx2;
+        case string_width::simd_level::avx512: return avx512;
+        default: break;
+    }
+#else
+    (void) level;
+#endif
+    return scalar;
+}
+
+// The kernels in use. They are selected according to the CPU
+// the first time that any of them is needed.
+inline std::atomic<const simd_kernels*>& active_simd_kernels() noexcept
+{
+    static std::atomic<const simd_kernels*> kernels
+        { &simd_kernels_for(string_width::detail::detect_simd_level()) };
+    return kernels;
+}
+
+inline std::size_t printable_ascii_run_length
+    ( const std::uint8_t* begin
+    , const std::uint8_t* end ) noexcept
+{
+    const auto* kernels = active_simd_kernels().load(std::memory_order_relaxed);
+    return kernels->printable_ascii_run_length(begin, end);
+}
+
+inline std::size_t printable_ascii_run_length
+    ( const std::uint16_t* begin
+    , const std::uint16_t* end ) noexcept
+{
+    const auto* kernels = active_simd_kernels().load(std::memory_order_relaxed);
+    return kernels->printable_ascii_run_length_u16(begin, end);
+}
+
+inline std::size_t wide_bmp_run_length
+    ( const std::uint16_t* begin
+    , const std::uint16_t* end ) noexcept
+{
+    const auto* kernels = active_simd_kernels().load(std::memory_order_relaxed);
+    return kernels->wide_bmp_run_length_u16(begin, end);
+}
+
+inline string_width::detail::codepoints_count_result utf8_codepoints_run
+    ( const std::uint8_t* begin
+    , const std::uint8_t* end
+    , std::size_t max_count
+    , string_width::surrogate_policy surr_poli ) noexcept
+{
+    const auto* kernels = active_simd_kernels().load(std::memory_order_relaxed);
+    return kernels->utf8_codepoints_run(begin, end, max_count, surr_poli);
+}
+
+inline string_width::detail::codepoints_count_result utf16_codepoints_run
+    ( const std::uint16_t* begin
+    , const std::uint16_t* end
+    , std::size_t max_count ) noexcept
+{
+    const auto* kernels = active_simd_kernels().load(std::memory_order_relaxed);
+    return kernels->utf16_codepoints_run(begin, end, max_count);
+}
+
+} // namespace detail
+
+// Returns the highest simd_level available in the running CPU
+inline string_width::simd_level detected_simd_level() noexcept
+{
+    static const auto level = string_width::detail::detect_simd_level();
+    return level;
+}
+
+// Returns the simd_level of the kernels that are in use
+inline string_width::simd_level active_simd_level() noexcept
+{
+    return string_width::detail::active_simd_kernels().load(std::memory_order_relaxed)->level;
+}
+
+// Makes the library use the kernels of the given level, or of the
+// detected one if it is lower. Returns the level that is actually set.
+// It is meant for testing and benchmarking. It is safe to call it while
+// other threads use the library, but they may not see the change at once.
+inline string_width::simd_level set_simd_level(string_width::simd_level level) noexcept
+{
+    const auto detected = string_width::detected_simd_level();
+    if (level > detected) {
+        level = detected;
+    }
+    const auto* kernels = &string_width::detail::simd_kernels_for(level);
+    string_width::detail::active_simd_kernels().store(kernels, std::memory_order_relaxed);
+    return kernels->level;
+}
+
+namespace detail {
+
+template <typename Dest, typename SrcCharT>
+typename std::enable_if<sizeof(SrcCharT) == 1, void>::type decode
+    ( Dest& dest
+    , const SrcCharT* src
+    , std::size_t src_size
+    , string_width::surrogate_policy surr_poli ) noexcept
+{
+    using string_width::detail::utf8_decode;
+    using string_width::detail::utf8_decode_first_2_of_3;
+    using string_width::detail::utf8_decode_first_2_of_4;
+    using string_width::detail::utf8_decode_last_2_of_4;
+    using string_width::detail::first_2_of_3_are_valid;
+    using string_width::detail::first_2_of_4_are_valid;
+    using string_width::detail::is_utf8_continuation;
+
+    std::uint8_t ch0, ch1, ch2, ch3;
+    unsigned long x;
+    auto src_it = src;
+    auto src_end = src + src_size;
+    auto dest_it = dest.pointer();
+    auto dest_end = dest.end();
+    typename Dest::char_type ch32;
+
+    while(src_it != src_end) {
+        ch0 = (*src_it);
+        ++src_it;
+        if (ch0 < 0x80) {
+            ch32 = ch0;
+        } else if (0xC0 == (ch0 & 0xE0)) {
+            if(ch0 > 0xC1 && src_it != src_end && is_utf8_continuation(ch1 = * src_it)) {
+                ch32 = utf8_decode(ch0, ch1);
+                ++src_it;
+            } else goto invalid_sequence;
+        } else if (0xE0 == ch0) {
+            if (   src_it != src_end && (((ch1 = * src_it) & 0xE0) == 0xA0)
+              && ++src_it != src_end && is_utf8_continuation(ch2 = * src_it) )
+            {
+                ch32 = ((ch1 & 0x3F) << 6) | (ch2 & 0x3F);
+                ++src_it;
+            } else goto invalid_sequence;
+        } else if (0xE0 == (ch0 & 0xF0)) {
+            if (   src_it != src_end && is_utf8_continuation(ch1 = * src_it)
+              && first_2_of_3_are_valid( x = utf8_decode_first_2_of_3(ch0, ch1)
+                                       , surr_poli )
+              && ++src_it != src_end && is_utf8_continuation(ch2 = * src_it) )
+            {
+                ch32 = (x << 6) | (ch2 & 0x3F);
+                ++src_it;
+            } else goto invalid_sequence;
+        } else if ( src_it != src_end
+                 && is_utf8_continuation(ch1 = * src_it)
+                 && first_2_of_4_are_valid(x = utf8_decode_first_2_of_4(ch0, ch1))
+                 && ++src_it != src_end && is_utf8_continuation(ch2 = * src_it)
+                 && ++src_it != src_end && is_utf8_continuation(ch3 = * src_it) )
+        {
+            ch32 = utf8_decode_last_2_of_4(x, ch2, ch3);
+            ++src_it;
+        } else {
+            invalid_sequence:
+            STRING_WIDTH_PROBE(invalid_sequences, 1);
+            ch32 = 0xFFFD;
+        }
+
+        STRING_WIDTH_CHECK_DEST;
+        *dest_it = ch32;
+        ++dest_it;
+    }
+    dest.advance_to(dest_it);
+}
+
+template <typename Dest, typename SrcCharT>
+typename std::enable_if<sizeof(SrcCharT) == 2, void>::type decode
+    ( Dest& dest
+    , const SrcCharT* src
+    , std::size_t src_size
+    , string_width::surrogate_policy surr_poli ) noexcept
+{
+    unsigned long ch, ch2;
+    typename Dest::char_type ch32;
+    const SrcCharT* src_it_next;
+    auto src_end = src + src_size;
+    auto dest_it = dest.pointer();
+    auto dest_end = dest.end();
+    for(auto src_it = src; src_it != src_end; src_it = src_it_next) {
+        src_it_next = src_it + 1;
+        ch = *src_it;
+        src_it_next = src_it + 1;
+
+        STRING_WIDTH_IF_LIKELY (string_width::detail::not_surrogate(ch)) {
+            ch32 = ch;
+        } else if ( string_width::detail::is_high_surrogate(ch)
+               && src_it_next != src_end
+               && string_width::detail::is_low_surrogate(ch2 = *src_it_next)) {
+            ch32 = 0x10000 + (((ch & 0x3FF) << 10) | (ch2 & 0x3FF));
+            ++src_it_next;
+        } else if (surr_poli == string_width::surrogate_policy::lax) {
+            ch32 = ch;
+        } else {
+            STRING_WIDTH_PROBE(invalid_sequences, 1);
+            ch32 = 0xFFFD;
+        }
+
+        STRING_WIDTH_CHECK_DEST;
+        *dest_it = ch32;
+        ++dest_it;
+    }
+    dest.advance_to(dest_it);
+}
+
+template <typename Dest, typename SrcCharT>
+typename std::enable_if<sizeof(SrcCharT) == 4, void>::type decode
+    ( Dest& dest
+    , const SrcCharT* src
+    , std::size_t src_size
+    , string_width::surrogate_policy ) noexcept
+{
+    // to-do : optimize ( not need to sanitize )
+
+    const auto src_end = src + src_size;
+    auto dest_it = dest.pointer();
+    auto dest_end = dest.end();
+    for (auto src_it = src; src_it < src_end; ++src_it) {
+        auto ch = *src_it;
+        STRING_WIDTH_IF_UNLIKELY (ch >= 0x110000) {
+            STRING_WIDTH_PROBE(invalid_sequences, 1);
+            ch = 0xFFFD;
+        }
+        STRING_WIDTH_CHECK_DEST;
+        *dest_it = ch;
+        ++dest_it;
+    }
+    dest.advance_to(dest_it);
+}
+
+template <typename CharT>
+typename std::enable_if
+    < sizeof(CharT) == 1
+    , string_width::detail::codepoints_count_result >::type
+count_codepoints
+    ( const CharT* src
+    , std::size_t src_size
+    , std::size_t max_count
+    , string_width::surrogate_policy surr_poli ) noexcept
+{
+    using string_width::detail::utf8_decode;
+    using string_width::detail::is_utf8_continuation;
+    using string_width::detail::first_2_of_3_are_valid;
+    using string_width::detail::first_2_of_4_are_valid;
+
+    std::uint8_t ch0, ch1;
+    std::size_t count = 0;
+    auto it = src;
+    auto end = src + src_size;
+    // The kernels count the codepoints of the blocks that have no invalid
+    // sequence. When they stop, the next block ( at least ) is decoded here.
+    const CharT* scalar_end = src;
+    while (it != end && count != max_count) {
+        if (it >= scalar_end) {
+            const auto run = string_width::detail::utf8_codepoints_run
+                ( reinterpret_cast<const std::uint8_t*>(it)
+                , reinterpret_cast<const std::uint8_t*>(end)
+                , max_count - count, surr_poli );
+            count += run.count;
+            it += run.pos;
+            scalar_end = end - it > 64 ? it + 64 : end;
+            if (it == end || count == max_count) {
+                break;
+            }
+        }
+        ch0 = (*it);
+        ++it;
+        ++count;
+        if (0xC0 == (ch0 & 0xE0)) {
+            if (ch0 > 0xC1 && it != end && is_utf8_continuation(*it)) {
+                ++it;
+            }
+        } else if (0xE0 == ch0) {
+            if (   it != end && ((*it & 0xE0) == 0xA0)
+              && ++it != end && is_utf8_continuation(*it) )
+            {
+                ++it;
+            }
+        } else if (0xE0 == (ch0 & 0xF0)) {
+            if ( it != end && is_utf8_continuation(ch1 = *it)
+              && first_2_of_3_are_valid( ch0, ch1, surr_poli )
+              && ++it != end && is_utf8_continuation(*it) )
+            {
+                ++it;
+            }
+        } else if (   it != end && is_utf8_continuation(ch1 = * it)
+                 && first_2_of_4_are_valid(ch0, ch1)
+                 && ++it != end && is_utf8_continuation(*it)
+                 && ++it != end && is_utf8_continuation(*it) )
+        {
+            ++it;
+        }
+    }
+    return {count, static_cast<std::size_t>(it - src)};
+}
+
+template <typename CharT>
+typename std::enable_if
+    < sizeof(CharT) == 2
+    , string_width::detail::codepoints_count_result >::type
+count_codepoints
+    ( const CharT* src
+    , std::size_t src_size
+    , std::size_t max_count
+    , string_width::surrogate_policy ) noexcept
+{
+    const auto run = string_width::detail::utf16_codepoints_run
+        ( reinterpret_cast<const std::uint16_t*>(src)
+        , reinterpret_cast<const std::uint16_t*>(src + src_size)
+        , max_count );
+    std::size_t count = run.count;
+    const CharT* it = src + run.pos;
+    const auto end = src + src_size;
+    unsigned long ch;
+    while (it != end && count < max_count) {
+        ch = *it;
+        ++ it;
+        ++ count;
+        if ( string_width::detail::is_high_surrogate(ch) && it != end
+          && string_width::detail::is_low_surrogate(*it)) {
+            ++ it;
+        }
+    }
+    return {count, static_cast<std::size_t>(it - src)};
+}
+
+template <typename CharT>
+typename std::enable_if
+    < sizeof(CharT) == 4
+    , string_width::detail::codepoints_count_result >::type
+count_codepoints
+    ( const CharT*
+    , std::size_t src_size
+    , std::size_t max_count
+    , string_width::surrogate_policy ) noexcept
+{
+    if (max_count <= src_size) {
+        return {max_count, max_count};
+    }
+    return {src_size, src_size};
+}
+
+
+namespace grapheme_state {
+
+// states of the grapheme cluster segmentation carried by std_width_calc_func
+
+using state_t = unsigned;
+constexpr state_t initial          = 0;
+constexpr state_t after_prepend    = 1;
+constexpr state_t after_core       = 1 << 1;
+constexpr state_t after_ri         = after_core | (1 << 2);
+constexpr state_t after_xpic       = after_core | (1 << 3);
+constexpr state_t after_xpic_zwj   = after_core | (1 << 4);
+constexpr state_t after_hangul     = after_core | (1 << 5);
+constexpr state_t after_hangul_l   = after_hangul | (1 << 6);
+constexpr state_t after_hangul_v   = after_hangul | (1 << 7);
+constexpr state_t after_hangul_t   = after_hangul | (1 << 8);
+constexpr state_t after_hangul_lv  = after_hangul | (1 << 9);
+constexpr state_t after_hangul_lvt = after_hangul | (1 << 10);
+constexpr state_t after_poscore    = 1 << 11;
+constexpr state_t after_cr         = 1 << 12;
+
+} // namespace grapheme_state
+
+namespace prop {
+
+// layout of the bytes stored in width_and_gcb_prop_tables
+
+constexpr std::uint8_t other              = 0;
+constexpr std::uint8_t control            = 1;
+constexpr std::uint8_t extend             = 2;
+constexpr std::uint8_t zwj                = 3;
+constexpr std::uint8_t spacing_mark       = 4;
+constexpr std::uint8_t prepend            = 5;
+constexpr std::uint8_t hangul_l           = 6;
+constexpr std::uint8_t hangul_v           = 7;
+constexpr std::uint8_t hangul_t           = 8;
+constexpr std::uint8_t hangul_lv          = 9;
+constexpr std::uint8_t hangul_lvt         = 10;
+constexpr std::uint8_t regional_indicator = 11;
+constexpr std::uint8_t extended_picto     = 12;
+constexpr std::uint8_t cr                 = 13;
+constexpr std::uint8_t lf                 = 14;
+
+constexpr std::uint8_t category_mask      = 0x0F;
+constexpr std::uint8_t double_width       = 0x10;
+
+} // namespace prop
+
+#include <string_width/detail/width_and_gcb_prop_tables>
+#include <string_width/detail/width_and_gcb_prop_tables_east_asian_wide>
+#include <string_width/detail/width_and_gcb_prop_tables_wcwidth>
+
+// The tables of each width_profile. They only differ in the prop::double_width bit.
+template <string_width::width_profile Profile>
+struct prop_tables_of {
+    using type = width_and_gcb_prop_tables<>;
+};
+template <>
+struct prop_tables_of<string_width::width_profile::east_asian_wide> {
+    using type = width_and_gcb_prop_tables_east_asian_wide<>;
+};
+template <>
+struct prop_tables_of<string_width::width_profile::wcwidth> {
+    using type = width_and_gcb_prop_tables_wcwidth<>;
+};
+
+using prop_tables = prop_tables_of<string_width::width_profile::std_format>::type;
+
+// The arguments are the bits 12-20, 6-11 and 0-5 of the codepoint,
+// which is the same as the payload of the bytes of its UTF-8 encoding,
+// except for the first one.
+template <string_width::width_profile Profile = string_width::width_profile::std_format>
+constexpr std::uint8_t lookup_props(unsigned hi, unsigned mid, unsigned lo) noexcept
+{
+    using tables = typename prop_tables_of<Profile>::type;
+    return tables::stage3
+        [ tables::stage2[tables::stage1[hi] * 64 + (mid & 0x3F)] * 64
+        + (lo & 0x3F) ];
+}
+
+template <string_width::width_profile Profile = string_width::width_profile::std_format>
+constexpr std::uint8_t ch32_props(char32_t ch) noexcept
+{
+    return lookup_props<Profile>(ch >> 12, ch >> 6, ch);
+}
+
+// The properties of U+FFFD, which replaces invalid sequences. Its width
+// depends on the profile, since its East Asian Width is Ambiguous.
+template <string_width::width_profile Profile = string_width::width_profile::std_format>
+constexpr std::uint8_t replacement_char_props() noexcept
+{
+    return ch32_props<Profile>(0xFFFD);
+}
+
+// What next_props returns for an invalid sequence. It also sets `*invalid`,
+// if not null, so that the caller can tell it from U+FFFD.
+template <string_width::width_profile Profile = string_width::width_profile::std_format>
+STRING_WIDTH_CONSTEXPR_IN_CXX20 std::uint8_t invalid_sequence_props(bool* invalid) noexcept
+{
+    if (invalid != nullptr) {
+        *invalid = true;
+    }
+    return replacement_char_props<Profile>();
+}
+
+// Updates the grapheme cluster segmentation state according to the category
+// of the next codepoint, and returns whether such codepoint starts a new
+// grapheme cluster. It is equivalent to the state machine implemented
+// in std_width_calc_func.
+STRING_WIDTH_CONSTEXPR_IN_CXX20 bool gcb_step(grapheme_state::state_t& state, std::uint8_t category) noexcept
+{
+    using namespace string_width::detail::grapheme_state;
+
+    bool starts_cluster = (state != after_prepend);
+    STRING_WIDTH_IF_LIKELY (category == prop::other) {
+        state = after_core;
+        return starts_cluster;
+    }
+    switch (category) {
+        case prop::cr:
+            state = after_cr;
+            return true;
+
+        case prop::lf:
+            starts_cluster = (state != after_cr);
+            state = initial;
+            return starts_cluster;
+
+        case prop::zwj:
+            if (state == after_xpic) {
+                state = after_xpic_zwj;
+                return false;
+            }
+            break;
+
+        case prop::extend:
+            if (state == after_xpic) {
+                return false;
+            }
+            break;
+
+        case prop::spacing_mark:
+            break;
+
+        case prop::prepend:
+            starts_cluster = (state != after_prepend);
+            state = after_prepend;
+            return starts_cluster;
+
+        case prop::regional_indicator:
+            if (state == after_ri) {
+                state = after_core;
+                return false;
+            }
+            state = after_ri;
+            return starts_cluster;
+
+        case prop::extended_picto:
+            if (state == after_xpic_zwj) {
+                state = after_xpic;
+                return false;
+            }
+            state = after_xpic;
+            return starts_cluster;
+
+        case prop::hangul_l:
+            starts_cluster = starts_cluster && state != after_hangul_l;
+            state = after_hangul_l;
+            return starts_cluster;
+
+        case prop::hangul_v: {
+            constexpr state_t mask = ~after_hangul &
+                (after_hangul_l | after_hangul_v | after_hangul_lv);
+            starts_cluster = starts_cluster && ! (state & mask);
+            state = after_hangul_v;
+            return starts_cluster;
+        }
+        case prop::hangul_t: {
+            constexpr state_t mask = ~after_hangul &
+                (after_hangul_v | after_hangul_lv | after_hangul_lvt | after_hangul_t);
+            starts_cluster = starts_cluster && ! (state & mask);
+            state = after_hangul_t;
+            return starts_cluster;
+        }
+        case prop::hangul_lv:
+            starts_cluster = starts_cluster && state != after_hangul_l;
+            state = after_hangul_lv;
+            return starts_cluster;
+
+        case prop::hangul_lvt:
+            starts_cluster = starts_cluster && state != after_hangul_l;
+            state = after_hangul_lvt;
+            return starts_cluster;
+
+        default: // prop::control
+            state = initial;
+            return true;
+    }
+    // extend, zwj and spacing_mark
+    starts_cluster = ! (state & (after_prepend | after_core | after_poscore));
+    state = after_poscore;
+    return starts_cluster;
+}
+
+// Reads the UTF-8 sequence that starts at `it` and returns its properties,
+// without reconstructing the codepoint. Invalid sequences are handled like in
+// decode: each one is treated as an U+FFFD and `it` is left where decode
+// would continue.
+template <string_width::width_profile Profile = string_width::width_profile::std_format, typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20 std::uint8_t utf8_next_props
+    ( const CharT*& it
+    , const CharT* end
+    , string_width::surrogate_policy surr_poli
+    , bool* invalid = nullptr ) noexcept
+{
+    std::uint8_t ch0, ch1, ch2, ch3;
+    ch0 = *it;
+    ++it;
+    if (ch0 < 0x80) {
+        return lookup_props<Profile>(0, ch0 >> 6, ch0);
+    }
+    if (0xC0 == (ch0 & 0xE0)) {
+        if (ch0 > 0xC1 && it != end && is_utf8_continuation(ch1 = *it)) {
+            ++it;
+            return lookup_props<Profile>(0, ch0, ch1);
+        }
+        return invalid_sequence_props<Profile>(invalid);
+    }
+    if (0xE0 == (ch0 & 0xF0)) {
+        if (   it != end && is_utf8_continuation(ch1 = *it)
+            && (ch0 != 0xE0 || ch1 >= 0xA0)
+            && ( ch0 != 0xED || ch1 < 0xA0
+              || surr_poli == string_width::surrogate_policy::lax )
+            && ++it != end && is_utf8_continuation(ch2 = *it) )
+        {
+            ++it;
+            return lookup_props<Profile>(ch0 & 0x0F, ch1, ch2);
+        }
+        return invalid_sequence_props<Profile>(invalid);
+    }
+    unsigned x;
+    if (   it != end
+        && is_utf8_continuation(ch1 = *it)
+        && first_2_of_4_are_valid(x = utf8_decode_first_2_of_4(ch0, ch1))
+        && ++it != end && is_utf8_continuation(ch2 = *it)
+        && ++it != end && is_utf8_continuation(ch3 = *it) )
+    {
+        ++it;
+        return lookup_props<Profile>(x, ch2, ch3);
+    }
+    return invalid_sequence_props<Profile>(invalid);
+}
+
+// Reads the codepoint that starts at `it` and returns its properties. Invalid
+// sequences are handled like in decode.
+template <string_width::width_profile Profile = string_width::width_profile::std_format, typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20 typename std::enable_if<sizeof(CharT) == 1, std::uint8_t>::type next_props
+    ( const CharT*& it
+    , const CharT* end
+    , string_width::surrogate_policy surr_poli
+    , bool* invalid = nullptr ) noexcept
+{
+    return string_width::detail::utf8_next_props<Profile>(it, end, surr_poli, invalid);
+}
+
+template <string_width::width_profile Profile = string_width::width_profile::std_format, typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20 typename std::enable_if<sizeof(CharT) == 2, std::uint8_t>::type next_props
+    ( const CharT*& it
+    , const CharT* end
+    , string_width::surrogate_policy surr_poli
+    , bool* invalid = nullptr ) noexcept
+{
+    const unsigned long ch = *it;
+    ++it;
+    STRING_WIDTH_IF_LIKELY (string_width::detail::not_surrogate(ch)) {
+        return ch32_props<Profile>(static_cast<char32_t>(ch));
+    }
+    unsigned long ch2;
+    if ( string_width::detail::is_high_surrogate(ch)
+      && it != end
+      && string_width::detail::is_low_surrogate(ch2 = *it)) {
+        ++it;
+        return ch32_props<Profile>(static_cast<char32_t>(0x10000 + (((ch & 0x3FF) << 10) | (ch2 & 0x3FF))));
+    }
+    if (surr_poli == string_width::surrogate_policy::lax) {
+        return ch32_props<Profile>(static_cast<char32_t>(ch));
+    }
+    return invalid_sequence_props<Profile>(invalid);
+}
+
+template <string_width::width_profile Profile = string_width::width_profile::std_format, typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20 typename std::enable_if<sizeof(CharT) == 4, std::uint8_t>::type next_props
+    ( const CharT*& it
+    , const CharT*
+    , string_width::surrogate_policy
+    , bool* invalid = nullptr ) noexcept
+{
+    const auto ch = static_cast<std::uint32_t>(*it);
+    ++it;
+    STRING_WIDTH_IF_UNLIKELY (ch >= 0x110000) {
+        return invalid_sequence_props<Profile>(invalid);
+    }
+    return ch32_props<Profile>(static_cast<char32_t>(ch));
+}
+
+// The same as next_props, but for strings that are known to be well-formed:
+// no sequence is checked, nor compared against `end`. In UTF-8, the payload
+// bits of each sequence are passed to lookup_props without further ado.
+template <string_width::width_profile Profile = string_width::width_profile::std_format, typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20 typename std::enable_if<sizeof(CharT) == 1, std::uint8_t>::type
+unchecked_next_props(const CharT*& it) noexcept
+{
+    const std::uint8_t ch0 = it[0];
+    STRING_WIDTH_IF_LIKELY (ch0 < 0x80) {
+        ++it;
+        return lookup_props<Profile>(0, ch0 >> 6, ch0);
+    }
+    const std::uint8_t ch1 = it[1];
+    if (ch0 < 0xE0) {
+        it += 2;
+        return lookup_props<Profile>(0, ch0, ch1);
+    }
+    const std::uint8_t ch2 = it[2];
+    if (ch0 < 0xF0) {
+        it += 3;
+        return lookup_props<Profile>(ch0 & 0x0F, ch1, ch2);
+    }
+    const std::uint8_t ch3 = it[3];
+    it += 4;
+    return lookup_props<Profile>(((ch0 & 0x07) << 6) | (ch1 & 0x3F), ch2, ch3);
+}
+
+template <string_width::width_profile Profile = string_width::width_profile::std_format, typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20 typename std::enable_if<sizeof(CharT) == 2, std::uint8_t>::type
+unchecked_next_props(const CharT*& it) noexcept
+{
+    const unsigned long ch = *it;
+    ++it;
+    STRING_WIDTH_IF_LIKELY (string_width::detail::not_surrogate(ch)) {
+        return ch32_props<Profile>(static_cast<char32_t>(ch));
+    }
+    const unsigned long ch2 = *it;
+    ++it;
+    return ch32_props<Profile>(static_cast<char32_t>(0x10000 + (((ch & 0x3FF) << 10) | (ch2 & 0x3FF))));
+}
+
+template <string_width::width_profile Profile = string_width::width_profile::std_format, typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20 typename std::enable_if<sizeof(CharT) == 4, std::uint8_t>::type
+unchecked_next_props(const CharT*& it) noexcept
+{
+    const auto ch = static_cast<char32_t>(*it);
+    ++it;
+    return ch32_props<Profile>(ch);
+}
+
+// Returns whether [it, end) has no invalid sequence, with
+// surrogate_policy::strict. It is what validation_policy::assume_valid
+// requires, and it is only called in assertions.
+template <typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20 typename std::enable_if<sizeof(CharT) == 1, bool>::type
+is_well_formed(const CharT* it, const CharT* end) noexcept
+{
+    while (it != end) {
+        const std::uint8_t ch0 = *it;
+        const std::ptrdiff_t seq_len = ( ch0 < 0x80 ? 1 : ch0 < 0xC2 ? 0
+                                       : ch0 < 0xE0 ? 2 : ch0 < 0xF0 ? 3
+                                       : ch0 < 0xF5 ? 4 : 0 );
+        // utf8_next_props takes the whole sequence only when it is valid
+        const CharT* const seq_begin = it;
+        (void) string_width::detail::utf8_next_props
+            (it, end, string_width::surrogate_policy::strict);
+        if (it - seq_begin != seq_len) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20 typename std::enable_if<sizeof(CharT) == 2, bool>::type
+is_well_formed(const CharT* it, const CharT* end) noexcept
+{
+    while (it != end) {
+        const unsigned long ch = *it;
+        ++it;
+        if (string_width::detail::not_surrogate(ch)) {
+            continue;
+        }
+        if ( ! string_width::detail::is_high_surrogate(ch) || it == end
+          || ! string_width::detail::is_low_surrogate(*it) ) {
+            return false;
+        }
+        ++it;
+    }
+    return true;
+}
+
+template <typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20 typename std::enable_if<sizeof(CharT) == 4, bool>::type
+is_well_formed(const CharT* it, const CharT* end) noexcept
+{
+    for (; it != end; ++it) {
+        const auto ch = static_cast<std::uint32_t>(*it);
+        if (ch >= 0x110000) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct std_width_calc_func_return {
+
+    std_width_calc_func_return
+        ( string_width::width_t width_
+        , unsigned state_
+        , const char32_t* ptr_ ) noexcept
+        : width(width_)
+        , state(state_)
+        , ptr(ptr_)
+    {
+    }
+
+    std_width_calc_func_return(const std_width_calc_func_return&) = default;
+
+    string_width::width_t width;
+    unsigned state;
+    const char32_t* ptr;
+};
+
+// std_width_calc_func with the widths of the given profile. It is only
+// instantiated for the profiles that are used, so with separate compilation
+// the tree of the default profile is still compiled only once.
+template <string_width::width_profile Profile>
+inline std_width_calc_func_return basic_std_width_calc_func
+    ( const char32_t* str
+    , const char32_t* end
+    , string_width::width_t width
+    , unsigned state
+    , bool return_pos ) noexcept
+{
+    // following http://www.unicode.org/reports/tr29/tr29-37.html#Grapheme_Cluster_Boundaries
+
+    using state_t = string_width::detail::grapheme_state::state_t;
+    using namespace string_width::detail::grapheme_state;
+
+    string_width::width_t ch_width;
+    char32_t ch;
+    goto next_codepoint;
+
+    handle_other:
+    if (state == after_prepend) {
+        state = after_core;
+        goto next_codepoint;
+    }
+    state = after_core;
+
+    decrement_width:
+    // should come here after the first codepoint of every grapheme cluster
+    STRING_WIDTH_PROBE(clusters, 1);
+    STRING_WIDTH_PROBE(wide_chars, ch_width - 1);
+    if (ch_width >= width) {
+        if (! return_pos) {
+            return {0, 0, nullptr};
+        }
+        if (ch_width > width) {
+            return {0, 0, str -1};
+        }
+        width = 0;
+        goto next_codepoint; // because there might be more codepoints in this grapheme cluster
+    }
+    width -= ch_width;
+
+    next_codepoint:
+    if (str == end) {
+        return {width, state, str};
+    }
+    ch = *str;
+    ++str;
+    ch_width = 1;
+    STRING_WIDTH_PROBE(codepoints, 1);
+    if (ch <= 0x007E) {
+        if (0x20 <= ch) {
+            ch_width = 1;
+            goto handle_other;
+        }
+        if (0x000D == ch) { // CR
+            goto handle_cr;
+        }
+        if (0x000A == ch) { // LF
+            goto handle_lf;
+        }
+        goto handle_control;
+    }
+
+    STRING_WIDTH_IF_UNLIKELY (ch >= 0x110000) {
+        STRING_WIDTH_PROBE(invalid_sequences, 1);
+        ch = 0xFFFD; // like decode does
+    }
+#if defined(STRING_WIDTH_USE_PROP_TABLES)
+    {
+        const auto props = string_width::detail::ch32_props<Profile>(ch);
+        if (props & string_width::detail::prop::double_width) {
+            ch_width = 2;
+        }
+        STRING_WIDTH_IF_LIKELY ((props & string_width::detail::prop::category_mask) == 0) {
+            goto handle_other;
+        }
+        switch (props & string_width::detail::prop::category_mask) {
+            case string_width::detail::prop::extend:             goto handle_extend;
+            case string_width::detail::prop::zwj:                goto handle_zwj;
+            case string_width::detail::prop::spacing_mark:       goto handle_spacing_mark;
+            case string_width::detail::prop::prepend:            goto handle_prepend;
+            case string_width::detail::prop::hangul_l:           goto handle_hangul_l;
+            case string_width::detail::prop::hangul_v:           goto handle_hangul_v;
+            case string_width::detail::prop::hangul_t:           goto handle_hangul_t;
+            case string_width::detail::prop::hangul_lv:          goto handle_hangul_lv_or_lvt;
+            case string_width::detail::prop::hangul_lvt:         goto handle_hangul_lv_or_lvt;
+            case string_width::detail::prop::regional_indicator: goto handle_regional_indicator;
+            case string_width::detail::prop::extended_picto:     goto handle_extended_picto;
+            case string_width::detail::prop::cr:                 goto handle_cr;
+            case string_width::detail::prop::lf:                 goto handle_lf;
+            default:                                             goto handle_control;
+        }
+    }
+#else
+    // Profile is a constant, so only one of the trees is kept
+    if (Profile == string_width::width_profile::east_asian_wide) {
+#include <string_width/detail/ch32_width_and_gcb_prop_east_asian_wide>
+    }
+    if (Profile == string_width::width_profile::wcwidth) {
+#include <string_width/detail/ch32_width_and_gcb_prop_wcwidth>
+    }
+#include <string_width/detail/ch32_width_and_gcb_prop>
+#endif
+
+    handle_zwj:
+    if (state == after_xpic) {
+        state = after_xpic_zwj;
+        goto next_codepoint;
+    }
+    goto handle_spacing_mark; // because the code is the same
+
+    handle_extend:
+#if ! defined(STRING_WIDTH_USE_PROP_TABLES)
+    handle_extend_and_control:
+#endif
+    if (state == after_xpic) {
+        goto next_codepoint;
+    }
+
+    handle_spacing_mark:
+    if (state & (after_prepend | after_core | after_poscore)) {
+        state = after_poscore;
+        goto next_codepoint;
+    }
+    state = after_poscore;
+    goto decrement_width;
+
+    handle_prepend:
+    if (state == after_prepend) {
+        goto next_codepoint;
+    }
+    state = after_prepend;
+    goto decrement_width;
+
+    handle_regional_indicator: {
+        if (state == after_ri) {
+            state = after_core;
+            goto next_codepoint;
+        }
+        if (state != after_prepend) {
+            state = after_ri;
+            goto decrement_width;
+        }
+        state = after_ri;
+        goto next_codepoint;
+    }
+    handle_extended_picto: {
+        if (state == after_xpic_zwj) {
+            state = after_xpic;
+            goto next_codepoint;
+        }
+        if (state != after_prepend) {
             state = after_xpic;
             goto decrement_width;
         }
-        state = after_xpic;
-        goto next_codepoint;
+        state = after_xpic;
+        goto next_codepoint;
+    }
+    handle_hangul_l: {
+        if (state == after_hangul_l) {
+            goto next_codepoint;
+        }
+        if (state != after_prepend) {
+            state = after_hangul_l;
+            goto decrement_width;
+        }
+        state = after_hangul_l;
+        goto next_codepoint;
+    }
+    handle_hangul_v: {
+        constexpr state_t mask = ~after_hangul &
+            (after_hangul_l | after_hangul_v | after_hangul_lv);
+        if (state & mask) {
+            state = after_hangul_v;
+            goto next_codepoint;
+        }
+        if (state != after_prepend) {
+            state = after_hangul_v;
+            goto decrement_width;
+        }
+        state = after_hangul_v;
+        goto next_codepoint;
+    }
+    handle_hangul_t: {
+        constexpr state_t mask = ~after_hangul &
+            (after_hangul_v | after_hangul_lv | after_hangul_lvt | after_hangul_t);
+        if (state & mask) {
+            state = after_hangul_t;
+            goto next_codepoint;
+        }
+        if (state != after_prepend) {
+            state = after_hangul_t;
+            goto decrement_width;
+        }
+        state = after_hangul_t;
+        goto next_codepoint;
+    }
+    handle_hangul_lv_or_lvt:
+    if ( ch <= 0xD788 // && 0xAC00 <= ch
+         && 0 == (ch & 3)
+         && 0 == ((ch - 0xAC00) >> 2) % 7)
+    {   // LV
+        if (state == after_hangul_l) {
+            state = after_hangul_lv;
+            goto next_codepoint;
+        }
+        if (state != after_prepend) {
+            state = after_hangul_lv;
+            goto decrement_width;
+        }
+        state = after_hangul_lv;
+        goto next_codepoint;
+
+    } else { // LVT
+        if (state == after_hangul_l) {
+            state = after_hangul_lvt;
+            goto next_codepoint;
+        }
+        if (state != after_prepend) {
+            state = after_hangul_lvt;
+            goto decrement_width;
+        }
+        state = after_hangul_lvt;
+        goto next_codepoint;
+    }
+
+    handle_cr:
+    state = after_cr;
+    goto decrement_width;
+
+    handle_lf:
+    if (state == after_cr) {
+        state = initial;
+        goto next_codepoint;
+    }
+    handle_control:
+    state = initial;
+    goto decrement_width;
+}
+
+#if ! defined(STRING_WIDTH_OMIT_IMPL)
+
+STRING_WIDTH_FUNC_IMPL std_width_calc_func_return std_width_calc_func
+    ( const char32_t* str
+    , const char32_t* end
+    , string_width::width_t width
+    , unsigned state
+    , bool return_pos ) noexcept
+{
+    return string_width::detail::basic_std_width_calc_func<string_width::width_profile::std_format>
+        (str, end, width, state, return_pos);
+}
+
+#else
+
+std_width_calc_func_return std_width_calc_func
+    ( const char32_t* begin
+    , const char32_t* end
+    , string_width::width_t width
+    , unsigned state
+    , bool return_pos ) noexcept;
+
+#endif // ! defined(STRING_WIDTH_OMIT_IMPL)
+
+// Calls std_width_calc_func for the default profile, and
+// basic_std_width_calc_func for the others
+template <string_width::width_profile Profile>
+struct profile_width_calc_func {
+    static std_width_calc_func_return call
+        ( const char32_t* str
+        , const char32_t* end
+        , string_width::width_t width
+        , unsigned state
+        , bool return_pos ) noexcept
+    {
+        return string_width::detail::basic_std_width_calc_func<Profile>
+            (str, end, width, state, return_pos);
+    }
+};
+
+template <>
+struct profile_width_calc_func<string_width::width_profile::std_format> {
+    static std_width_calc_func_return call
+        ( const char32_t* str
+        , const char32_t* end
+        , string_width::width_t width
+        , unsigned state
+        , bool return_pos ) noexcept
+    {
+        return string_width::detail::std_width_calc_func(str, end, width, state, return_pos);
+    }
+};
+
+#if defined(__GNUC__) && (__GNUC__ >= 11)
+#  pragma GCC diagnostic push
+#  pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+
+template <std::size_t BuffSize>
+class basic_std_width_decrementer final
+    : public string_width::detail::static_destination
+        < char32_t, basic_std_width_decrementer<BuffSize> >
+{
+    using base_ = string_width::detail::static_destination
+        < char32_t, basic_std_width_decrementer<BuffSize> >;
+
+public:
+    basic_std_width_decrementer (string_width::width_t initial_width) noexcept
+        : base_(buff_, BuffSize)
+        , width_{initial_width}
+    {
+        this->set_good(initial_width != 0);
+    }
+
+    void recycle() noexcept {
+        if (this->good()) {
+            auto res = detail::std_width_calc_func(buff_, this->pointer(), width_, state_, false);
+            width_ = res.width;
+            state_ = res.state;
+            if (width_ == 0) {
+                this->set_good(false);
+            }
+        }
+        this->set_pointer(buff_);
     }
-    handle_hangul_l: {
-        if (state == after_hangul_l) {
-            goto next_codepoint;
+
+
+    void reset(string_width::width_t initial_width) noexcept {
+        width_ = initial_width;
+        state_ = 0;
+        this->set_pointer(buff_);
+        this->set_good(initial_width != 0);
+    }
+
+    string_width::width_t get_remaining_width()  noexcept {
+        if (width_ != 0 && this->pointer() != buff_) {
+            auto res = detail::std_width_calc_func(buff_, this->pointer(), width_, state_, false);
+            return res.width;
         }
-        if (state != after_prepend) {
-            state = after_hangul_l;
-            goto decrement_width;
+        return width_;
+    }
+
+private:
+    string_width::width_t width_;
+    unsigned state_ = 0;
+    char32_t buff_[BuffSize];
+};
+
+template <std::size_t BuffSize>
+class basic_std_width_decrementer_with_pos final
+    : public string_width::detail::static_destination
+        < char32_t, basic_std_width_decrementer_with_pos<BuffSize> >
+{
+    using base_ = string_width::detail::static_destination
+        < char32_t, basic_std_width_decrementer_with_pos<BuffSize> >;
+
+public:
+    basic_std_width_decrementer_with_pos (string_width::width_t initial_width) noexcept
+        : base_(buff_, BuffSize)
+        , width_{initial_width}
+    {
+        this->set_good(initial_width != 0);
+    }
+
+    void recycle() noexcept {
+        if (this->good()) {
+            auto res = detail::std_width_calc_func(buff_, this->pointer(), width_, state_, true);
+            width_ = res.width;
+            state_ = res.state;
+            codepoints_count_ += (res.ptr - buff_);
+            if (width_ == 0 && res.ptr != this->pointer()) {
+                this->set_good(false);
+            }
         }
-        state = after_hangul_l;
-        goto next_codepoint;
+        this->set_pointer(buff_);
     }
-    handle_hangul_v: {
-        constexpr state_t mask = ~after_hangul &
-            (after_hangul_l | after_hangul_v | after_hangul_lv);
-        if (state & mask) {
-            state = after_hangul_v;
-            goto next_codepoint;
+
+
+    void reset(string_width::width_t initial_width) noexcept {
+        width_ = initial_width;
+        state_ = 0;
+        codepoints_count_ = 0;
+        this->set_pointer(buff_);
+        this->set_good(initial_width != 0);
+    }
+
+    struct result {
+        string_width::width_t remaining_width;
+        bool whole_string_covered;
+        std::size_t codepoints_count;
+    };
+
+    result get_remaining_width_and_codepoints_count() noexcept {
+        if (! this->good()) {
+            return {0, false, codepoints_count_};
         }
-        if (state != after_prepend) {
-            state = after_hangul_v;
-            goto decrement_width;
+        auto res = detail::std_width_calc_func(buff_, this->pointer(), width_, state_, true);
+        width_ = res.width;
+        codepoints_count_ += (res.ptr - buff_);
+        bool whole_string_covered = (res.ptr == this->pointer());
+        return {width_, whole_string_covered, codepoints_count_};
+    }
+
+private:
+    string_width::width_t width_;
+    unsigned state_ = 0;
+    std::size_t codepoints_count_ = 0;
+    char32_t buff_[BuffSize];
+};
+
+using std_width_decrementer =
+    basic_std_width_decrementer<STRING_WIDTH_DECODE_BUFFER_SIZE>;
+using std_width_decrementer_with_pos =
+    basic_std_width_decrementer_with_pos<STRING_WIDTH_DECODE_BUFFER_SIZE>;
+
+template <typename CharT>
+struct width_calc_result {
+    string_width::width_t width;
+    unsigned state;
+    const CharT* ptr;
+};
+
+template <typename CharT>
+constexpr bool is_printable_ascii(CharT ch) noexcept
+{
+    return static_cast<std::uint32_t>(ch) - 0x20 < 0x5F;
+}
+
+template <typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20 std::size_t printable_ascii_run_length_generic
+    ( const CharT* begin
+    , const CharT* end ) noexcept
+{
+    auto it = begin;
+    while (it != end && string_width::detail::is_printable_ascii(*it)) {
+        ++it;
+    }
+    return static_cast<std::size_t>(it - begin);
+}
+
+template <typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20
+typename std::enable_if<sizeof(CharT) == 1, std::size_t>::type printable_ascii_run_length
+    ( const CharT* begin
+    , const CharT* end ) noexcept
+{
+#if defined(__cpp_lib_is_constant_evaluated)
+    if (std::is_constant_evaluated()) {
+        return string_width::detail::printable_ascii_run_length_generic(begin, end);
+    }
+#endif
+    return string_width::detail::printable_ascii_run_length
+        ( reinterpret_cast<const std::uint8_t*>(begin)
+        , reinterpret_cast<const std::uint8_t*>(end) );
+}
+
+template <typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20
+typename std::enable_if<sizeof(CharT) == 2, std::size_t>::type printable_ascii_run_length
+    ( const CharT* begin
+    , const CharT* end ) noexcept
+{
+#if defined(__cpp_lib_is_constant_evaluated)
+    if (std::is_constant_evaluated()) {
+        return string_width::detail::printable_ascii_run_length_generic(begin, end);
+    }
+#endif
+    return string_width::detail::printable_ascii_run_length
+        ( reinterpret_cast<const std::uint16_t*>(begin)
+        , reinterpret_cast<const std::uint16_t*>(end) );
+}
+
+template <typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20
+typename std::enable_if<sizeof(CharT) == 4, std::size_t>::type printable_ascii_run_length
+    ( const CharT* begin
+    , const CharT* end ) noexcept
+{
+    return string_width::detail::printable_ascii_run_length_generic(begin, end);
+}
+
+template <typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20 std::size_t wide_bmp_run_length_generic
+    ( const CharT* begin
+    , const CharT* end ) noexcept
+{
+    auto it = begin;
+    while (it != end && string_width::detail::is_wide_bmp(static_cast<std::uint32_t>(*it))) {
+        ++it;
+    }
+    return static_cast<std::size_t>(it - begin);
+}
+
+template <typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20
+typename std::enable_if<sizeof(CharT) == 2, std::size_t>::type wide_bmp_run_length
+    ( const CharT* begin
+    , const CharT* end ) noexcept
+{
+#if defined(__cpp_lib_is_constant_evaluated)
+    if (std::is_constant_evaluated()) {
+        return string_width::detail::wide_bmp_run_length_generic(begin, end);
+    }
+#endif
+    return string_width::detail::wide_bmp_run_length
+        ( reinterpret_cast<const std::uint16_t*>(begin)
+        , reinterpret_cast<const std::uint16_t*>(end) );
+}
+
+template <typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20
+typename std::enable_if<sizeof(CharT) != 2, std::size_t>::type wide_bmp_run_length
+    ( const CharT* begin
+    , const CharT* end ) noexcept
+{
+    return string_width::detail::wide_bmp_run_length_generic(begin, end);
+}
+
+// Equivalent to decoding [str, end) and passing the result to
+// std_width_calc_func, but classifies each codepoint directly from
+// the code units and returns the position in the original string.
+// In UTF-8, the sequences are classified without reconstructing
+// the codepoints.
+//
+// Like std_width_calc_func, when it stops before a grapheme cluster that
+// is wider than the remaining width, it returns zero as the remaining width,
+// unless ExactWidth is true.
+//
+// If AssumeValid is true, the string must be well-formed ( see is_well_formed ),
+// and the UTF-8 and UTF-16 sequences are not checked. `surr_poli` is then ignored.
+template < bool ReturnPos, bool ExactWidth = false
+         , string_width::width_profile Profile = string_width::width_profile::std_format
+         , bool AssumeValid = false
+         , typename CharT >
+STRING_WIDTH_CONSTEXPR_IN_CXX20 width_calc_result<CharT> std_width_calc
+    ( const CharT* str
+    , const CharT* end
+    , string_width::width_t width
+    , unsigned state
+    , string_width::surrogate_policy surr_poli ) noexcept
+{
+    using namespace string_width::detail::grapheme_state;
+
+    while (str != end) {
+        if (string_width::detail::is_printable_ascii(*str)) {
+            // run of printable ASCII characters: each one starts a new
+            // grapheme cluster, except the first one when it follows
+            // a prepend character.
+            std::size_t count = 1;
+            if (end - str > 1 && string_width::detail::is_printable_ascii(str[1])) {
+                count = string_width::detail::printable_ascii_run_length(str, end);
+            }
+            const std::size_t joined = (state == after_prepend);
+            const std::size_t clusters = count - joined;
+            const std::size_t available = width > 0 ? static_cast<std::size_t>(width) : 0;
+            STRING_WIDTH_PROBE(codepoints, count);
+            STRING_WIDTH_PROBE(bulk_codepoints, count);
+            STRING_WIDTH_PROBE(clusters, clusters);
+            state = after_core;
+            if (clusters < available || clusters == 0) {
+                width -= static_cast<string_width::width_t>(clusters);
+                str += count;
+                continue;
+            }
+            if (! ReturnPos) {
+                return {0, state, nullptr};
+            }
+            if (clusters == available) {
+                width = 0;
+                str += count;
+                continue;
+            }
+            return {0, state, str + joined + available};
         }
-        state = after_hangul_v;
-        goto next_codepoint;
+        if ( sizeof(CharT) == 2 && width > 2
+          && string_width::detail::is_wide_bmp(static_cast<std::uint32_t>(*str))
+          && state != after_prepend && state != after_hangul_l
+          && end - str > 1
+          && string_width::detail::is_wide_bmp(static_cast<std::uint32_t>(str[1])) ) {
+            // run of CJK ideographs and Hangul syllables: each one is a
+            // grapheme cluster of width 2, but the last one of the run is
+            // left to the code below, because what follows it may join it.
+            // The clusters are only counted here while the remaining width
+            // stays greater than 2, so that the code below handles the limit.
+            const std::size_t count = string_width::detail::wide_bmp_run_length(str, end);
+            std::size_t clusters = static_cast<std::size_t>(width - 1) / 2;
+            if (clusters > count - 1) {
+                clusters = count - 1;
+            }
+            width -= static_cast<string_width::width_t>(2 * clusters);
+            str += clusters;
+            state = after_core;
+            STRING_WIDTH_PROBE(codepoints, clusters);
+            STRING_WIDTH_PROBE(bulk_codepoints, clusters);
+            STRING_WIDTH_PROBE(clusters, clusters);
+            STRING_WIDTH_PROBE(wide_chars, clusters);
+            continue;
+        }
+        const CharT* const ch_begin = str;
+        bool invalid = false;
+        const std::uint8_t props = AssumeValid
+            ? string_width::detail::unchecked_next_props<Profile>(str)
+            : string_width::detail::next_props<Profile>(str, end, surr_poli, &invalid);
+        STRING_WIDTH_PROBE(codepoints, 1);
+        STRING_WIDTH_PROBE(invalid_sequences, invalid);
+        (void) invalid;
+        if (string_width::detail::gcb_step(state, props & prop::category_mask)) {
+            const string_width::width_t ch_width = (props & prop::double_width) ? 2 : 1;
+            STRING_WIDTH_PROBE(clusters, 1);
+            STRING_WIDTH_PROBE(wide_chars, ch_width - 1);
+            if (ch_width >= width) {
+                if (! ReturnPos) {
+                    return {0, state, nullptr};
+                }
+                if (ch_width > width) {
+                    return {ExactWidth ? width : 0, state, ch_begin};
+                }
+                width = 0;
+            } else {
+                width -= ch_width;
+            }
+        }
+    }
+    return {width, state, str};
+}
+
+template < string_width::width_profile Profile = string_width::width_profile::std_format
+         , bool AssumeValid = false, typename CharT >
+typename std::enable_if<! std::is_same<CharT, char32_t>::value, string_width::width_t>::type str_width
+    ( string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy surr_poli ) noexcept
+{
+    STRING_WIDTH_PROBE(bytes, str_len * sizeof(CharT));
+    auto res = string_width::detail::std_width_calc<false, false, Profile, AssumeValid>
+        (str, str + str_len, limit, grapheme_state::initial, surr_poli);
+    return limit - res.width;
+}
+
+template <std::size_t BuffSize, typename CharT>
+string_width::width_t str_width
+    ( string_width::detail::basic_std_width_decrementer<BuffSize>& decr
+    , string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy surr_poli ) noexcept
+{
+    STRING_WIDTH_PROBE(bytes, str_len * sizeof(CharT));
+    decr.reset(limit);
+    string_width::detail::decode(decr, str, str_len, surr_poli);
+    return (limit - decr.get_remaining_width());
+}
+
+// char32_t strings are passed to std_width_calc_func as they are, without
+// being copied. It handles the codepoints not less than 0x110000 as U+FFFD,
+// which is what decode replaces them with, so there is nothing to fix.
+// Other 4-byte code units ( like wchar_t ) can not be read as char32_t
+// without breaking the strict aliasing rule, so they go through
+// std_width_calc, like UTF-8 and UTF-16.
+template < string_width::width_profile Profile = string_width::width_profile::std_format
+         , bool AssumeValid = false, typename CharT >
+typename std::enable_if<std::is_same<CharT, char32_t>::value, string_width::width_t>::type str_width
+    ( string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy ) noexcept
+{
+    if (limit == 0) {
+        return 0;
+    }
+    STRING_WIDTH_PROBE(bytes, str_len * sizeof(CharT));
+    auto res = string_width::detail::profile_width_calc_func<Profile>::call
+        (str, str + str_len, limit, 0, false);
+    return limit - res.width;
+}
+
+template < string_width::width_profile Profile = string_width::width_profile::std_format
+         , bool AssumeValid = false, typename CharT >
+typename std::enable_if<! std::is_same<CharT, char32_t>::value, string_width::width_and_pos>::type str_width_and_pos
+    ( string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy surr_poli ) noexcept
+{
+    STRING_WIDTH_PROBE(bytes, str_len * sizeof(CharT));
+    auto res = string_width::detail::std_width_calc<true, false, Profile, AssumeValid>
+        (str, str + str_len, limit, grapheme_state::initial, surr_poli);
+    return {limit - res.width, static_cast<std::size_t>(res.ptr - str)};
+}
+
+template <std::size_t BuffSize, typename CharT>
+string_width::width_and_pos str_width_and_pos
+    ( string_width::detail::basic_std_width_decrementer_with_pos<BuffSize>& decr
+    , string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy surr_poli ) noexcept
+{
+    STRING_WIDTH_PROBE(bytes, str_len * sizeof(CharT));
+    decr.reset(limit);
+    string_width::detail::decode(decr, str, str_len, surr_poli);
+    auto res = decr.get_remaining_width_and_codepoints_count();
+
+    string_width::width_t width = limit - res.remaining_width;
+    if (res.whole_string_covered) {
+        return {width, str_len};
+    }
+    auto res2 = string_width::detail::count_codepoints
+        (str, str_len, res.codepoints_count, surr_poli);
+    return {width, res2.pos};
+}
+
+template < string_width::width_profile Profile = string_width::width_profile::std_format
+         , bool AssumeValid = false, typename CharT >
+typename std::enable_if<std::is_same<CharT, char32_t>::value, string_width::width_and_pos>::type str_width_and_pos
+    ( string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy ) noexcept
+{
+    if (limit == 0) {
+        return {0, 0};
+    }
+    STRING_WIDTH_PROBE(bytes, str_len * sizeof(CharT));
+    auto res = string_width::detail::profile_width_calc_func<Profile>::call
+        (str, str + str_len, limit, 0, true);
+    return {limit - res.width, static_cast<std::size_t>(res.ptr - str)};
+}
+
+// Returns the first position not before `p` where decode starts
+// a new codepoint.
+template <typename CharT>
+typename std::enable_if<sizeof(CharT) == 1, const CharT*>::type sync_to_codepoint
+    ( const CharT*, const CharT* p, const CharT* end ) noexcept
+{
+    // decode never takes a byte that is not a continuation byte
+    // as part of a previous sequence
+    while (p != end && string_width::detail::is_utf8_continuation(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+template <typename CharT>
+typename std::enable_if<sizeof(CharT) == 2, const CharT*>::type sync_to_codepoint
+    ( const CharT* begin, const CharT* p, const CharT* end ) noexcept
+{
+    if ( p != begin && p != end
+      && string_width::detail::is_low_surrogate(*p)
+      && string_width::detail::is_high_surrogate(p[-1]) ) {
+        ++p;
+    }
+    return p;
+}
+
+template <typename CharT>
+typename std::enable_if<sizeof(CharT) == 4, const CharT*>::type sync_to_codepoint
+    ( const CharT*, const CharT* p, const CharT* ) noexcept
+{
+    return p;
+}
+
+// Searches in [p, scan_end) the first codepoint that surely starts a
+// grapheme cluster, whatever the state before it, and after which
+// the state does not depend on anything that comes before it. So the
+// string can be split there and each part be measured separately,
+// starting with the initial state. `p` must be at the start of a codepoint.
+// Returns `end` if no such codepoint is found.
+template <typename CharT>
+const CharT* find_split_point
+    ( const CharT* p
+    , const CharT* scan_end
+    , const CharT* end
+    , string_width::surrogate_policy surr_poli ) noexcept
+{
+    if (p == end) {
+        return end;
     }
-    handle_hangul_t: {
-        constexpr state_t mask = ~after_hangul &
-            (after_hangul_v | after_hangul_lv | after_hangul_lvt | after_hangul_t);
-        if (state & mask) {
-            state = after_hangul_t;
-            goto next_codepoint;
+    auto prev = string_width::detail::next_props(p, end, surr_poli) & prop::category_mask;
+    while (p < scan_end) {
+        const CharT* const ch_begin = p;
+        const auto cat = string_width::detail::next_props(p, end, surr_poli) & prop::category_mask;
+        if ( cat == prop::control || cat == prop::cr
+          || (cat == prop::other && prev != prop::prepend)
+          || (cat == prop::lf && prev != prop::cr) ) {
+            return ch_begin;
         }
-        if (state != after_prepend) {
-            state = after_hangul_t;
-            goto decrement_width;
-        }
-        state = after_hangul_t;
-        goto next_codepoint;
+        prev = cat;
     }
-    handle_hangul_lv_or_lvt:
-    if ( ch <= 0xD788 // && 0xAC00 <= ch
-         && 0 == (ch & 3)
-         && 0 == ((ch - 0xAC00) >> 2) % 7)
-    {   // LV
-        if (state == after_hangul_l) {
-            state = after_hangul_lv;
-            goto next_codepoint;
-        }
-        if (state != after_prepend) {
-            state = after_hangul_lv;
-            goto decrement_width;
-        }
-        state = after_hangul_lv;
-        goto next_codepoint;
+    return end;
+}
 
-    } else { // LVT
-        if (state == after_hangul_l) {
-            state = after_hangul_lvt;
-            goto next_codepoint;
+// If the string ends with a sequence that is incomplete but that
+// could still become valid, returns its length. Otherwise returns zero.
+template <typename CharT>
+typename std::enable_if<sizeof(CharT) == 1, std::size_t>::type incomplete_tail_length
+    ( const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy surr_poli ) noexcept
+{
+    const std::size_t max_tail = str_len < 3 ? str_len : 3;
+    for (std::size_t tail = 1; tail <= max_tail; ++tail) {
+        const std::uint8_t ch0 = str[str_len - tail];
+        if (string_width::detail::is_utf8_continuation(ch0)) {
+            continue;
         }
-        if (state != after_prepend) {
-            state = after_hangul_lvt;
-            goto decrement_width;
+        std::size_t seq_len = ( ch0 >= 0xC2 && ch0 <= 0xDF ? 2
+                              : (ch0 & 0xF0) == 0xE0 ? 3
+                              : ch0 >= 0xF0 && ch0 <= 0xF4 ? 4 : 0 );
+        if (tail >= seq_len) {
+            return 0;
         }
-        state = after_hangul_lvt;
-        goto next_codepoint;
+        if (tail >= 2) {
+            const std::uint8_t ch1 = str[str_len - tail + 1];
+            const bool valid = ( seq_len == 3
+                               ? ( (ch0 != 0xE0 || ch1 >= 0xA0)
+                                 && string_width::detail::first_2_of_3_are_valid(ch0, ch1, surr_poli) )
+                               : seq_len == 4
+                               ? string_width::detail::first_2_of_4_are_valid(ch0, ch1)
+                               : true );
+            if (! valid) {
+                return 0;
+            }
+        }
+        return tail;
     }
+    return 0;
+}
 
-    handle_cr:
-    state = after_cr;
-    goto decrement_width;
+template <typename CharT>
+typename std::enable_if<sizeof(CharT) == 2, std::size_t>::type incomplete_tail_length
+    ( const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy ) noexcept
+{
+    return str_len != 0 && string_width::detail::is_high_surrogate(str[str_len - 1]);
+}
 
-    handle_lf:
-    if (state == after_cr) {
-        state = initial;
-        goto next_codepoint;
-    }
-    handle_control:
-    state = initial;
-    goto decrement_width;
+template <typename CharT>
+typename std::enable_if<sizeof(CharT) == 4, std::size_t>::type incomplete_tail_length
+    ( const CharT*
+    , std::size_t
+    , string_width::surrogate_policy ) noexcept
+{
+    return 0;
 }
 
-#else
+} // namespace detail
 
-std_width_calc_func_return std_width_calc_func
-    ( const char32_t* begin
-    , const char32_t* end
-    , string_width::width_t width
-    , unsigned state
-    , bool return_pos ) noexcept;
+// In C++20, str_width and str_width_and_pos can be evaluated at compile
+// time. In this case, UTF-32 is handled by std_width_calc instead of
+// std_width_calc_func, like UTF-8 and UTF-16 always are.
+//
+// The width_profile is a template parameter, so that each profile has its
+// own code, and there is no runtime branch: str_width<width_profile::wcwidth>(...)
 
-#endif // ! defined(STRING_WIDTH_OMIT_IMPL)
+template <string_width::width_profile Profile = string_width::width_profile::std_format, typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20 string_width::width_t str_width
+    ( string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict ) noexcept
+{
+#if defined(__cpp_lib_is_constant_evaluated)
+    if (std::is_constant_evaluated()) {
+        auto res = string_width::detail::std_width_calc<false, false, Profile>
+            (str, str + str_len, limit, string_width::detail::grapheme_state::initial, surr_poli);
+        return limit - res.width;
+    }
+#endif
+    return string_width::detail::str_width<Profile>(limit, str, str_len, surr_poli);
+}
 
-#if defined(__GNUC__) && (__GNUC__ >= 11)
-#  pragma GCC diagnostic push
-#  pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+template <string_width::width_profile Profile = string_width::width_profile::std_format, typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20 string_width::width_and_pos str_width_and_pos
+    ( string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict ) noexcept
+{
+#if defined(__cpp_lib_is_constant_evaluated)
+    if (std::is_constant_evaluated()) {
+        auto res = string_width::detail::std_width_calc<true, false, Profile>
+            (str, str + str_len, limit, string_width::detail::grapheme_state::initial, surr_poli);
+        return {limit - res.width, static_cast<std::size_t>(res.ptr - str)};
+    }
 #endif
+    return string_width::detail::str_width_and_pos<Profile>(limit, str, str_len, surr_poli);
+}
 
+// Overloads for strings that are known to be well-formed. There are no
+// invalid surrogates in them, hence there is no surrogate_policy parameter.
+// During constant evaluation, the string is checked anyway.
 
-class std_width_decrementer: public string_width::detail::destination<char32_t> {
-public:
-    std_width_decrementer (string_width::width_t initial_width) noexcept
-        : string_width::detail::destination<char32_t>(buff_, buff_size_)
-        , width_{initial_width}
-    {
-        this->set_good(initial_width != 0);
+template <string_width::width_profile Profile = string_width::width_profile::std_format, typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20 string_width::width_t str_width
+    ( string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::validation_policy valid_poli ) noexcept
+{
+#if defined(__cpp_lib_is_constant_evaluated)
+    if (std::is_constant_evaluated()) {
+        valid_poli = string_width::validation_policy::check;
+    }
+#endif
+    if (valid_poli == string_width::validation_policy::check) {
+        return string_width::str_width<Profile>(limit, str, str_len);
     }
+    STRING_WIDTH_ASSERT(string_width::detail::is_well_formed(str, str + str_len));
+    return string_width::detail::str_width<Profile, true>
+        (limit, str, str_len, string_width::surrogate_policy::strict);
+}
 
-    void recycle() noexcept override {
-        if (this->good()) {
-            auto res = detail::std_width_calc_func(buff_, this->pointer(), width_, state_, false);
-            width_ = res.width;
-            state_ = res.state;
-            if (width_ == 0) {
-                this->set_good(false);
+template <string_width::width_profile Profile = string_width::width_profile::std_format, typename CharT>
+STRING_WIDTH_CONSTEXPR_IN_CXX20 string_width::width_and_pos str_width_and_pos
+    ( string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::validation_policy valid_poli ) noexcept
+{
+#if defined(__cpp_lib_is_constant_evaluated)
+    if (std::is_constant_evaluated()) {
+        valid_poli = string_width::validation_policy::check;
+    }
+#endif
+    if (valid_poli == string_width::validation_policy::check) {
+        return string_width::str_width_and_pos<Profile>(limit, str, str_len);
+    }
+    STRING_WIDTH_ASSERT(string_width::detail::is_well_formed(str, str + str_len));
+    return string_width::detail::str_width_and_pos<Profile, true>
+        (limit, str, str_len, string_width::surrogate_policy::strict);
+}
+
+// Returns the number of codepoints in `str`. Like in str_width, each
+// invalid sequence counts as the U+FFFD that it is replaced by, and
+// surr_poli tells whether surrogates are invalid.
+template <typename CharT>
+std::size_t count_codepoints
+    ( const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict ) noexcept
+{
+    return string_width::detail::count_codepoints(str, str_len, std::size_t(-1), surr_poli).count;
+}
+
+// Returns the position in `str` where the codepoint of index `n` starts,
+// which is the length of its first `n` codepoints, or `str_len` if there
+// are not more than `n` codepoints. The codepoints are counted like in
+// count_codepoints.
+template <typename CharT>
+std::size_t codepoint_pos
+    ( const CharT* str
+    , std::size_t str_len
+    , std::size_t n
+    , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict ) noexcept
+{
+    return string_width::detail::count_codepoints(str, str_len, n, surr_poli).pos;
+}
+
+// Returns a value `r` such that `r.pos` is the position of the start of
+// the longest suffix of `str` that is made of whole grapheme clusters and
+// whose width is not greater than `limit`, and `r.width` is the width of
+// such suffix. It scans the string backwards, so that the time it takes
+// is proportional to the length of the suffix, not of the whole string.
+template <typename CharT>
+string_width::width_and_pos str_tail_width_and_pos
+    ( string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict ) noexcept
+{
+    if (limit <= 0) {
+        return {0, str_len};
+    }
+    // The string is split, from the end, into segments that start at
+    // codepoints that always begin a grapheme cluster. So each segment
+    // can be segmented forwards, starting with the initial state.
+    const CharT* seg_end = str + str_len;
+    string_width::width_t taken = 0;
+    std::size_t window = 64;
+    while (seg_end != str) {
+        const CharT* seg_begin = str;
+        while (static_cast<std::size_t>(seg_end - str) > window) {
+            const CharT* p = string_width::detail::sync_to_codepoint(str, seg_end - window, seg_end);
+            p = string_width::detail::find_split_point(p, seg_end, seg_end, surr_poli);
+            if (p != seg_end) {
+                seg_begin = p;
+                break;
             }
+            window *= 2;
         }
-        this->set_pointer(buff_);
+        const auto seg_width = string_width::detail::str_width
+            (static_cast<string_width::width_t>(~0u >> 1), seg_begin, seg_end - seg_begin, surr_poli);
+        const auto available = limit - taken;
+        if (seg_width <= available) {
+            taken += seg_width;
+            seg_end = seg_begin;
+            continue;
+        }
+        // The suffix begins inside this segment, at the first cluster
+        // such that the width of the clusters before it is at least `skip`
+        const auto skip = seg_width - available;
+        unsigned state = string_width::detail::grapheme_state::initial;
+        string_width::width_t width_before = 0;
+        for (const CharT* it = seg_begin; it != seg_end; ) {
+            const CharT* const ch_begin = it;
+            auto props = string_width::detail::next_props(it, seg_end, surr_poli);
+            if (string_width::detail::gcb_step(state, props & detail::prop::category_mask)) {
+                if (width_before >= skip) {
+                    return { taken + seg_width - width_before
+                           , static_cast<std::size_t>(ch_begin - str) };
+                }
+                width_before += (props & detail::prop::double_width) ? 2 : 1;
+            }
+        }
+        return {taken, static_cast<std::size_t>(seg_end - str)};
     }
+    return {taken, 0};
+}
 
-    string_width::width_t get_remaining_width()  noexcept {
-        if (width_ != 0 && this->pointer() != buff_) {
-            auto res = detail::std_width_calc_func(buff_, this->pointer(), width_, state_, false);
-            return res.width;
+struct truncation_result {
+    string_width::width_t width;
+    std::size_t size;
+    bool truncated;
+};
+
+namespace detail {
+
+// Returns the width of the result of str_truncate, and the length of
+// the prefix of `str` that it contains.
+template <typename CharT>
+string_width::truncation_result truncation_point
+    ( string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::width_t ellipsis_width
+    , string_width::surrogate_policy surr_poli ) noexcept
+{
+    using string_width::detail::std_width_calc;
+
+    const CharT* const end = str + str_len;
+    if (limit < 0) {
+        limit = 0;
+    }
+    const bool use_ellipsis = ellipsis_width <= limit;
+    const auto prefix_limit = use_ellipsis ? limit - ellipsis_width : limit;
+    auto res = std_width_calc<true, true>
+        (str, end, prefix_limit, string_width::detail::grapheme_state::initial, surr_poli);
+    string_width::truncation_result result = {prefix_limit - res.width, str_len, false};
+    if (res.ptr != end) {
+        // It does not fit into prefix_limit. But it may still fit
+        // into limit if there is no need of the ellipsis. Since res.ptr
+        // is at the beginning of a grapheme cluster, the measure of the
+        // rest can start from the initial state.
+        auto res2 = use_ellipsis
+            ? std_width_calc<true, true>
+                ( res.ptr, end, limit - result.width
+                , string_width::detail::grapheme_state::initial, surr_poli )
+            : res;
+        if (res2.ptr == end) {
+            result.width = limit - res2.width;
+        } else {
+            result.size = static_cast<std::size_t>(res.ptr - str);
+            result.truncated = true;
+            if (use_ellipsis) {
+                result.width += ellipsis_width;
+            }
         }
-        return width_;
     }
+    return result;
+}
 
-private:
-    string_width::width_t width_;
-    unsigned state_ = 0;
-    static constexpr std::size_t buff_size_ = 16;
-    char32_t buff_[buff_size_];
-};
+} // namespace detail
+
+// If the width of `str` is not greater than `limit`, copies `str` into `dest`.
+// Otherwise, copies into `dest` the longest prefix of `str` that is made of
+// whole grapheme clusters and whose width is not greater than `limit` minus
+// the width of `ellipsis`, followed by `ellipsis`. If `ellipsis` is
+// wider than `limit`, it is not written, and the prefix fits `limit`.
+//
+// Returns the width and the size of the result. If such size is greater
+// than `dest_size`, nothing is written.
+template <typename CharT>
+string_width::truncation_result str_truncate
+    ( string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , CharT* dest
+    , std::size_t dest_size
+    , const CharT* ellipsis
+    , std::size_t ellipsis_len
+    , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict ) noexcept
+{
+    const auto ellipsis_width = string_width::detail::str_width
+        (static_cast<string_width::width_t>(~0u >> 1), ellipsis, ellipsis_len, surr_poli);
+    auto result = string_width::detail::truncation_point
+        (limit, str, str_len, ellipsis_width, surr_poli);
+    const std::size_t prefix_len = result.size;
+    const bool write_ellipsis = result.truncated && ellipsis_width <= limit;
+    if (write_ellipsis) {
+        result.size += ellipsis_len;
+    }
+    if (result.size <= dest_size) {
+        for (std::size_t i = 0; i < prefix_len; ++i) {
+            dest[i] = str[i];
+        }
+        if (write_ellipsis) {
+            for (std::size_t i = 0; i < ellipsis_len; ++i) {
+                dest[prefix_len + i] = ellipsis[i];
+            }
+        }
+    }
+    return result;
+}
 
-class std_width_decrementer_with_pos: public string_width::detail::destination<char32_t> {
+// Measures a string that is received in pieces. After feeding all of them,
+// finish() returns the same as str_width_and_pos would return for the
+// concatenation of all pieces, where `pos` is a position in such
+// concatenation. A sequence split between two pieces is joined before
+// being decoded.
+template <typename CharT>
+class str_width_stream {
 public:
-    std_width_decrementer_with_pos (string_width::width_t initial_width) noexcept
-        : string_width::detail::destination<char32_t>(buff_, buff_size_)
-        , width_{initial_width}
+    explicit str_width_stream
+        ( string_width::width_t limit
+        , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict ) noexcept
+        : limit_(limit)
+        , width_(limit)
+        , surr_poli_(surr_poli)
     {
-        this->set_good(initial_width != 0);
     }
 
-    void recycle() noexcept override {
-        if (this->good()) {
-            auto res = detail::std_width_calc_func(buff_, this->pointer(), width_, state_, true);
-            width_ = res.width;
-            state_ = res.state;
-            codepoints_count_ += (res.ptr - buff_);
-            if (width_ == 0 && res.ptr != this->pointer()) {
-                this->set_good(false);
+    void feed(const CharT* str, std::size_t str_len) noexcept
+    {
+        if (done_) {
+            return;
+        }
+        if (pending_len_ != 0) {
+            // complete the pending sequence with the first code units
+            const std::size_t old_pending_len = pending_len_;
+            while (pending_len_ < max_pending_ + 1 && str_len != 0) {
+                pending_[pending_len_++] = *str++;
+                --str_len;
+            }
+            const auto incomplete_len = string_width::detail::incomplete_tail_length
+                (pending_, pending_len_, surr_poli_);
+            if (incomplete_len == pending_len_) {
+                return; // still incomplete
+            }
+            const CharT* it = pending_;
+            (void) string_width::detail::next_props(it, pending_ + pending_len_, surr_poli_);
+            const auto seq_len = static_cast<std::size_t>(it - pending_);
+            process_(pending_, it);
+            // return to str the code units that were not part of the sequence
+            const auto returned = pending_len_ - seq_len;
+            str -= returned;
+            str_len += returned;
+            pending_len_ = 0;
+            STRING_WIDTH_ASSERT(seq_len >= old_pending_len);
+            (void) old_pending_len;
+            if (done_) {
+                return;
             }
         }
-        this->set_pointer(buff_);
+        auto tail = string_width::detail::incomplete_tail_length(str, str_len, surr_poli_);
+        STRING_WIDTH_ASSERT(tail <= max_pending_);
+        if (tail > max_pending_) {
+            tail = max_pending_; // can not happen, but makes the bound of pending_ visible
+        }
+        process_(str, str + (str_len - tail));
+        if (! done_) {
+            for (std::size_t i = 0; i < tail; ++i) {
+                pending_[i] = str[str_len - tail + i];
+            }
+            pending_len_ = tail;
+        }
     }
 
-    struct result {
-        string_width::width_t remaining_width;
-        bool whole_string_covered;
-        std::size_t codepoints_count;
-    };
+    // Returns true if the limit has been reached, and
+    // so feeding more input can not change the result
+    bool limit_reached() const noexcept
+    {
+        return done_;
+    }
 
-    result get_remaining_width_and_codepoints_count() noexcept {
-        if (! this->good()) {
-            return {0, false, codepoints_count_};
+    string_width::width_and_pos finish() noexcept
+    {
+        if (pending_len_ != 0 && ! done_) {
+            // the last sequence is incomplete and hence invalid
+            process_(pending_, pending_ + pending_len_);
         }
-        auto res = detail::std_width_calc_func(buff_, this->pointer(), width_, state_, true);
-        width_ = res.width;
-        codepoints_count_ += (res.ptr - buff_);
-        bool whole_string_covered = (res.ptr == this->pointer());
-        return {width_, whole_string_covered, codepoints_count_};
+        pending_len_ = 0;
+        return {limit_ - width_, pos_};
     }
 
 private:
+
+    void process_(const CharT* begin, const CharT* end) noexcept
+    {
+        auto res = string_width::detail::std_width_calc<true>
+            (begin, end, width_, state_, surr_poli_);
+        width_ = res.width;
+        state_ = res.state;
+        pos_ += static_cast<std::size_t>(res.ptr - begin);
+        done_ = (res.ptr != end);
+    }
+
+    static constexpr std::size_t max_pending_ = sizeof(CharT) == 1 ? 3 : 1;
+
+    string_width::width_t limit_;
     string_width::width_t width_;
-    unsigned state_ = 0;
-    std::size_t codepoints_count_ = 0;
-    static constexpr std::size_t buff_size_ = 16;
-    char32_t buff_[buff_size_];
+    unsigned state_ = string_width::detail::grapheme_state::initial;
+    std::size_t pos_ = 0;
+    CharT pending_[max_pending_ + 1];
+    std::size_t pending_len_ = 0;
+    string_width::surrogate_policy surr_poli_;
+    bool done_ = false;
 };
 
-} // namespace detail
+template <typename CharT>
+struct width_query {
+    const CharT* str;
+    std::size_t str_len;
+    string_width::width_t limit;
+};
 
+// widths[i] = str_width(queries[i].limit, queries[i].str, queries[i].str_len)
 template <typename CharT>
-string_width::width_t str_width
-    ( string_width::width_t limit
-    , const CharT* str
-    , std::size_t str_len
+void str_width_batch
+    ( const string_width::width_query<CharT>* queries
+    , std::size_t count
+    , string_width::width_t* widths
     , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict ) noexcept
 {
-    detail::std_width_decrementer decr{limit};
-    detail::decode(decr, str, str_len, surr_poli);
-    return (limit - decr.get_remaining_width());
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto& q = queries[i];
+        widths[i] = string_width::detail::str_width(q.limit, q.str, q.str_len, surr_poli);
+    }
 }
 
-struct width_and_pos {
+// Same as str_width_batch, but also writes into positions[i] the pos
+// returned by str_width_and_pos.
+template <typename CharT>
+void str_width_and_pos_batch
+    ( const string_width::width_query<CharT>* queries
+    , std::size_t count
+    , string_width::width_t* widths
+    , std::size_t* positions
+    , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict ) noexcept
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto& q = queries[i];
+        auto res = string_width::detail::str_width_and_pos(q.limit, q.str, q.str_len, surr_poli);
+        widths[i] = res.width;
+        positions[i] = res.pos;
+    }
+}
+
+struct max_width_result {
     string_width::width_t width;
-    std::size_t pos;
+    std::size_t index;
 };
 
+// Returns the greatest str_width(min(queries[i].limit, cap), ...) and the
+// index of the first query that has it. Stops as soon as one of them
+// reaches cap. If count is zero, returns {0, 0}.
 template <typename CharT>
-string_width::width_and_pos str_width_and_pos
-    ( string_width::width_t limit
-    , const CharT* str
-    , std::size_t str_len
+string_width::max_width_result max_str_width
+    ( const string_width::width_query<CharT>* queries
+    , std::size_t count
+    , string_width::width_t cap
     , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict ) noexcept
 {
-    string_width::detail::std_width_decrementer_with_pos decr{limit};
-    string_width::detail::decode(decr, str, str_len, surr_poli);
-    auto res = decr.get_remaining_width_and_codepoints_count();
-
-    string_width::width_t width = limit - res.remaining_width;
-    if (res.whole_string_covered) {
-        return {width, str_len};
+    string_width::max_width_result result{0, 0};
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto& q = queries[i];
+        const auto limit = q.limit < cap ? q.limit : cap;
+        const auto w = string_width::detail::str_width(limit, q.str, q.str_len, surr_poli);
+        if (i == 0 || w > result.width) {
+            result = {w, i};
+            if (w >= cap) {
+                break;
+            }
+        }
     }
-    auto res2 = string_width::detail::count_codepoints
-        (str, str_len, res.codepoints_count, surr_poli);
-    return {width, res2.pos};
+    return result;
 }
 
 } // namespace string_width
 
 #undef STRING_WIDTH_ASSERT
 #undef STRING_WIDTH_CHECK_DEST
+#undef STRING_WIDTH_CONSTEXPR_IN_CXX20
 #undef STRING_WIDTH_CHECK_DEST_SIZE
 #undef STRING_WIDTH_FUNC_IMPL
 #undef STRING_WIDTH_IF_LIKELY
 #undef STRING_WIDTH_IF_UNLIKELY
 #undef STRING_WIDTH_OMIT_IMPL
+#undef STRING_WIDTH_PROBE
 #undef STRING_WIDTH_SEPARATE_COMPILATION
+#undef STRING_WIDTH_TARGET_AVX2
+#undef STRING_WIDTH_TARGET_AVX512
+#undef STRING_WIDTH_X86_SIMD
 
 #endif // STRING_WIDTH_HPP
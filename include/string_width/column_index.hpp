@@ -0,0 +1,175 @@
+#ifndef STRING_WIDTH_COLUMN_INDEX_HPP
+#define STRING_WIDTH_COLUMN_INDEX_HPP
+
+//  Copyright (C) (See commit logs on github.com/robhz786/strf)
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <algorithm>
+#include <vector>
+
+namespace string_width {
+
+// Allows to find the position at a given column, or the column at a given
+// position, of a long string without measuring it from the beginning.
+//
+// In one pass over the string, the constructor saves the position, the
+// width so far and the grapheme cluster segmentation state at the start
+// of every `interval`-th grapheme cluster. Each query starts from the
+// closest of these samples, so it takes O(log(n) + interval) time, while
+// the memory used is proportional to n / interval.
+//
+// The index refers to the string; it does not copy it.
+template <typename CharT>
+class column_index {
+public:
+
+    column_index
+        ( const CharT* str
+        , std::size_t str_len
+        , std::size_t interval = 64
+        , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict )
+        : str_(str)
+        , str_len_(str_len)
+        , surr_poli_(surr_poli)
+    {
+        build_(interval ? interval : 1);
+    }
+
+    // The width of the whole string
+    string_width::width_t width() const noexcept
+    {
+        return width_;
+    }
+
+    std::size_t samples_count() const noexcept
+    {
+        return samples_.size();
+    }
+
+    // Returns the same as str_width_and_pos(column, str, str_len, surr_poli)
+    string_width::width_and_pos offset_at_column(string_width::width_t column) const noexcept
+    {
+        if (column <= 0) {
+            return string_width::detail::str_width_and_pos(column, str_, str_len_, surr_poli_);
+        }
+        // the last sample before `column`. The first one has width 0.
+        auto it = std::lower_bound
+            ( samples_.begin(), samples_.end(), column
+            , [](const sample_& s, string_width::width_t c) { return s.width < c; } );
+        --it;
+        auto res = string_width::detail::std_width_calc<true>
+            (str_ + it->offset, str_ + str_len_, column - it->width, it->state, surr_poli_);
+        return {column - res.width, static_cast<std::size_t>(res.ptr - str_)};
+    }
+
+    // Returns the column where the grapheme cluster that contains the code
+    // unit at `offset` begins, i.e. the total width of the grapheme clusters
+    // that end at or before `offset`.
+    string_width::width_t column_at_offset(std::size_t offset) const noexcept
+    {
+        if (offset >= str_len_) {
+            return width_;
+        }
+        // the last sample at or before `offset`. The first one is at 0.
+        auto it = std::upper_bound
+            ( samples_.begin(), samples_.end(), offset
+            , [](std::size_t off, const sample_& s) { return off < s.offset; } );
+        --it;
+        if (it->offset == offset) {
+            return it->width;
+        }
+        const CharT* const end = str_ + str_len_;
+        const CharT* const target = str_ + offset;
+        const CharT* ptr = str_ + it->offset;
+        auto width = it->width;
+        auto state = it->state;
+        string_width::width_t last_cluster_width = 0;
+        while (ptr != end) {
+            const CharT* const ch_begin = ptr;
+            auto props = string_width::detail::next_props(ptr, end, surr_poli_);
+            if (string_width::detail::gcb_step(state, props & detail::prop::category_mask)) {
+                if (ch_begin >= target) {
+                    return ch_begin == target ? width : width - last_cluster_width;
+                }
+                last_cluster_width = (props & detail::prop::double_width) ? 2 : 1;
+                width += last_cluster_width;
+            }
+        }
+        return width - last_cluster_width;
+    }
+
+private:
+
+    struct sample_ {
+        std::size_t offset;
+        string_width::width_t width;
+        unsigned state;
+    };
+
+    void build_(std::size_t interval)
+    {
+        using namespace string_width::detail::grapheme_state;
+
+        samples_.reserve(str_len_ / interval / 2 + 1);
+        samples_.push_back({0, 0, initial});
+
+        const CharT* const end = str_ + str_len_;
+        const CharT* ptr = str_;
+        string_width::width_t width = 0;
+        unsigned state = initial;
+        std::size_t clusters_count = 0;
+        while (ptr != end) {
+            if (string_width::detail::is_printable_ascii(*ptr)) {
+                // each one starts a grapheme cluster of width 1,
+                // except the first one when it follows a prepend character.
+                std::size_t count = 1;
+                if (end - ptr > 1 && string_width::detail::is_printable_ascii(ptr[1])) {
+                    count = string_width::detail::printable_ascii_run_length(ptr, end);
+                }
+                const std::size_t joined = (state == after_prepend);
+                const std::size_t clusters = count - joined;
+                const std::size_t offset = static_cast<std::size_t>(ptr - str_) + joined;
+                const auto rem = clusters_count % interval;
+                for (std::size_t i = rem ? interval - rem : 0; i < clusters; i += interval) {
+                    if (clusters_count + i != 0) {
+                        const auto state_before = (i == 0 && ! joined) ? state : after_core;
+                        samples_.push_back
+                            ( { offset + i
+                              , width + static_cast<string_width::width_t>(i)
+                              , state_before } );
+                    }
+                }
+                clusters_count += clusters;
+                width += static_cast<string_width::width_t>(clusters);
+                state = after_core;
+                ptr += count;
+                continue;
+            }
+            const CharT* const ch_begin = ptr;
+            const auto state_before = state;
+            auto props = string_width::detail::next_props(ptr, end, surr_poli_);
+            if (string_width::detail::gcb_step(state, props & detail::prop::category_mask)) {
+                if (clusters_count % interval == 0 && clusters_count != 0) {
+                    samples_.push_back
+                        ({static_cast<std::size_t>(ch_begin - str_), width, state_before});
+                }
+                ++clusters_count;
+                width += (props & detail::prop::double_width) ? 2 : 1;
+            }
+        }
+        width_ = width;
+    }
+
+    const CharT* str_;
+    std::size_t str_len_;
+    string_width::surrogate_policy surr_poli_;
+    string_width::width_t width_ = 0;
+    std::vector<sample_> samples_;
+};
+
+} // namespace string_width
+
+#endif // STRING_WIDTH_COLUMN_INDEX_HPP
@@ -0,0 +1,167 @@
+#ifndef STRING_WIDTH_GRAPHEME_CLUSTERS_HPP
+#define STRING_WIDTH_GRAPHEME_CLUSTERS_HPP
+
+//  Copyright (C) (See commit logs on github.com/robhz786/strf)
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <iterator>
+
+namespace string_width {
+
+template <typename CharT>
+struct grapheme_cluster {
+    const CharT* begin;
+    const CharT* end;
+    string_width::width_t width; // 1 or 2
+};
+
+// Forward iterator over the grapheme clusters of a string, segmented
+// the same way as in str_width. It does not allocate nor copy the string.
+template <typename CharT>
+class grapheme_cluster_iterator {
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = string_width::grapheme_cluster<CharT>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    // creates an iterator that is equal to the end iterator
+    grapheme_cluster_iterator() noexcept
+        : cluster_{nullptr, nullptr, 0}
+        , str_end_(nullptr)
+        , next_first_end_(nullptr)
+    {
+    }
+
+    grapheme_cluster_iterator
+        ( const CharT* str
+        , const CharT* str_end
+        , string_width::surrogate_policy surr_poli ) noexcept
+        : cluster_{str, str, 0}
+        , str_end_(str_end)
+        , next_first_end_(str)
+        , surr_poli_(surr_poli)
+    {
+        if (str != str_end) {
+            // the first codepoint always starts a grapheme cluster
+            auto props = string_width::detail::next_props(next_first_end_, str_end_, surr_poli_);
+            (void) string_width::detail::gcb_step(state_, props & detail::prop::category_mask);
+            next_width_ = (props & detail::prop::double_width) ? 2 : 1;
+            advance_();
+        }
+    }
+
+    reference operator*() const noexcept
+    {
+        return cluster_;
+    }
+    pointer operator->() const noexcept
+    {
+        return &cluster_;
+    }
+    grapheme_cluster_iterator& operator++() noexcept
+    {
+        advance_();
+        return *this;
+    }
+    grapheme_cluster_iterator operator++(int) noexcept
+    {
+        auto copy = *this;
+        advance_();
+        return copy;
+    }
+
+    // Iterators are compared by position. The end iterator
+    // is equal to any iterator that has passed the last cluster.
+    friend bool operator==
+        ( const grapheme_cluster_iterator& lhs
+        , const grapheme_cluster_iterator& rhs ) noexcept
+    {
+        return lhs.cluster_.begin == rhs.cluster_.begin
+            || (lhs.at_end_() && rhs.at_end_());
+    }
+    friend bool operator!=
+        ( const grapheme_cluster_iterator& lhs
+        , const grapheme_cluster_iterator& rhs ) noexcept
+    {
+        return ! (lhs == rhs);
+    }
+
+private:
+
+    bool at_end_() const noexcept
+    {
+        return cluster_.begin == str_end_;
+    }
+
+    void advance_() noexcept
+    {
+        // The first codepoint of the next cluster has already been read
+        // ( in order to find where the current one ends ).
+        cluster_.begin = cluster_.end;
+        if (cluster_.begin == str_end_) {
+            cluster_.width = 0;
+            return;
+        }
+        cluster_.width = next_width_;
+        const CharT* it = next_first_end_;
+        while (it != str_end_) {
+            const CharT* const ch_begin = it;
+            auto props = string_width::detail::next_props(it, str_end_, surr_poli_);
+            if (string_width::detail::gcb_step(state_, props & detail::prop::category_mask)) {
+                cluster_.end = ch_begin;
+                next_first_end_ = it;
+                next_width_ = (props & detail::prop::double_width) ? 2 : 1;
+                return;
+            }
+        }
+        cluster_.end = str_end_;
+        next_first_end_ = str_end_;
+    }
+
+    value_type cluster_;
+    const CharT* str_end_;
+    const CharT* next_first_end_;
+    string_width::width_t next_width_ = 0;
+    unsigned state_ = string_width::detail::grapheme_state::initial;
+    string_width::surrogate_policy surr_poli_ = string_width::surrogate_policy::strict;
+};
+
+template <typename CharT>
+class grapheme_clusters {
+public:
+    using iterator = string_width::grapheme_cluster_iterator<CharT>;
+    using const_iterator = iterator;
+
+    grapheme_clusters
+        ( const CharT* str
+        , std::size_t str_len
+        , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict ) noexcept
+        : str_(str)
+        , str_len_(str_len)
+        , surr_poli_(surr_poli)
+    {
+    }
+
+    iterator begin() const noexcept
+    {
+        return {str_, str_ + str_len_, surr_poli_};
+    }
+    iterator end() const noexcept
+    {
+        return {};
+    }
+
+private:
+    const CharT* str_;
+    std::size_t str_len_;
+    string_width::surrogate_policy surr_poli_;
+};
+
+} // namespace string_width
+
+#endif // STRING_WIDTH_GRAPHEME_CLUSTERS_HPP
@@ -0,0 +1,291 @@
+#ifndef STRING_WIDTH_INSTRUMENTATION_HPP
+#define STRING_WIDTH_INSTRUMENTATION_HPP
+
+//  Copyright (C) (See commit logs on github.com/robhz786/strf)
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <cstdio>
+
+// Per call site statistics, for when STRING_WIDTH_INSTRUMENTATION is
+// defined. A call site is a scope marked with STRING_WIDTH_INSTRUMENT:
+//
+//     string_width::width_t column_width(const std::string& s)
+//     {
+//         STRING_WIDTH_INSTRUMENT("column_width");
+//         return string_width::str_width(1 << 20, s.data(), s.size());
+//     }
+//
+// Each time the scope is left, what the probes of the library counted
+// in the meantime, in the current thread, is added to the call site,
+// and so is the time taken, to a histogram of latencies. dump() prints
+// all call sites.
+//
+// When STRING_WIDTH_INSTRUMENTATION is not defined, STRING_WIDTH_INSTRUMENT
+// expands to nothing, and dump() prints nothing.
+
+#if defined(STRING_WIDTH_INSTRUMENTATION)
+
+#include <atomic>
+#include <chrono>
+
+namespace string_width {
+namespace instrumentation {
+
+constexpr std::size_t latency_buckets_count = 64;
+
+// Bucket `i` counts the calls that took less than 2^(i+1) nanoseconds,
+// and, except bucket zero, not less than 2^i. Recording is a relaxed
+// atomic increment, so it can be done by any number of threads.
+class latency_histogram {
+public:
+
+    latency_histogram() noexcept
+    {
+        for (auto& b: buckets_) {
+            b.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    latency_histogram(const latency_histogram&) = delete;
+    latency_histogram& operator=(const latency_histogram&) = delete;
+
+    static std::size_t bucket_of(std::uint64_t ns) noexcept
+    {
+        std::size_t i = 0;
+        while (ns > 1) {
+            ns >>= 1;
+            ++i;
+        }
+        return i;
+    }
+
+    void record(std::uint64_t ns) noexcept
+    {
+        buckets_[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::uint64_t bucket(std::size_t i) const noexcept
+    {
+        return buckets_[i].load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t count() const noexcept
+    {
+        std::uint64_t n = 0;
+        for (auto& b: buckets_) {
+            n += b.load(std::memory_order_relaxed);
+        }
+        return n;
+    }
+
+    // The upper bound, in nanoseconds, of the bucket where the fraction
+    // `p` of the calls is reached. Zero if nothing was recorded.
+    std::uint64_t percentile(double p) const noexcept
+    {
+        std::uint64_t counts[latency_buckets_count];
+        std::uint64_t total = 0;
+        for (std::size_t i = 0; i < latency_buckets_count; ++i) {
+            counts[i] = buckets_[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        if (total == 0) {
+            return 0;
+        }
+        const double target = p * static_cast<double>(total);
+        std::uint64_t sum = 0;
+        std::size_t i = 0;
+        for (; i + 1 < latency_buckets_count; ++i) {
+            sum += counts[i];
+            if (sum != 0 && static_cast<double>(sum) >= target) {
+                break;
+            }
+        }
+        return i + 1 < latency_buckets_count ? std::uint64_t(2) << i : UINT64_MAX;
+    }
+
+private:
+
+    std::atomic<std::uint64_t> buckets_[latency_buckets_count];
+};
+
+// A call site registers itself, when constructed, in a lock-free list
+// that dump() goes through. Hence it must not be destroyed before the
+// last call of dump(): it is meant to be a static variable, which is what
+// STRING_WIDTH_INSTRUMENT declares.
+class call_site {
+public:
+
+    explicit call_site(const char* name) noexcept
+        : name_(name)
+    {
+        calls_.store(0, std::memory_order_relaxed);
+        for (auto& t: totals_) {
+            t.store(0, std::memory_order_relaxed);
+        }
+        call_site* head = head_().load(std::memory_order_relaxed);
+        do {
+            next_ = head;
+        } while (! head_().compare_exchange_weak
+                     (head, this, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    call_site(const call_site&) = delete;
+    call_site& operator=(const call_site&) = delete;
+
+    void add(const string_width::instrumentation::counters& delta, std::uint64_t ns) noexcept
+    {
+        calls_.fetch_add(1, std::memory_order_relaxed);
+        totals_[0].fetch_add(delta.bytes, std::memory_order_relaxed);
+        totals_[1].fetch_add(delta.codepoints, std::memory_order_relaxed);
+        totals_[2].fetch_add(delta.clusters, std::memory_order_relaxed);
+        totals_[3].fetch_add(delta.invalid_sequences, std::memory_order_relaxed);
+        totals_[4].fetch_add(delta.wide_chars, std::memory_order_relaxed);
+        totals_[5].fetch_add(delta.bulk_codepoints, std::memory_order_relaxed);
+        latencies_.record(ns);
+    }
+
+    const char* name() const noexcept
+    {
+        return name_;
+    }
+
+    std::uint64_t calls() const noexcept
+    {
+        return calls_.load(std::memory_order_relaxed);
+    }
+
+    string_width::instrumentation::counters totals() const noexcept
+    {
+        return { totals_[0].load(std::memory_order_relaxed)
+               , totals_[1].load(std::memory_order_relaxed)
+               , totals_[2].load(std::memory_order_relaxed)
+               , totals_[3].load(std::memory_order_relaxed)
+               , totals_[4].load(std::memory_order_relaxed)
+               , totals_[5].load(std::memory_order_relaxed) };
+    }
+
+    const string_width::instrumentation::latency_histogram& latencies() const noexcept
+    {
+        return latencies_;
+    }
+
+    // The most recently registered call site comes first
+    static const call_site* first() noexcept
+    {
+        return head_().load(std::memory_order_acquire);
+    }
+
+    const call_site* next() const noexcept
+    {
+        return next_;
+    }
+
+private:
+
+    static std::atomic<call_site*>& head_() noexcept
+    {
+        static std::atomic<call_site*> head{nullptr};
+        return head;
+    }
+
+    const char* name_;
+    call_site* next_ = nullptr;
+    std::atomic<std::uint64_t> calls_;
+    std::atomic<std::uint64_t> totals_[6];
+    string_width::instrumentation::latency_histogram latencies_;
+};
+
+// Adds to `site` what happens in the current thread between its
+// construction and its destruction. Scopes can be nested: the outer
+// one also gets what is counted in the inner one.
+class call_scope {
+public:
+
+    explicit call_scope(string_width::instrumentation::call_site& site) noexcept
+        : site_(site)
+        , start_counters_(string_width::instrumentation::thread_counters())
+        , start_time_(std::chrono::steady_clock::now())
+    {
+    }
+
+    call_scope(const call_scope&) = delete;
+    call_scope& operator=(const call_scope&) = delete;
+
+    ~call_scope()
+    {
+        const auto end_time = std::chrono::steady_clock::now();
+        const auto& c = string_width::instrumentation::thread_counters();
+        const string_width::instrumentation::counters delta =
+            { c.bytes - start_counters_.bytes
+            , c.codepoints - start_counters_.codepoints
+            , c.clusters - start_counters_.clusters
+            , c.invalid_sequences - start_counters_.invalid_sequences
+            , c.wide_chars - start_counters_.wide_chars
+            , c.bulk_codepoints - start_counters_.bulk_codepoints };
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>
+            (end_time - start_time_).count();
+        site_.add(delta, static_cast<std::uint64_t>(ns));
+    }
+
+private:
+
+    string_width::instrumentation::call_site& site_;
+    const string_width::instrumentation::counters start_counters_;
+    const std::chrono::steady_clock::time_point start_time_;
+};
+
+inline void dump(std::FILE* out = stderr)
+{
+    using ull = unsigned long long;
+    for (auto site = call_site::first(); site != nullptr; site = site->next()) {
+        const auto t = site->totals();
+        const auto& lat = site->latencies();
+        std::fprintf( out, "%s: %llu calls, %llu bytes, %llu codepoints, %llu clusters, "
+                      "%llu invalid sequences, %llu wide chars, %llu bulk codepoints\n"
+                    , site->name(), (ull)site->calls(), (ull)t.bytes, (ull)t.codepoints
+                    , (ull)t.clusters, (ull)t.invalid_sequences, (ull)t.wide_chars
+                    , (ull)t.bulk_codepoints );
+        if (site->calls() == 0) {
+            continue;
+        }
+        std::fprintf( out, "  latency: p50 < %llu ns, p90 < %llu ns, p99 < %llu ns\n"
+                    , (ull)lat.percentile(0.5), (ull)lat.percentile(0.9)
+                    , (ull)lat.percentile(0.99) );
+        for (std::size_t i = 0; i < latency_buckets_count; ++i) {
+            const auto n = lat.bucket(i);
+            if (n != 0) {
+                std::fprintf( out, "  [%llu, %llu) ns: %llu\n"
+                            , (ull)(i == 0 ? 0 : std::uint64_t(1) << i)
+                            , (ull)(i + 1 < latency_buckets_count ? std::uint64_t(2) << i : UINT64_MAX), (ull)n );
+            }
+        }
+    }
+}
+
+} // namespace instrumentation
+} // namespace string_width
+
+#define STRING_WIDTH_INSTRUMENT(NAME)                                             \
+    static string_width::instrumentation::call_site string_width_call_site_(NAME); \
+    string_width::instrumentation::call_scope string_width_call_scope_(string_width_call_site_)
+
+#else // defined(STRING_WIDTH_INSTRUMENTATION)
+
+namespace string_width {
+namespace instrumentation {
+
+inline void dump(std::FILE* = stderr)
+{
+}
+
+} // namespace instrumentation
+} // namespace string_width
+
+#define STRING_WIDTH_INSTRUMENT(NAME)
+
+#endif // defined(STRING_WIDTH_INSTRUMENTATION)
+
+#endif // STRING_WIDTH_INSTRUMENTATION_HPP
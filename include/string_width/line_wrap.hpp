@@ -0,0 +1,166 @@
+#ifndef STRING_WIDTH_LINE_WRAP_HPP
+#define STRING_WIDTH_LINE_WRAP_HPP
+
+//  Copyright (C) (See commit logs on github.com/robhz786/strf)
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width/grapheme_clusters.hpp>
+#include <utility>
+
+namespace string_width {
+
+template <typename CharT>
+struct line_span {
+    const CharT* begin;
+    const CharT* end;
+    string_width::width_t width;
+};
+
+namespace detail {
+
+template <typename CharT>
+inline bool is_wrap_space(const string_width::grapheme_cluster<CharT>& c) noexcept
+{
+    return c.end - c.begin == 1 && (*c.begin == ' ' || *c.begin == '\t');
+}
+
+template <typename CharT>
+inline bool is_line_break(const string_width::grapheme_cluster<CharT>& c) noexcept
+{
+    // CR, LF and CR LF always form grapheme clusters on their own
+    return *c.begin == '\r' || *c.begin == '\n';
+}
+
+} // namespace detail
+
+// Splits `str` into lines whose width is not greater than `max_width`,
+// calling `func(const line_span<CharT>&)` for each one, in order.
+//
+// Lines are broken before a word that follows a space or a tab. A word
+// that does not fit into an empty line is broken between grapheme clusters
+// ( or after its first cluster, if that alone is wider than `max_width` ).
+// The spaces and tabs at the end of a line are not included in its span
+// nor in its width, and the ones at which a line is broken are skipped.
+// The ones at the beginning of the string or after a hard break are kept
+// as indentation ( and broken like a word if they don't fit ).
+//
+// If `hard_breaks` is true, CR, LF and CR LF end the current line and are
+// not included in any span. Otherwise, they are handled like spaces, and
+// so may appear inside a span, except at its beginning.
+// An empty string has no lines, and a hard break at the end of the
+// string does not start a new one.
+//
+// It takes a single pass over the string and does not allocate memory.
+template <typename CharT, typename Func>
+auto wrap_lines
+    ( string_width::width_t max_width
+    , const CharT* str
+    , std::size_t str_len
+    , Func&& func
+    , bool hard_breaks = true
+    , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict )
+    -> decltype(func(std::declval<const string_width::line_span<CharT>&>()), void())
+{
+    const CharT* const str_end = str + str_len;
+    const CharT* line_begin = str;
+    string_width::width_t line_width = 0;    // including trailing spaces
+
+    // the line without the trailing spaces
+    const CharT* content_end = str;
+    string_width::width_t content_width = 0;
+
+    bool has_word = false;       // whether the line has something besides indentation
+    bool after_space = false;
+
+    // where the line can be broken, if the current word does not fit
+    const CharT* break_begin = nullptr;           // the beginning of the current word
+    const CharT* break_content_end = nullptr;
+    string_width::width_t break_content_width = 0;
+    string_width::width_t break_line_width = 0;
+
+    for (auto& c: string_width::grapheme_clusters<CharT>(str, str_len, surr_poli)) {
+        if (hard_breaks && string_width::detail::is_line_break(c)) {
+            func(string_width::line_span<CharT>{line_begin, content_end, content_width});
+            line_begin = content_end = c.end;
+            line_width = content_width = 0;
+            has_word = after_space = false;
+            break_begin = nullptr;
+            continue;
+        }
+        const bool is_space = string_width::detail::is_wrap_space(c);
+        if (is_space || string_width::detail::is_line_break(c)) {
+            if (has_word) {
+                line_width += c.width;
+                after_space = true;
+                continue;
+            }
+            if (! is_space) {
+                // a line break ( not handled as a hard one ) discards the
+                // indentation, as if the line started after it
+                line_begin = content_end = c.end;
+                line_width = content_width = 0;
+                continue;
+            }
+            // indentation: it is kept, and it is broken like a word
+        }
+        if (after_space) {
+            after_space = false;
+            break_begin = c.begin;
+            break_content_end = content_end;
+            break_content_width = content_width;
+            break_line_width = line_width;
+        }
+        if (line_width + c.width > max_width) {
+            if (break_begin != nullptr) {
+                func(string_width::line_span<CharT>
+                     {line_begin, break_content_end, break_content_width});
+                line_begin = break_begin;
+                line_width -= break_line_width;
+                break_begin = nullptr;
+            } else if (c.begin != line_begin) {
+                func(string_width::line_span<CharT>{line_begin, content_end, content_width});
+                line_begin = c.begin;
+                line_width = 0;
+            }
+        }
+        has_word = has_word || ! is_space;
+        line_width += c.width;
+        content_end = c.end;
+        content_width = line_width;
+    }
+    if (line_begin != str_end) {
+        func(string_width::line_span<CharT>{line_begin, content_end, content_width});
+    }
+}
+
+// Same as the overload above, but writes the lines into `lines`, up to
+// `lines_capacity` of them. Returns the total number of lines, which
+// may be greater than `lines_capacity`.
+template <typename CharT>
+std::size_t wrap_lines
+    ( string_width::width_t max_width
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::line_span<CharT>* lines
+    , std::size_t lines_capacity
+    , bool hard_breaks = true
+    , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict )
+{
+    std::size_t count = 0;
+    string_width::wrap_lines
+        ( max_width, str, str_len
+        , [&](const string_width::line_span<CharT>& line) {
+              if (count < lines_capacity) {
+                  lines[count] = line;
+              }
+              ++count;
+          }
+        , hard_breaks, surr_poli );
+    return count;
+}
+
+} // namespace string_width
+
+#endif // STRING_WIDTH_LINE_WRAP_HPP
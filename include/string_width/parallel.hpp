@@ -0,0 +1,359 @@
+#ifndef STRING_WIDTH_PARALLEL_HPP
+#define STRING_WIDTH_PARALLEL_HPP
+
+//  Copyright (C) (See commit logs on github.com/robhz786/strf)
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace string_width {
+
+// Threads that wait for work to do, so that measuring a string in parallel
+// does not start and join threads each time. They are stopped and joined
+// when the pool is destroyed.
+class worker_pool {
+public:
+
+    // Starts `threads_count` threads. If zero, as many as
+    // std::thread::hardware_concurrency() minus one, since the thread
+    // that calls run also takes part. If a thread can not be created,
+    // the pool has fewer threads.
+    explicit worker_pool(unsigned threads_count = 0)
+    {
+        if (threads_count == 0) {
+            const unsigned hw = std::thread::hardware_concurrency();
+            threads_count = hw > 1 ? hw - 1 : 0;
+        }
+        threads_.reserve(threads_count);
+        try {
+            for (unsigned i = 0; i < threads_count; ++i) {
+                threads_.emplace_back([this]{ work_(); });
+            }
+        } catch (...) {
+            // could not create more threads
+        }
+    }
+
+    worker_pool(const worker_pool&) = delete;
+    worker_pool& operator=(const worker_pool&) = delete;
+
+    ~worker_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stop_ = true;
+        }
+        work_cv_.notify_all();
+        for (auto& t: threads_) {
+            t.join();
+        }
+    }
+
+    // The number of threads of the pool, not counting the one that calls run
+    unsigned size() const noexcept
+    {
+        return static_cast<unsigned>(threads_.size());
+    }
+
+    // Calls func(i) for each i in [0, count), in the threads of the pool
+    // and in the calling one, and returns when all the calls have returned.
+    // func must not throw. Calls from different threads are serialized.
+    template <typename Func>
+    void run(std::size_t count, Func func)
+    {
+        std::lock_guard<std::mutex> run_lock(run_mtx_);
+        std::unique_lock<std::mutex> lock(mtx_);
+        task_ = &func;
+        invoke_ = [](void* f, std::size_t i) { (*static_cast<Func*>(f))(i); };
+        next_ = 0;
+        count_ = count;
+        pending_ = count;
+        ++generation_;
+        work_cv_.notify_all();
+        take_tasks_(lock);
+        done_cv_.wait(lock, [this]{ return pending_ == 0; });
+        task_ = nullptr;
+    }
+
+private:
+
+    void work_()
+    {
+        std::uint64_t seen_generation = 0;
+        std::unique_lock<std::mutex> lock(mtx_);
+        for (;;) {
+            work_cv_.wait(lock, [&]{ return stop_ || generation_ != seen_generation; });
+            if (stop_) {
+                return;
+            }
+            seen_generation = generation_;
+            take_tasks_(lock);
+        }
+    }
+
+    void take_tasks_(std::unique_lock<std::mutex>& lock)
+    {
+        while (next_ < count_) {
+            const std::size_t i = next_++;
+            lock.unlock();
+            invoke_(task_, i);
+            lock.lock();
+            if (--pending_ == 0) {
+                done_cv_.notify_all();
+            }
+        }
+    }
+
+    std::mutex run_mtx_;
+    std::mutex mtx_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    void* task_ = nullptr;
+    void (*invoke_)(void*, std::size_t) = nullptr;
+    std::size_t next_ = 0;
+    std::size_t count_ = 0;
+    std::size_t pending_ = 0;
+    std::uint64_t generation_ = 0;
+    bool stop_ = false;
+    std::vector<std::thread> threads_;
+};
+
+namespace detail {
+
+// Splits [str, str + str_len) into at most `max_parts` parts of
+// similar size. Returns the boundaries, including both ends.
+template <typename CharT>
+std::vector<const CharT*> split_for_parallel_measure
+    ( const CharT* str
+    , std::size_t str_len
+    , std::size_t max_parts
+    , string_width::surrogate_policy surr_poli )
+{
+    const CharT* const end = str + str_len;
+    std::vector<const CharT*> points;
+    points.reserve(max_parts + 1);
+    points.push_back(str);
+    for (std::size_t i = 1; i < max_parts; ++i) {
+        const CharT* p = str + str_len * i / max_parts;
+        const CharT* const scan_end = str + str_len * (i + 1) / max_parts;
+        if (p <= points.back()) {
+            continue;
+        }
+        p = string_width::detail::sync_to_codepoint(str, p, end);
+        p = string_width::detail::find_split_point(p, scan_end, end, surr_poli);
+        if (p != end) {
+            points.push_back(p);
+        }
+    }
+    points.push_back(end);
+    return points;
+}
+
+// Calls func(i) for each i in [0, count), each one in a different thread
+template <typename Func>
+void run_in_parallel(std::size_t count, Func func)
+{
+    std::vector<std::thread> threads;
+    threads.reserve(count);
+    std::size_t i = 1;
+    try {
+        for (; i < count; ++i) {
+            threads.emplace_back(func, i);
+        }
+    } catch (...) {
+        // could not create more threads
+        for (; i < count; ++i) {
+            func(i);
+        }
+    }
+    func(0);
+    for (auto& t: threads) {
+        t.join();
+    }
+}
+
+// Runs the tasks in new threads, which are joined before returning
+struct thread_per_task_runner {
+    template <typename Func>
+    void run(std::size_t count, Func func) const
+    {
+        string_width::detail::run_in_parallel(count, func);
+    }
+};
+
+template <typename Runner, typename CharT>
+std::vector<string_width::width_t> measure_parts
+    ( Runner& runner
+    , const std::vector<const CharT*>& points
+    , string_width::width_t limit
+    , string_width::surrogate_policy surr_poli )
+{
+    const std::size_t parts_count = points.size() - 1;
+    std::vector<string_width::width_t> widths(parts_count);
+    runner.run(parts_count, [&](std::size_t i) {
+        const auto len = static_cast<std::size_t>(points[i + 1] - points[i]);
+        widths[i] = string_width::detail::str_width(limit, points[i], len, surr_poli);
+    });
+    return widths;
+}
+
+inline std::size_t parallel_parts_count
+    ( std::size_t str_len
+    , unsigned threads_count
+    , std::size_t min_part_len ) noexcept
+{
+    if (threads_count == 0) {
+        threads_count = std::thread::hardware_concurrency();
+    }
+    const std::size_t max_parts = str_len / (min_part_len ? min_part_len : 1);
+    return max_parts < threads_count ? max_parts : threads_count;
+}
+
+template <typename Runner, typename CharT>
+string_width::width_t parallel_str_width
+    ( Runner& runner
+    , std::size_t parts_count
+    , string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy surr_poli )
+{
+    if (limit <= 0 || parts_count < 2) {
+        return string_width::detail::str_width(limit, str, str_len, surr_poli);
+    }
+    const auto points = string_width::detail::split_for_parallel_measure
+        (str, str_len, parts_count, surr_poli);
+    const auto widths = string_width::detail::measure_parts(runner, points, limit, surr_poli);
+
+    // The width of each part is at most limit, so the sum does not overflow
+    string_width::width_t total = 0;
+    for (auto w: widths) {
+        if (w >= limit - total) {
+            return limit;
+        }
+        total += w;
+    }
+    return total;
+}
+
+template <typename Runner, typename CharT>
+string_width::width_and_pos parallel_str_width_and_pos
+    ( Runner& runner
+    , std::size_t parts_count
+    , string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy surr_poli )
+{
+    if (limit <= 0 || parts_count < 2) {
+        return string_width::detail::str_width_and_pos(limit, str, str_len, surr_poli);
+    }
+    const auto points = string_width::detail::split_for_parallel_measure
+        (str, str_len, parts_count, surr_poli);
+    const auto widths = string_width::detail::measure_parts(runner, points, limit, surr_poli);
+
+    string_width::width_t total = 0;
+    for (std::size_t i = 0; i < widths.size(); ++i) {
+        if (widths[i] >= limit - total) {
+            // The limit is reached inside this part. Since the next part
+            // starts with a grapheme cluster that is not zero-width, the
+            // position where str_width_and_pos stops is inside this part
+            // or at its end.
+            const auto len = static_cast<std::size_t>(points[i + 1] - points[i]);
+            const auto res = string_width::detail::str_width_and_pos
+                (limit - total, points[i], len, surr_poli);
+            return { total + res.width
+                   , static_cast<std::size_t>(points[i] - str) + res.pos };
+        }
+        total += widths[i];
+    }
+    return {total, str_len};
+}
+
+} // namespace detail
+
+// Same as str_width, but splits large strings into parts that are measured
+// in parallel. The result is always equal to the one of str_width.
+//
+// `threads_count` is the maximum number of threads used ( including the
+// calling one ). If zero, std::thread::hardware_concurrency() is used.
+// `min_part_len` is the minimum number of code units per thread.
+// The threads are created and joined in each call: to avoid that,
+// use the overload that takes a worker_pool.
+template <typename CharT>
+string_width::width_t parallel_str_width
+    ( string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict
+    , unsigned threads_count = 0
+    , std::size_t min_part_len = 1 << 18 )
+{
+    const auto parts_count = string_width::detail::parallel_parts_count
+        (str_len, threads_count, min_part_len);
+    string_width::detail::thread_per_task_runner runner;
+    return string_width::detail::parallel_str_width
+        (runner, parts_count, limit, str, str_len, surr_poli);
+}
+
+// Same as above, but measures the parts in the threads of `pool` and in
+// the calling one.
+template <typename CharT>
+string_width::width_t parallel_str_width
+    ( string_width::worker_pool& pool
+    , string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict
+    , std::size_t min_part_len = 1 << 18 )
+{
+    const auto parts_count = string_width::detail::parallel_parts_count
+        (str_len, pool.size() + 1, min_part_len);
+    return string_width::detail::parallel_str_width
+        (pool, parts_count, limit, str, str_len, surr_poli);
+}
+
+// Same as str_width_and_pos, but splits large strings into parts that are
+// measured in parallel. The result is always equal to the one of
+// str_width_and_pos. The last two parameters have the same meaning as in
+// parallel_str_width.
+template <typename CharT>
+string_width::width_and_pos parallel_str_width_and_pos
+    ( string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict
+    , unsigned threads_count = 0
+    , std::size_t min_part_len = 1 << 18 )
+{
+    const auto parts_count = string_width::detail::parallel_parts_count
+        (str_len, threads_count, min_part_len);
+    string_width::detail::thread_per_task_runner runner;
+    return string_width::detail::parallel_str_width_and_pos
+        (runner, parts_count, limit, str, str_len, surr_poli);
+}
+
+template <typename CharT>
+string_width::width_and_pos parallel_str_width_and_pos
+    ( string_width::worker_pool& pool
+    , string_width::width_t limit
+    , const CharT* str
+    , std::size_t str_len
+    , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict
+    , std::size_t min_part_len = 1 << 18 )
+{
+    const auto parts_count = string_width::detail::parallel_parts_count
+        (str_len, pool.size() + 1, min_part_len);
+    return string_width::detail::parallel_str_width_and_pos
+        (pool, parts_count, limit, str, str_len, surr_poli);
+}
+
+} // namespace string_width
+
+#endif // STRING_WIDTH_PARALLEL_HPP
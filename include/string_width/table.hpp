@@ -0,0 +1,197 @@
+#ifndef STRING_WIDTH_TABLE_HPP
+#define STRING_WIDTH_TABLE_HPP
+
+//  Copyright (C) (See commit logs on github.com/robhz786/strf)
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <vector>
+
+namespace string_width {
+
+enum class table_align { left, right, center };
+
+// Lays out text in aligned columns.
+//
+// Each cell is measured only once, when it is added: its width and, if it
+// is wider than the maximum width of its column, the position where it is
+// cut are saved in a single array owned by the table. The column widths are
+// updated at the same time, so that write() only needs to emit the cells
+// and the padding.
+//
+// The table refers to the strings of the cells and of the ellipsis and
+// the separator; it does not copy them.
+template <typename CharT>
+class table_layout {
+public:
+
+    explicit table_layout
+        ( std::size_t columns_count
+        , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict )
+        : columns_(columns_count)
+        , surr_poli_(surr_poli)
+    {
+    }
+
+    // The following functions affect how the cells are measured, so
+    // they must be called before adding any cell.
+
+    void set_column
+        ( std::size_t column
+        , string_width::width_t max_width
+        , string_width::table_align align = string_width::table_align::left ) noexcept
+    {
+        columns_[column].max_width = max_width < 0 ? 0 : max_width;
+        columns_[column].align = align;
+    }
+
+    // Written at the end of the cells that are cut. Empty by default.
+    void set_ellipsis(const CharT* ellipsis, std::size_t ellipsis_len) noexcept
+    {
+        ellipsis_ = ellipsis;
+        ellipsis_len_ = ellipsis_len;
+        ellipsis_width_ = string_width::str_width
+            (max_width_, ellipsis, ellipsis_len, surr_poli_);
+    }
+
+    // Written between the columns. A single space by default.
+    void set_separator(const CharT* separator, std::size_t separator_len) noexcept
+    {
+        separator_ = separator;
+        separator_len_ = separator_len;
+    }
+
+    void reserve_rows(std::size_t rows_count)
+    {
+        cells_.reserve(rows_count * columns_.size());
+    }
+
+    // Adds a cell to the current row, starting a new row after the last column.
+    void add_cell(const CharT* str, std::size_t str_len)
+    {
+        auto& col = columns_[cells_.size() % columns_.size()];
+        const auto res = string_width::detail::truncation_point
+            (col.max_width, str, str_len, ellipsis_width_, surr_poli_);
+        cells_.push_back({str, res.size, res.width, res.truncated});
+        if (res.width > col.width) {
+            col.width = res.width;
+        }
+    }
+
+    // Adds the cells of a row. `cells` and `cells_lengths` must have
+    // one element per column.
+    void add_row(const CharT* const* cells, const std::size_t* cells_lengths)
+    {
+        for (std::size_t i = 0; i < columns_.size(); ++i) {
+            add_cell(cells[i], cells_lengths[i]);
+        }
+    }
+
+    std::size_t columns_count() const noexcept
+    {
+        return columns_.size();
+    }
+    std::size_t rows_count() const noexcept
+    {
+        return (cells_.size() + columns_.size() - 1) / columns_.size();
+    }
+    string_width::width_t column_width(std::size_t column) const noexcept
+    {
+        return columns_[column].width;
+    }
+
+    // Writes the table by calling `sink(const CharT* str, std::size_t len)`
+    // for each piece of it. Each row ends with a line feed. No padding is
+    // written after the last column when it is left-aligned. An incomplete
+    // last row is written as if the missing cells were empty.
+    template <typename Sink>
+    void write(Sink&& sink) const
+    {
+        const std::size_t cols = columns_.size();
+        const std::size_t rows = rows_count();
+        const CharT newline = '\n';
+        for (std::size_t r = 0; r < rows; ++r) {
+            for (std::size_t c = 0; c < cols; ++c) {
+                const auto& col = columns_[c];
+                const std::size_t index = r * cols + c;
+                const cell_ empty = {nullptr, 0, 0, false};
+                const cell_& cell = index < cells_.size() ? cells_[index] : empty;
+                const bool last = c + 1 == cols;
+                if (c != 0) {
+                    sink(separator_, separator_len_);
+                }
+                const auto padding = col.width - cell.width;
+                string_width::width_t left = 0;
+                if (col.align == string_width::table_align::right) {
+                    left = padding;
+                } else if (col.align == string_width::table_align::center) {
+                    left = padding / 2;
+                }
+                write_fill_(sink, left);
+                if (cell.len != 0) {
+                    sink(cell.str, cell.len);
+                }
+                if (cell.truncated && ellipsis_width_ <= col.max_width && ellipsis_len_ != 0) {
+                    sink(ellipsis_, ellipsis_len_);
+                }
+                if (! (last && col.align == string_width::table_align::left)) {
+                    write_fill_(sink, padding - left);
+                }
+            }
+            sink(&newline, 1);
+        }
+    }
+
+private:
+
+    template <typename Sink>
+    static void write_fill_(Sink& sink, string_width::width_t count)
+    {
+        static const CharT spaces[] =
+            { ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ' };
+        const string_width::width_t spaces_count = sizeof(spaces) / sizeof(spaces[0]);
+        for (; count > spaces_count; count -= spaces_count) {
+            sink(spaces, static_cast<std::size_t>(spaces_count));
+        }
+        if (count > 0) {
+            sink(spaces, static_cast<std::size_t>(count));
+        }
+    }
+
+    static constexpr string_width::width_t max_width_
+        = static_cast<string_width::width_t>(~0u >> 1);
+
+    struct column_ {
+        string_width::width_t max_width = max_width_;
+        string_width::width_t width = 0;
+        string_width::table_align align = string_width::table_align::left;
+    };
+
+    struct cell_ {
+        const CharT* str;
+        std::size_t len;    // the length of the part that is written
+        string_width::width_t width;
+        bool truncated;
+    };
+
+    std::vector<column_> columns_;
+    std::vector<cell_> cells_;
+    const CharT* ellipsis_ = nullptr;
+    std::size_t ellipsis_len_ = 0;
+    string_width::width_t ellipsis_width_ = 0;
+    const CharT* separator_ = separator_default_();
+    std::size_t separator_len_ = 1;
+    string_width::surrogate_policy surr_poli_;
+
+    static const CharT* separator_default_() noexcept
+    {
+        static const CharT space = ' ';
+        return &space;
+    }
+};
+
+} // namespace string_width
+
+#endif // STRING_WIDTH_TABLE_HPP
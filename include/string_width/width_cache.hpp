@@ -0,0 +1,293 @@
+#ifndef STRING_WIDTH_WIDTH_CACHE_HPP
+#define STRING_WIDTH_WIDTH_CACHE_HPP
+
+//  Copyright (C) (See commit logs on github.com/robhz786/strf)
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+namespace string_width {
+
+struct width_cache_stats {
+    std::uint64_t hits;
+    std::uint64_t misses;
+    std::uint64_t evictions;
+    std::uint64_t bypassed;   // calls that did not use the cache
+};
+
+namespace detail {
+
+constexpr std::size_t width_cache_key_words = 6;
+
+// One entry of width_cache, guarded by a sequence lock: `seq` is odd
+// while the entry is being written. All members are atomic so that
+// readers can access them while a writer modifies them; a reader only
+// accepts what it read if `seq` has not changed meanwhile.
+struct width_cache_entry {
+    std::atomic<std::uint64_t> seq;
+    std::atomic<std::uint64_t> hash;     // zero when empty
+    std::atomic<std::uint64_t> meta;     // limit, key size and surrogate policy
+    std::atomic<std::uint64_t> result;   // width and pos
+    std::atomic<std::uint64_t> key[width_cache_key_words];
+};
+
+constexpr std::size_t width_cache_ways = 4;
+
+// padded to the size of a cache line
+struct width_cache_counters {
+    std::atomic<std::uint64_t> hits{0};
+    std::atomic<std::uint64_t> misses{0};
+    std::atomic<std::uint64_t> evictions{0};
+    std::atomic<std::uint64_t> bypassed{0};
+    char padding[64 - 4 * sizeof(std::atomic<std::uint64_t>)];
+};
+
+constexpr std::size_t width_cache_counters_count = 64;
+
+// Each thread uses its own set of counters ( unless there are more
+// threads than sets ), so that counting does not make the threads
+// contend for the same cache line.
+inline std::size_t width_cache_thread_slot() noexcept
+{
+    static std::atomic<std::size_t> next{0};
+    static thread_local const std::size_t slot =
+        next.fetch_add(1, std::memory_order_relaxed) % width_cache_counters_count;
+    return slot;
+}
+
+inline std::uint64_t width_cache_hash
+    ( const std::uint64_t* words
+    , std::size_t words_count
+    , std::uint64_t meta ) noexcept
+{
+    std::uint64_t h = meta * 0x9E3779B97F4A7C15ull;
+    for (std::size_t i = 0; i < words_count; ++i) {
+        h = (h ^ words[i]) * 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 31;
+    }
+    h ^= h >> 29;
+    h *= 0x94D049BB133111EBull;
+    h ^= h >> 32;
+    return h ? h : 1;
+}
+
+} // namespace detail
+
+// A memoizing layer in front of str_width and str_width_and_pos, for
+// programs that measure the same short strings many times. It can be used
+// concurrently by any number of threads.
+//
+// The results are kept in a fixed-size table, split into `shards_count`
+// shards, whose size is derived from `memory_budget` ( in bytes ). An
+// entry is found by the hash of the string, the limit and the surrogate
+// policy, and it also holds the string itself, so that collisions are
+// detected. Each string maps to a set of four entries; when all of them
+// are used, one is replaced.
+//
+// Reading and writing are lock-free: each entry is guarded by a sequence
+// lock. A thread that finds an entry being written handles the call as
+// a miss, and a thread that cannot acquire an entry to write does not
+// store the result.
+//
+// Strings longer than 48 bytes, and strings of printable ASCII characters
+// only ( whose width is their length ), are measured directly.
+template <typename CharT>
+class width_cache {
+public:
+
+    explicit width_cache(std::size_t memory_budget = 1 << 20, std::size_t shards_count = 16)
+    {
+        using string_width::detail::width_cache_entry;
+        using string_width::detail::width_cache_ways;
+
+        shards_count_ = 1;
+        while (shards_count_ * 2 <= shards_count) {
+            shards_count_ *= 2;
+        }
+        const std::size_t per_shard = memory_budget / shards_count_ / sizeof(width_cache_entry);
+        std::size_t buckets = 1;
+        while (buckets * 2 * width_cache_ways <= per_shard) {
+            buckets *= 2;
+        }
+        buckets_mask_ = buckets - 1;
+        entries_count_ = shards_count_ * buckets * width_cache_ways;
+        entries_.reset(new width_cache_entry[entries_count_]);
+        for (std::size_t i = 0; i < entries_count_; ++i) {
+            entries_[i].seq.store(0, std::memory_order_relaxed);
+            entries_[i].hash.store(0, std::memory_order_relaxed);
+        }
+        cursors_.reset(new cursor_[shards_count_]);
+    }
+
+    width_cache(const width_cache&) = delete;
+    width_cache& operator=(const width_cache&) = delete;
+
+    string_width::width_t str_width
+        ( string_width::width_t limit
+        , const CharT* str
+        , std::size_t str_len
+        , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict ) noexcept
+    {
+        return str_width_and_pos(limit, str, str_len, surr_poli).width;
+    }
+
+    string_width::width_and_pos str_width_and_pos
+        ( string_width::width_t limit
+        , const CharT* str
+        , std::size_t str_len
+        , string_width::surrogate_policy surr_poli = string_width::surrogate_policy::strict ) noexcept
+    {
+        using namespace string_width::detail;
+
+        auto& counters = counters_[width_cache_thread_slot()];
+        const std::size_t key_size = str_len * sizeof(CharT);
+        if (limit <= 0 || str_len == 0 || key_size > sizeof(width_cache_entry::key)) {
+            counters.bypassed.fetch_add(1, std::memory_order_relaxed);
+            return string_width::str_width_and_pos(limit, str, str_len, surr_poli);
+        }
+        if (string_width::detail::is_printable_ascii(*str)
+         && string_width::detail::printable_ascii_run_length(str, str + str_len) == str_len) {
+            counters.bypassed.fetch_add(1, std::memory_order_relaxed);
+            const auto len = static_cast<string_width::width_t>(str_len);
+            return len < limit
+                ? string_width::width_and_pos{len, str_len}
+                : string_width::width_and_pos{limit, static_cast<std::size_t>(limit)};
+        }
+
+        std::uint64_t key[width_cache_key_words] = {};
+        std::memcpy(key, str, key_size);
+        const std::size_t key_words = (key_size + 7) / 8;
+        const std::uint64_t meta = static_cast<std::uint32_t>(limit)
+            | (static_cast<std::uint64_t>(key_size) << 32)
+            | (static_cast<std::uint64_t>(surr_poli == string_width::surrogate_policy::lax) << 40);
+        const std::uint64_t hash = width_cache_hash(key, key_words, meta);
+        const std::size_t shard = static_cast<std::size_t>(hash >> 40) & (shards_count_ - 1);
+        const std::size_t bucket = static_cast<std::size_t>(hash) & buckets_mask_;
+        width_cache_entry* const entries =
+            &entries_[((shard * (buckets_mask_ + 1)) + bucket) * width_cache_ways];
+
+        for (std::size_t i = 0; i < width_cache_ways; ++i) {
+            std::uint64_t result;
+            if (read_(entries[i], hash, meta, key, key_words, result)) {
+                counters.hits.fetch_add(1, std::memory_order_relaxed);
+                return { static_cast<string_width::width_t>(result & 0xFFFFFFFFu)
+                       , static_cast<std::size_t>(result >> 32) };
+            }
+        }
+        counters.misses.fetch_add(1, std::memory_order_relaxed);
+        const auto res = string_width::str_width_and_pos(limit, str, str_len, surr_poli);
+        const std::uint64_t result = static_cast<std::uint32_t>(res.width)
+            | (static_cast<std::uint64_t>(res.pos) << 32);
+        write_(entries, shard, hash, meta, key, key_words, result, counters);
+        return res;
+    }
+
+    // The sum of the counters of all threads. They are updated with
+    // relaxed atomic operations, so while other threads use the cache
+    // the result is only approximate.
+    string_width::width_cache_stats stats() const noexcept
+    {
+        string_width::width_cache_stats s = {0, 0, 0, 0};
+        for (auto& c: counters_) {
+            s.hits += c.hits.load(std::memory_order_relaxed);
+            s.misses += c.misses.load(std::memory_order_relaxed);
+            s.evictions += c.evictions.load(std::memory_order_relaxed);
+            s.bypassed += c.bypassed.load(std::memory_order_relaxed);
+        }
+        return s;
+    }
+
+    // The number of entries, which is the maximum number of results kept
+    std::size_t capacity() const noexcept
+    {
+        return entries_count_;
+    }
+
+private:
+
+    static bool read_
+        ( const string_width::detail::width_cache_entry& e
+        , std::uint64_t hash
+        , std::uint64_t meta
+        , const std::uint64_t* key
+        , std::size_t key_words
+        , std::uint64_t& result ) noexcept
+    {
+        const auto seq = e.seq.load(std::memory_order_acquire);
+        if ((seq & 1) || e.hash.load(std::memory_order_relaxed) != hash
+         || e.meta.load(std::memory_order_relaxed) != meta) {
+            return false;
+        }
+        for (std::size_t i = 0; i < key_words; ++i) {
+            if (e.key[i].load(std::memory_order_relaxed) != key[i]) {
+                return false;
+            }
+        }
+        result = e.result.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return e.seq.load(std::memory_order_relaxed) == seq;
+    }
+
+    void write_
+        ( string_width::detail::width_cache_entry* entries
+        , std::size_t shard
+        , std::uint64_t hash
+        , std::uint64_t meta
+        , const std::uint64_t* key
+        , std::size_t key_words
+        , std::uint64_t result
+        , string_width::detail::width_cache_counters& counters ) noexcept
+    {
+        using string_width::detail::width_cache_ways;
+
+        // an empty entry, or else the next one in the round-robin of the shard
+        std::size_t victim = width_cache_ways;
+        for (std::size_t i = 0; i < width_cache_ways; ++i) {
+            if (entries[i].hash.load(std::memory_order_relaxed) == 0) {
+                victim = i;
+                break;
+            }
+        }
+        if (victim == width_cache_ways) {
+            victim = cursors_[shard].value.fetch_add(1, std::memory_order_relaxed) % width_cache_ways;
+        }
+        auto& e = entries[victim];
+        auto seq = e.seq.load(std::memory_order_relaxed);
+        if ((seq & 1) || ! e.seq.compare_exchange_strong(seq, seq + 1, std::memory_order_relaxed)) {
+            return; // another thread is writing it
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        if (e.hash.load(std::memory_order_relaxed) != 0) {
+            counters.evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+        e.hash.store(hash, std::memory_order_relaxed);
+        e.meta.store(meta, std::memory_order_relaxed);
+        e.result.store(result, std::memory_order_relaxed);
+        for (std::size_t i = 0; i < key_words; ++i) {
+            e.key[i].store(key[i], std::memory_order_relaxed);
+        }
+        e.seq.store(seq + 2, std::memory_order_release);
+    }
+
+    struct cursor_ {
+        std::atomic<std::size_t> value{0};
+        char padding[64 - sizeof(std::atomic<std::size_t>)];
+    };
+
+    std::unique_ptr<string_width::detail::width_cache_entry[]> entries_;
+    std::unique_ptr<cursor_[]> cursors_;
+    std::size_t entries_count_ = 0;
+    std::size_t shards_count_ = 1;
+    std::size_t buckets_mask_ = 0;
+    string_width::detail::width_cache_counters
+        counters_[string_width::detail::width_cache_counters_count];
+};
+
+} // namespace string_width
+
+#endif // STRING_WIDTH_WIDTH_CACHE_HPP
@@ -0,0 +1,98 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+// Checks that long runs of printable ASCII characters in UTF-8, which are
+// processed in bulk, give the same results as the equivalent UTF-32 strings,
+// which are processed one codepoint at a time.
+
+static void append_utf8(std::string& dest, char32_t ch)
+{
+    if (ch < 0x80) {
+        dest.push_back(static_cast<char>(ch));
+    } else if (ch < 0x800) {
+        dest.push_back(static_cast<char>(0xC0 | (ch >> 6)));
+        dest.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+    } else if (ch < 0x10000) {
+        dest.push_back(static_cast<char>(0xE0 | (ch >> 12)));
+        dest.push_back(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
+        dest.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+    } else {
+        dest.push_back(static_cast<char>(0xF0 | (ch >> 18)));
+        dest.push_back(static_cast<char>(0x80 | ((ch >> 12) & 0x3F)));
+        dest.push_back(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
+        dest.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+    }
+}
+
+static int failures = 0;
+
+static void test(const std::u32string& str32)
+{
+    std::string str8;
+    std::vector<std::size_t> offsets; // utf8 offset of each codepoint
+    for (auto ch: str32) {
+        offsets.push_back(str8.size());
+        append_utf8(str8, ch);
+    }
+    offsets.push_back(str8.size());
+
+    const auto total = string_width::str_width(10000, str32.data(), str32.size());
+    for (int limit = -1; limit <= total + 1; ++limit) {
+        auto w8 = string_width::str_width(limit, str8.data(), str8.size());
+        auto w32 = string_width::str_width(limit, str32.data(), str32.size());
+        auto r8 = string_width::str_width_and_pos(limit, str8.data(), str8.size());
+        auto r32 = string_width::str_width_and_pos(limit, str32.data(), str32.size());
+        if (w8 != w32 || r8.width != r32.width || r8.pos != offsets[r32.pos]) {
+            ++failures;
+            std::printf( "failure with limit %d and string of length %d:"
+                         " str_width: %d (expected %d);"
+                         " str_width_and_pos: {%d, %d} (expected {%d, %d})\n"
+                       , limit, (int)str32.size(), w8, w32
+                       , r8.width, (int)r8.pos, r32.width, (int)offsets[r32.pos] );
+        }
+    }
+}
+
+int main()
+{
+    const std::u32string ascii_run = U"The quick brown fox jumps over the lazy dog";
+    const std::u32string pieces[] = {
+        U"", U"\u0600", U"\u0301", U"\u0600\u0301", U"\u6F22", U"\r", U"\n",
+        U"\r\n", U"\U0001F600", U"\u200D", U"\U0001F1E7", U"\u1100", U"\t", U"\u00E9"
+    };
+    for (auto& before: pieces) {
+        for (auto& after: pieces) {
+            test(before + ascii_run + after);
+            test(before + ascii_run + after + ascii_run);
+            test(before + ascii_run.substr(0, 7) + after + ascii_run.substr(0, 8));
+        }
+    }
+    test(ascii_run + ascii_run + ascii_run);
+    test(ascii_run.substr(0, 8));
+    test(ascii_run.substr(0, 1));
+    test(U"");
+
+    // invalid sequences around ascii runs
+    {
+        const char str[] = "\xE0\xA0" "abcdefghijklmnop" "\xF0\x90\x80" "abcdefghijklmnop" "\x80";
+        const std::size_t len = sizeof(str) - 1;
+        const auto width = string_width::str_width(1000, str, len);
+        auto r = string_width::str_width_and_pos(18, str, len);
+        if (width != 35 || r.width != 18 || r.pos != 21) {
+            ++failures;
+            std::printf( "invalid sequences around ascii runs: width %d, %d, pos %d "
+                         "( expected 35, 18, 21 )\n"
+                       , width, r.width, (int)r.pos );
+        }
+    }
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
@@ -0,0 +1,139 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdio>
+
+// Checks that, for well-formed strings, validation_policy::assume_valid
+// gives the same results as the default validation.
+
+static int failures = 0;
+
+static void append_utf8(std::string& str, char32_t ch)
+{
+    if (ch < 0x80) {
+        str += static_cast<char>(ch);
+    } else if (ch < 0x800) {
+        str += static_cast<char>(0xC0 | (ch >> 6));
+        str += static_cast<char>(0x80 | (ch & 0x3F));
+    } else if (ch < 0x10000) {
+        str += static_cast<char>(0xE0 | (ch >> 12));
+        str += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+        str += static_cast<char>(0x80 | (ch & 0x3F));
+    } else {
+        str += static_cast<char>(0xF0 | (ch >> 18));
+        str += static_cast<char>(0x80 | ((ch >> 12) & 0x3F));
+        str += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+        str += static_cast<char>(0x80 | (ch & 0x3F));
+    }
+}
+
+static void append_utf16(std::u16string& str, char32_t ch)
+{
+    if (ch < 0x10000) {
+        str += static_cast<char16_t>(ch);
+    } else {
+        str += static_cast<char16_t>(0xD800 + ((ch - 0x10000) >> 10));
+        str += static_cast<char16_t>(0xDC00 + ((ch - 0x10000) & 0x3FF));
+    }
+}
+
+static char32_t random_codepoint(std::mt19937& rng)
+{
+    static const char32_t samples[] = {
+        U'a', U' ', U'\r', U'\n', 0x0301, 0x200D, 0x0600, 0x1100, 0x1161, 0x11A8,
+        0xAC00, 0x6F22, 0x00B1, 0xFFFD, 0x1F600, 0x1F1E7, 0x1F3FB, 0xE0100 };
+    char32_t ch;
+    switch (rng() % 4) {
+        case 0:  ch = samples[rng() % (sizeof(samples) / sizeof(samples[0]))]; break;
+        case 1:  ch = 0x20 + rng() % 0x5F; break;
+        case 2:  ch = rng() % 0x10000; break;
+        default: ch = rng() % 0x110000;
+    }
+    if (ch >= 0xD800 && ch < 0xE000) {
+        ch -= 0x1000;
+    }
+    return ch;
+}
+
+template <string_width::width_profile Profile, typename CharT>
+static void check_string(const std::basic_string<CharT>& str, std::size_t index)
+{
+    using string_width::validation_policy;
+    const auto* s = str.data();
+    const auto len = str.size();
+    if (! string_width::detail::is_well_formed(s, s + len)) {
+        ++failures;
+        std::printf("string %d (char size %d) is not well-formed\n", (int)index, (int)sizeof(CharT));
+        return;
+    }
+    const int total = string_width::str_width<Profile>(1 << 30, s, len);
+    const int limits[] = {-1, 0, 1, 2, 3, total / 2, total - 1, total, total + 1};
+    for (int limit: limits) {
+        const auto expected_width = string_width::str_width<Profile>(limit, s, len);
+        const auto expected = string_width::str_width_and_pos<Profile>(limit, s, len);
+        const auto width = string_width::str_width<Profile>
+            (limit, s, len, validation_policy::assume_valid);
+        const auto res = string_width::str_width_and_pos<Profile>
+            (limit, s, len, validation_policy::assume_valid);
+        if ( width != expected_width || res.width != expected.width
+          || res.pos != expected.pos ) {
+            ++failures;
+            std::printf( "string %d (char size %d), limit %d: width %d, %d, pos %d "
+                         "( expected %d, %d, %d )\n"
+                       , (int)index, (int)sizeof(CharT), limit, width, res.width
+                       , (int)res.pos, expected_width, expected.width, (int)expected.pos );
+        }
+    }
+}
+
+template <typename CharT>
+static void check_ill_formed(const std::basic_string<CharT>& str, const char* name)
+{
+    if (string_width::detail::is_well_formed(str.data(), str.data() + str.size())) {
+        ++failures;
+        std::printf("%s is considered well-formed\n", name);
+    }
+}
+
+int main()
+{
+    std::mt19937 rng(2468);
+    for (std::size_t i = 0; i < 2000; ++i) {
+        std::string str8;
+        std::u16string str16;
+        std::u32string str32;
+        const int n = static_cast<int>(rng() % 30);
+        for (int j = 0; j < n; ++j) {
+            const char32_t ch = random_codepoint(rng);
+            append_utf8(str8, ch);
+            append_utf16(str16, ch);
+            str32 += ch;
+        }
+        check_string<string_width::width_profile::std_format>(str8, i);
+        check_string<string_width::width_profile::std_format>(str16, i);
+        check_string<string_width::width_profile::std_format>(str32, i);
+        check_string<string_width::width_profile::east_asian_wide>(str8, i);
+        check_string<string_width::width_profile::wcwidth>(str16, i);
+    }
+
+    check_ill_formed(std::string("\x80"), "lone continuation byte");
+    check_ill_formed(std::string("\xC1\xBF"), "overlong 2-byte sequence");
+    check_ill_formed(std::string("\xE0\x9F\x80"), "overlong 3-byte sequence");
+    check_ill_formed(std::string("\xED\xA0\x80"), "encoded surrogate");
+    check_ill_formed(std::string("\xE4\xB8"), "missing continuation byte");
+    check_ill_formed(std::string("\xF4\x90\x80\x80"), "codepoint above U+10FFFF");
+    check_ill_formed(std::string("\xF5\x80\x80\x80"), "invalid leading byte");
+    check_ill_formed(std::u16string(1, (char16_t)0xDC00), "lone low surrogate");
+    check_ill_formed(std::u16string(u"a") + (char16_t)0xD800, "lone high surrogate");
+    check_ill_formed(std::u32string(1, (char32_t)0x110000), "UTF-32 0x110000");
+
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
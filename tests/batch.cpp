@@ -0,0 +1,100 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+// Checks that the batch functions give the same results as calling
+// str_width and str_width_and_pos for each string.
+
+static int failures = 0;
+
+template <typename CharT>
+static void test(const std::vector<std::basic_string<CharT>>& strings)
+{
+    std::vector<string_width::width_query<CharT>> queries;
+    for (string_width::width_t limit = -1; limit < 12; ++limit) {
+        for (auto& s: strings) {
+            queries.push_back({s.data(), s.size(), limit});
+        }
+    }
+    const auto count = queries.size();
+    std::vector<string_width::width_t> widths(count), widths2(count);
+    std::vector<std::size_t> positions(count);
+    string_width::str_width_batch(queries.data(), count, widths.data());
+    string_width::str_width_and_pos_batch(queries.data(), count, widths2.data(), positions.data());
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto& q = queries[i];
+        auto w = string_width::str_width(q.limit, q.str, q.str_len);
+        auto r = string_width::str_width_and_pos(q.limit, q.str, q.str_len);
+        if (widths[i] != w || widths2[i] != r.width || positions[i] != r.pos) {
+            ++failures;
+            std::printf( "failure in query %d ( sizeof(CharT) == %d ): {%d, %d, %d}"
+                         " (expected {%d, %d, %d})\n"
+                       , (int)i, (int)sizeof(CharT), widths[i], widths2[i], (int)positions[i]
+                       , w, r.width, (int)r.pos );
+        }
+    }
+
+    for (string_width::width_t cap = 0; cap < 12; ++cap) {
+        for (std::size_t first = 0; first < count; first += 7) {
+            const auto n = count - first < 9 ? count - first : 9;
+            string_width::max_width_result expected{0, 0};
+            for (std::size_t i = 0; i < n; ++i) {
+                const auto& q = queries[first + i];
+                auto w = string_width::str_width(q.limit < cap ? q.limit : cap, q.str, q.str_len);
+                if (i == 0 || w > expected.width) {
+                    expected = {w, i};
+                }
+            }
+            auto res = string_width::max_str_width(queries.data() + first, n, cap);
+            if (res.width != expected.width || res.index != expected.index) {
+                ++failures;
+                std::printf( "max_str_width failure ( sizeof(CharT) == %d, cap = %d ):"
+                             " {%d, %d} (expected {%d, %d})\n"
+                           , (int)sizeof(CharT), cap, res.width, (int)res.index
+                           , expected.width, (int)expected.index );
+            }
+        }
+    }
+}
+
+int main()
+{
+    test<char>({ "", "abc", "\xE6\xBC\xA2\xE5\xAD\x97", "a\xCC\x81" "bc"
+               , "\xF0\x9F\x91\xA9\xE2\x80\x8D\xF0\x9F\x92\xBB!", "\xFF\xFE", "0123456789abcdef" });
+    test<char16_t>({ u"", u"abc", u"\u6F22\u5B57", u"a\u0301bc", u"\U0001F469\u200D\U0001F4BB!"
+                   , std::u16string(1, (char16_t)0xD800), u"0123456789abcdef" });
+    test<char32_t>({ U"", U"abc", U"\u6F22\u5B57", U"a\u0301bc", U"\U0001F469\u200D\U0001F4BB!"
+                   , std::u32string(1, (char32_t)0x110000), U"0123456789abcdef" });
+
+    {
+        string_width::width_query<char> none[1] = {};
+        auto res = string_width::max_str_width(none, 0, 10);
+        if (res.width != 0 || res.index != 0) {
+            ++failures;
+            std::printf( "max_str_width of no query: width %d, index %d ( expected 0, 0 )\n"
+                       , res.width, (int)res.index );
+        }
+    }
+    {
+        // early exit: the query after the one that reaches the cap is never read
+        const std::string a = "abcdef", b = "abcdefghij";
+        string_width::width_query<char> q[] = { {a.data(), a.size(), 100}
+                                              , {b.data(), b.size(), 100}
+                                              , {nullptr, 1000, 100} };
+        auto res = string_width::max_str_width(q, 3, 8);
+        if (res.width != 8 || res.index != 1) {
+            ++failures;
+            std::printf( "max_str_width early exit: width %d, index %d ( expected 8, 1 )\n"
+                       , res.width, (int)res.index );
+        }
+    }
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
@@ -171,6 +171,30 @@ codepoint_properties obtain_props(UChar32 ch) {
     return {category::invalid, 100};
 }
 
+codepoint_properties props_from_tables(std::uint32_t ch) {
+    namespace prop = string_width::detail::prop;
+    const auto props = string_width::detail::ch32_props(ch);
+    const string_width::width_t width = (props & prop::double_width) ? 2 : 1;
+    switch (props & prop::category_mask) {
+        case prop::other: return {category::other, width};
+        case prop::control: return {category::control, width};
+        case prop::extend: return {category::extend, width};
+        case prop::zwj: return {category::zwj, width};
+        case prop::spacing_mark: return {category::spacing_mark, width};
+        case prop::prepend: return {category::prepend, width};
+        case prop::hangul_l: return {category::hangul_l, width};
+        case prop::hangul_v: return {category::hangul_v, width};
+        case prop::hangul_t: return {category::hangul_t, width};
+        case prop::hangul_lv: return {category::hangul_lv, width};
+        case prop::hangul_lvt: return {category::hangul_lvt, width};
+        case prop::regional_indicator: return {category::regional_indicator, width};
+        case prop::extended_picto: return {category::extended_picto, width};
+        case prop::cr: return {category::cr, width};
+        case prop::lf: return {category::lf, width};
+    }
+    return {category::invalid, 100};
+}
+
 int main() {
     constexpr long max_failures_count = 500;
     long failures_count = 0;
@@ -195,6 +219,14 @@ int main() {
         if (obtained_width != expected_width) {
             printf("     Got width = %d (expected %d).\n", obtained_width, expected_width);
         }
+        auto from_tables = props_from_tables(ch);
+        if (from_tables.width != obtained_width || from_tables.cat != obtained_category) {
+            printf( "For codepoint U+%.4X: width_and_gcb_prop_tables has category \'%s\'"
+                    " and width %d, while the tree has \'%s\' and %d.\n"
+                  , ch, to_str(from_tables.cat), from_tables.width
+                  , to_str(obtained_category), obtained_width );
+            ++failures_count;
+        }
         if (failures_count >= max_failures_count) {
             printf("%s", "\nToo many failures. Stopping before end.\n");
             break;
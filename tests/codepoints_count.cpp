@@ -0,0 +1,164 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdio>
+
+// Compares count_codepoints and codepoint_pos, at each simd_level
+// supported by the CPU, against stepping through the string with
+// next_props, which moves over the sequences like decode does.
+
+static int failures = 0;
+
+template <typename CharT>
+static std::vector<std::size_t> reference_positions
+    ( const std::basic_string<CharT>& str
+    , string_width::surrogate_policy surr_poli )
+{
+    std::vector<std::size_t> positions;
+    const CharT* it = str.data();
+    const CharT* end = it + str.size();
+    while (it != end) {
+        positions.push_back(static_cast<std::size_t>(it - str.data()));
+        (void) string_width::detail::next_props(it, end, surr_poli);
+    }
+    positions.push_back(str.size());
+    return positions;
+}
+
+template <typename CharT>
+static void check_string(const std::basic_string<CharT>& str, std::size_t index, std::mt19937& rng)
+{
+    const string_width::surrogate_policy policies[] =
+        { string_width::surrogate_policy::strict, string_width::surrogate_policy::lax };
+    for (auto surr_poli: policies) {
+        const auto positions = reference_positions(str, surr_poli);
+        const std::size_t expected_count = positions.size() - 1;
+        const auto count = string_width::count_codepoints(str.data(), str.size(), surr_poli);
+        if (count != expected_count) {
+            ++failures;
+            std::printf( "string %d (char size %d, %s): %d codepoints ( expected %d )\n"
+                       , (int)index, (int)sizeof(CharT)
+                       , surr_poli == string_width::surrogate_policy::lax ? "lax" : "strict"
+                       , (int)count, (int)expected_count );
+        }
+        std::vector<std::size_t> ns = {0, 1, 2, 63, 64, 65, expected_count / 2
+                                      , expected_count - 1, expected_count, expected_count + 1};
+        for (int i = 0; i < 8; ++i) {
+            ns.push_back(rng() % (expected_count + 2));
+        }
+        for (std::size_t n: ns) {
+            const auto expected = n < positions.size() ? positions[n] : str.size();
+            const auto pos = string_width::codepoint_pos(str.data(), str.size(), n, surr_poli);
+            if (pos != expected) {
+                ++failures;
+                std::printf( "string %d (char size %d, %s): codepoint %d at %d ( expected %d )\n"
+                           , (int)index, (int)sizeof(CharT)
+                           , surr_poli == string_width::surrogate_policy::lax ? "lax" : "strict"
+                           , (int)n, (int)pos, (int)expected );
+            }
+        }
+    }
+}
+
+static std::string random_utf8(std::mt19937& rng)
+{
+    static const char* const pieces[] = {
+        "abc", "xyzw12345 ", "\xC3\xA9", "\xD0\x96", "\xE6\xBC\xA2\xE5\xAD\x97",
+        "\xE0\xA4\xA8", "\xED\x9F\xBF", "\xEF\xBF\xBD", "\xF0\x9F\x98\x80", "\xF4\x8F\xBF\xBF",
+        // invalid sequences
+        "\xED\xA0\x80", "\xED\xBF\xBF", "\xE0\x9F\x80", "\xF0\x8F\xBF\xBF", "\xF4\x90\x80\x80",
+        "\xC0\x80", "\xC1\xBF", "\x80", "\xBF\xBF", "\xE6\xBC", "\xF0\x9F\x98", "\xF5\x80",
+        "\xFF", "\xC3" };
+    const std::size_t pieces_count = sizeof(pieces) / sizeof(pieces[0]);
+    std::string str;
+    const int n = static_cast<int>(rng() % 120);
+    for (int i = 0; i < n; ++i) {
+        // mostly valid sequences
+        const std::size_t max = rng() % 8 == 0 ? pieces_count : 10;
+        const char* piece = pieces[rng() % max];
+        const int repeat = 1 + rng() % 6;
+        for (int r = 0; r < repeat; ++r) {
+            str += piece;
+        }
+    }
+    return str;
+}
+
+static std::u16string random_utf16(std::mt19937& rng)
+{
+    static const char16_t lone_low[] = {0xDC00, 0};
+    static const char16_t lone_high[] = {0xDBFF, 0};
+    static const char16_t* const pieces[] = {
+        u"abc", u"\u6F22\u5B57", u"\uFFFD", u"\U0001F600", u"\U0010FFFF",
+        lone_low, lone_high };
+    const std::size_t pieces_count = sizeof(pieces) / sizeof(pieces[0]);
+    std::u16string str;
+    const int n = static_cast<int>(rng() % 120);
+    for (int i = 0; i < n; ++i) {
+        const std::size_t max = rng() % 8 == 0 ? pieces_count : 5;
+        const char16_t* piece = pieces[rng() % max];
+        const int repeat = 1 + rng() % 6;
+        for (int r = 0; r < repeat; ++r) {
+            str += piece;
+        }
+    }
+    return str;
+}
+
+int main()
+{
+    std::mt19937 rng(97531);
+    std::vector<std::string> strings8;
+    std::vector<std::u16string> strings16;
+    for (int i = 0; i < 1500; ++i) {
+        strings8.push_back(random_utf8(rng));
+        strings16.push_back(random_utf16(rng));
+    }
+    // a sequence that is incomplete at the end of a block of 64 bytes, and
+    // a surrogate pair split between two blocks of 32 code units
+    strings8.push_back(std::string(62, 'a') + "\xE6\xBC\xA2" + std::string(70, 'b'));
+    strings8.push_back(std::string(61, 'a') + "\xE6\xBC" + "\xE6\xBC\xA2" + std::string(70, 'b'));
+    strings8.push_back(std::string(61, 'a') + "\xF0\x9F\x98\x80" + std::string(70, 'b'));
+    strings16.push_back(std::u16string(31, u'a') + u"\U0001F600" + std::u16string(40, u'b'));
+    strings16.push_back(std::u16string(31, u'a') + (char16_t)0xD800 + std::u16string(40, u'b'));
+    strings16.push_back(std::u16string(32, u'a') + (char16_t)0xDC00 + std::u16string(40, u'b'));
+
+    const string_width::simd_level levels[] = {
+        string_width::simd_level::scalar,
+        string_width::simd_level::sse2,
+        string_width::simd_level::avx2,
+        string_width::simd_level::avx512 };
+    const auto detected = string_width::detected_simd_level();
+    for (auto level: levels) {
+        if (level > detected) {
+            break;
+        }
+        string_width::set_simd_level(level);
+        for (std::size_t i = 0; i < strings8.size(); ++i) {
+            check_string(strings8[i], i, rng);
+        }
+        for (std::size_t i = 0; i < strings16.size(); ++i) {
+            check_string(strings16[i], i, rng);
+        }
+    }
+    string_width::set_simd_level(detected);
+
+    std::u32string str32 = U"abc\U0001F600";
+    str32 += static_cast<char32_t>(0x110000);
+    if ( string_width::count_codepoints(str32.data(), str32.size()) != 5
+      || string_width::codepoint_pos(str32.data(), str32.size(), 3) != 3
+      || string_width::codepoint_pos(str32.data(), str32.size(), 9) != 5 ) {
+        ++failures;
+        std::printf("wrong count or position in UTF-32\n");
+    }
+
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
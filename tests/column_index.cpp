@@ -0,0 +1,108 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width/column_index.hpp>
+#include <string>
+#include <random>
+#include <cstdio>
+
+// Checks column_index against str_width_and_pos
+
+static int failures = 0;
+
+template <typename CharT>
+static void test(const std::basic_string<CharT>& str, std::size_t interval)
+{
+    const auto surr_poli = string_width::surrogate_policy::strict;
+    const string_width::column_index<CharT> index(str.data(), str.size(), interval);
+    const auto total = string_width::str_width(1 << 30, str.data(), str.size());
+    if (index.width() != total) {
+        ++failures;
+        std::printf("wrong total width %d (expected %d)\n", index.width(), total);
+    }
+    std::vector<string_width::width_and_pos> by_column;
+    for (int column = -1; column <= total + 1; ++column) {
+        auto expected = string_width::str_width_and_pos(column, str.data(), str.size(), surr_poli);
+        auto res = index.offset_at_column(column);
+        if (res.width != expected.width || res.pos != expected.pos) {
+            ++failures;
+            std::printf( "offset_at_column failure ( sizeof(CharT) == %d, length %d, interval %d"
+                         ", column %d ): {%d, %d} (expected {%d, %d})\n"
+                       , (int)sizeof(CharT), (int)str.size(), (int)interval, column
+                       , res.width, (int)res.pos, expected.width, (int)expected.pos );
+        }
+        by_column.push_back(expected);
+    }
+    for (std::size_t offset = 0; offset <= str.size() + 1; ++offset) {
+        // the widest prefix made of whole grapheme clusters that does
+        // not go beyond offset
+        string_width::width_t expected = 0;
+        for (auto& r: by_column) {
+            if (r.pos <= offset) {
+                // r.width is not used because it is equal to the column,
+                // even when it stops before a wide character
+                auto w = string_width::str_width(1 << 30, str.data(), r.pos);
+                expected = w > expected ? w : expected;
+            }
+        }
+        auto column = index.column_at_offset(offset);
+        if (column != expected) {
+            ++failures;
+            std::printf( "column_at_offset failure ( sizeof(CharT) == %d, length %d, interval %d"
+                         ", offset %d ): %d (expected %d)\n"
+                       , (int)sizeof(CharT), (int)str.size(), (int)interval, (int)offset
+                       , column, expected );
+        }
+    }
+}
+
+int main()
+{
+    const char* const pieces[] = {
+        "a", "bcdefghijklmnopqrstuvwxyz", "\r", "\n", "\t",
+        "\xC3\xA9",          // U+00E9
+        "\xCC\x81",          // U+0301 extend
+        "\xD8\x80",          // U+0600 prepend
+        "\xE2\x80\x8D",      // U+200D zwj
+        "\xE1\x84\x80",      // U+1100 hangul L
+        "\xEA\xB0\x80",      // U+AC00 hangul LV
+        "\xE6\xBC\xA2",      // U+6F22 wide
+        "\xF0\x9F\x98\x80",  // U+1F600 extended pictographic
+        "\xF0\x9F\x87\xA7",  // U+1F1E7 regional indicator
+        "\xE0\x9F\x80", "\xF0\x90\x80", "\xFF"
+    };
+    const std::size_t pieces_count = sizeof(pieces) / sizeof(pieces[0]);
+    const char16_t pieces16[] = { u'a', u'b', 0x0301, 0x0600, 0x6F22, 0xD83D, 0xDE00, 0xD800, u'\r', u'\n' };
+    const char32_t pieces32[] = { U'a', U'b', 0x0301, 0x0600, 0x6F22, 0x1F600, 0x1F1E7, 0x110000, U'\r', U'\n' };
+    const std::size_t intervals[] = {1, 2, 3, 7, 64};
+
+    std::mt19937 rng(2468);
+    for (int n = 0; n < 200; ++n) {
+        std::string str;
+        std::u16string str16;
+        std::u32string str32;
+        const auto count = rng() % 30;
+        for (unsigned i = 0; i < count; ++i) {
+            str += pieces[rng() % pieces_count];
+            str16 += pieces16[rng() % (sizeof(pieces16) / sizeof(pieces16[0]))];
+            str32 += pieces32[rng() % (sizeof(pieces32) / sizeof(pieces32[0]))];
+        }
+        for (auto interval: intervals) {
+            test(str, interval);
+            test(str16, interval);
+            test(str32, interval);
+        }
+    }
+    {
+        const std::string str(10000, 'x');
+        string_width::column_index<char> index(str.data(), str.size(), 100);
+        assert(index.samples_count() == 100);
+        assert(index.column_at_offset(5555) == 5555);
+        assert(index.offset_at_column(4321).pos == 4321);
+    }
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
@@ -0,0 +1,90 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <cstdio>
+
+// Checks that str_width and str_width_and_pos can be evaluated at
+// compile time ( in C++20 ), and that they give the same results there
+// as at runtime.
+
+#if defined(__cpp_lib_is_constant_evaluated)
+
+template <typename CharT, std::size_t N>
+constexpr int width(int limit, const CharT (&str)[N])
+{
+    return string_width::str_width(limit, str, N - 1);
+}
+
+template <typename CharT, std::size_t N>
+constexpr std::size_t pos(int limit, const CharT (&str)[N])
+{
+    return string_width::str_width_and_pos(limit, str, N - 1).pos;
+}
+
+static_assert(width(100, "") == 0, "");
+static_assert(width(100, "Hello world") == 11, "");
+static_assert(width(5, "Hello world") == 5, "");
+static_assert(width(0, "Hello world") == 0, "");
+static_assert(width(-1, "Hello world") == -1, "");
+static_assert(width(100, "\xE6\xBC\xA2\xE5\xAD\x97") == 4, "");
+static_assert(width(100, "a\xCC\x81" "b") == 2, "");
+static_assert(width(100, "\xF0\x9F\x91\xA9\xE2\x80\x8D\xF0\x9F\x92\xBB") == 2, "");
+static_assert(width(100, "\xF0\x9F\x87\xA7\xF0\x9F\x87\xB7\xF0\x9F\x87\xA7") == 2, "");
+static_assert(width(100, "\xE1\x84\x80\xE1\x85\xA1\xE1\x86\xA8") == 2, "");
+static_assert(width(100, "\xFF\xE0\xA0") == 2, "");
+static_assert(pos(3, "abcdef") == 3, "");
+static_assert(pos(3, "ab\xE6\xBC\xA2" "c") == 2, "");
+static_assert(pos(1, "a\xCC\x81" "b") == 3, "");
+
+static_assert(width(100, u"\u6F22\u5B57 ok") == 7, "");
+static_assert(width(100, u"\U0001F469\u200D\U0001F4BB") == 2, "");
+static_assert(pos(2, u"\u6F22\u0301\u5B57") == 2, "");
+static_assert(width(100, U"\u6F22\u5B57 ok") == 7, "");
+static_assert(width(100, U"\r\n\r\n") == 2, "");
+static_assert(pos(1, U"a\u0301\u0301b") == 3, "");
+
+template <typename CharT, std::size_t N>
+static int check(const CharT (&str)[N], int compile_time_width, std::size_t compile_time_pos)
+{
+    // the same values at runtime
+    volatile int limit = 3;
+    const auto w = string_width::str_width(100, str, N - 1);
+    const auto p = string_width::str_width_and_pos(limit, str, N - 1).pos;
+    if (w != compile_time_width || p != compile_time_pos) {
+        std::printf("failure: %d, %d (at compile time: %d, %d)\n"
+                   , w, (int)p, compile_time_width, (int)compile_time_pos);
+        return 1;
+    }
+    return 0;
+}
+
+#define CHECK(STR) check(STR, width(100, STR), pos(3, STR))
+
+int main()
+{
+    int failures
+        = CHECK("Hello world")
+        + CHECK("a\xCC\x81" "b\xE6\xBC\xA2" "c")
+        + CHECK("\xD8\x80" "abc")
+        + CHECK("\xF0\x9F\x87\xA7\xF0\x9F\x87\xB7\xF0\x9F\x87\xA7")
+        + CHECK(u"\u0600\u6F22\u0301x")
+        + CHECK(u"\xD800" "ab")
+        + CHECK(U"\U0001F469\u200D\U0001F4BB!")
+        + CHECK(U"\x110000" "ab");
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
+
+#else
+
+int main()
+{
+    std::printf("%s", "constexpr str_width requires C++20\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,116 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width/grapheme_clusters.hpp>
+#include <string>
+#include <set>
+#include <random>
+#include <cstdio>
+
+// Checks that the grapheme clusters yielded by grapheme_clusters cover the
+// whole string, and that their boundaries and widths agree with
+// str_width_and_pos.
+
+static int failures = 0;
+
+template <typename CharT>
+static void test(const std::basic_string<CharT>& str, string_width::surrogate_policy surr_poli)
+{
+    const auto total = string_width::str_width(1 << 30, str.data(), str.size(), surr_poli);
+
+    // the positions where str_width_and_pos may stop are the cluster boundaries
+    std::set<std::size_t> expected_ends;
+    for (int limit = 1; limit <= total; ++limit) {
+        expected_ends.insert(string_width::str_width_and_pos(limit, str.data(), str.size(), surr_poli).pos);
+    }
+    expected_ends.erase(0); // when the first cluster is wider than the limit
+
+    std::set<std::size_t> ends;
+    const CharT* prev_end = str.data();
+    string_width::width_t width = 0;
+    for (auto& c: string_width::grapheme_clusters<CharT>(str.data(), str.size(), surr_poli)) {
+        const auto cluster_width = string_width::str_width(1 << 30, c.begin, c.end - c.begin, surr_poli);
+        if (c.begin != prev_end || c.end <= c.begin || c.width != cluster_width) {
+            ++failures;
+            std::printf( "failure ( sizeof(CharT) == %d ): cluster [%d, %d) of width %d\n"
+                       , (int)sizeof(CharT), (int)(c.begin - str.data())
+                       , (int)(c.end - str.data()), c.width );
+        }
+        prev_end = c.end;
+        width += c.width;
+        ends.insert(c.end - str.data());
+    }
+    if (prev_end != str.data() + str.size() || width != total || ends != expected_ends) {
+        ++failures;
+        std::printf( "failure ( sizeof(CharT) == %d, length %d ): total width %d ( expected %d )\n"
+                   , (int)sizeof(CharT), (int)str.size(), width, total );
+    }
+}
+
+int main()
+{
+    const char* const pieces[] = {
+        "a", "bc", "\r", "\n", "\t", "\x7F",
+        "\xC3\xA9",          // U+00E9
+        "\xCC\x81",          // U+0301 extend
+        "\xD8\x80",          // U+0600 prepend
+        "\xE0\xA4\x83",      // U+0903 spacing mark
+        "\xE2\x80\x8D",      // U+200D zwj
+        "\xE1\x84\x80",      // U+1100 hangul L
+        "\xE1\x85\xA0",      // U+1160 hangul V
+        "\xE1\x86\xA8",      // U+11A8 hangul T
+        "\xEA\xB0\x80",      // U+AC00 hangul LV
+        "\xEA\xB0\x81",      // U+AC01 hangul LVT
+        "\xE6\xBC\xA2",      // U+6F22 wide
+        "\xF0\x9F\x98\x80",  // U+1F600 extended pictographic
+        "\xF0\x9F\x87\xA7",  // U+1F1E7 regional indicator
+        "\xED\xA0\x80", "\xE0\x9F\x80", "\xF0\x90\x80", "\x80", "\xFF"
+    };
+    const std::size_t pieces_count = sizeof(pieces) / sizeof(pieces[0]);
+    const char16_t pieces16[] = { u'a', 0x0301, 0x0600, 0x200D, 0x1100, 0x1160, 0xAC00, 0x6F22, 0xD83D, 0xDE00, 0xD800, u'\r', u'\n' };
+    const char32_t pieces32[] = { U'a', 0x0301, 0x0600, 0x200D, 0x1100, 0x11A8, 0xAC01, 0x6F22, 0x1F600, 0x1F1E7, 0x110000, U'\r', U'\n' };
+
+    std::mt19937 rng(1357);
+    for (int n = 0; n < 3000; ++n) {
+        std::string str;
+        std::u16string str16;
+        std::u32string str32;
+        const auto count = rng() % 12;
+        for (unsigned i = 0; i < count; ++i) {
+            str += pieces[rng() % pieces_count];
+            str16 += pieces16[rng() % (sizeof(pieces16) / sizeof(pieces16[0]))];
+            str32 += pieces32[rng() % (sizeof(pieces32) / sizeof(pieces32[0]))];
+        }
+        for (auto surr_poli: {string_width::surrogate_policy::strict, string_width::surrogate_policy::lax}) {
+            test(str, surr_poli);
+            test(str16, surr_poli);
+            test(str32, surr_poli);
+        }
+    }
+    {
+        const char str[] = "e\xCC\x81\xF0\x9F\x87\xA7\xF0\x9F\x87\xB7\xE6\xBC\xA2";
+        string_width::grapheme_clusters<char> clusters(str, sizeof(str) - 1);
+        auto it = clusters.begin();
+        const bool first_ok = it->begin == str && it->end == str + 3 && it->width == 1;
+        auto it2 = it++;
+        const bool post_increment_ok = it2 != it && it2->end == it->begin;
+        const bool second_ok = it->end == str + 11 && it->width == 1;
+        ++it;
+        const bool third_ok = it->end == str + 14 && it->width == 2;
+        ++it;
+        const bool end_ok = it == clusters.end();
+        const bool empty_ok = string_width::grapheme_clusters<char>(str, 0).begin() == clusters.end();
+        if (! (first_ok && post_increment_ok && second_ok && third_ok && end_ok && empty_ok)) {
+            ++failures;
+            std::printf( "iterator: first %d, post increment %d, second %d, third %d, end %d, "
+                         "empty %d ( expected all 1 )\n"
+                       , (int)first_ok, (int)post_increment_ok, (int)second_ok, (int)third_ok
+                       , (int)end_ok, (int)empty_ok );
+        }
+    }
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
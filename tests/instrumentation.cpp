@@ -0,0 +1,151 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width/instrumentation.hpp>
+#include <string>
+#include <cstdio>
+#include <cstring>
+
+// Built with STRING_WIDTH_INSTRUMENTATION defined. Checks what the probes
+// count on known strings, through each engine, and what the call sites
+// accumulate.
+
+static int failures = 0;
+
+using string_width::instrumentation::counters;
+
+static counters snapshot()
+{
+    return string_width::instrumentation::thread_counters();
+}
+
+static void check_delta
+    ( const char* name
+    , const counters& before
+    , std::uint64_t bytes
+    , std::uint64_t codepoints
+    , std::uint64_t clusters
+    , std::uint64_t invalid_sequences
+    , std::uint64_t wide_chars
+    , std::uint64_t bulk_codepoints )
+{
+    const counters after = snapshot();
+    const counters delta =
+        { after.bytes - before.bytes
+        , after.codepoints - before.codepoints
+        , after.clusters - before.clusters
+        , after.invalid_sequences - before.invalid_sequences
+        , after.wide_chars - before.wide_chars
+        , after.bulk_codepoints - before.bulk_codepoints };
+    if ( delta.bytes != bytes || delta.codepoints != codepoints
+      || delta.clusters != clusters || delta.invalid_sequences != invalid_sequences
+      || delta.wide_chars != wide_chars || delta.bulk_codepoints != bulk_codepoints ) {
+        ++failures;
+        std::printf( "%s: %d bytes, %d codepoints, %d clusters, %d invalid, %d wide, %d bulk "
+                     "( expected %d, %d, %d, %d, %d, %d )\n"
+                   , name, (int)delta.bytes, (int)delta.codepoints, (int)delta.clusters
+                   , (int)delta.invalid_sequences, (int)delta.wide_chars
+                   , (int)delta.bulk_codepoints
+                   , (int)bytes, (int)codepoints, (int)clusters, (int)invalid_sequences
+                   , (int)wide_chars, (int)bulk_codepoints );
+    }
+}
+
+static string_width::width_t measure(const std::string& str)
+{
+    STRING_WIDTH_INSTRUMENT("measure");
+    return string_width::str_width(1000, str.data(), str.size());
+}
+
+int main()
+{
+    // 'a', an invalid byte, a wide character, and 'e' followed by a
+    // combining acute accent
+    const std::string str8 = "a\xFF\xE6\xBC\xA2" "e\xCC\x81";
+    const std::u16string str16 = std::u16string(u"a") + (char16_t)0xDC00 + u"\u6F22e\u0301";
+    const std::u32string str32 = std::u32string(U"a") + (char32_t)0x110000 + U"\u6F22e\u0301";
+
+    auto before = snapshot();
+    (void) string_width::str_width(100, str8.data(), str8.size());
+    check_delta("UTF-8", before, 8, 5, 4, 1, 1, 2);
+
+    before = snapshot();
+    (void) string_width::str_width_and_pos(100, str16.data(), str16.size());
+    check_delta("UTF-16", before, 10, 5, 4, 1, 1, 2);
+
+    before = snapshot();
+    (void) string_width::str_width(100, str32.data(), str32.size());
+    check_delta("UTF-32", before, 20, 5, 4, 1, 1, 0);
+
+    // runs of ASCII and of wide characters ( the last wide character
+    // of the run is measured alone )
+    const std::u16string runs = std::u16string(40, u'x') + std::u16string(40, u'\u6F22');
+    before = snapshot();
+    (void) string_width::str_width(1000, runs.data(), runs.size());
+    check_delta("UTF-16 runs", before, 160, 80, 80, 0, 40, 79);
+
+    // invalid sequences are counted once, even when they are split
+    // between the pieces of a stream
+    string_width::str_width_stream<char> stream(100);
+    before = snapshot();
+    stream.feed("a\xE6", 2);
+    stream.feed("\xFF", 1);
+    (void) stream.finish();
+    check_delta("stream", before, 0, 3, 3, 2, 0, 1);
+
+    // neither assume_valid nor count_codepoints checks the sequences
+    const std::string valid8 = "a\xE6\xBC\xA2";
+    before = snapshot();
+    (void) string_width::str_width
+        (100, valid8.data(), valid8.size(), string_width::validation_policy::assume_valid);
+    (void) string_width::count_codepoints(str8.data(), str8.size());
+    check_delta("assume_valid and count_codepoints", before, 4, 2, 2, 0, 1, 1);
+
+    // the width decrementers of detail
+    std::string long_str;
+    for (int i = 0; i < 20; ++i) {
+        long_str += "ab\xE6\xBC\xA2\xFF";
+    }
+    string_width::detail::std_width_decrementer decr{0};
+    before = snapshot();
+    const auto width = string_width::detail::str_width
+        (decr, 1000, long_str.data(), long_str.size(), string_width::surrogate_policy::strict);
+    check_delta("decrementer", before, 120, 80, 80, 20, 20, 0);
+    if (width != 100) {
+        ++failures;
+        std::printf("decrementer: width %d ( expected 100 )\n", width);
+    }
+
+    for (int i = 0; i < 10; ++i) {
+        (void) measure(str8);
+    }
+    const auto* site = string_width::instrumentation::call_site::first();
+    if ( site == nullptr || std::strcmp(site->name(), "measure") != 0
+      || site->calls() != 10 || site->latencies().count() != 10
+      || site->totals().codepoints != 50 || site->totals().invalid_sequences != 10
+      || site->latencies().percentile(0.5) == 0 ) {
+        ++failures;
+        std::printf("wrong call site statistics\n");
+    }
+
+    char buff[4096] = {};
+    std::FILE* f = std::tmpfile();
+    if (f != nullptr) {
+        string_width::instrumentation::dump(f);
+        std::rewind(f);
+        const auto n = std::fread(buff, 1, sizeof(buff) - 1, f);
+        buff[n] = '\0';
+        std::fclose(f);
+        if (std::strstr(buff, "measure: 10 calls, 80 bytes, 50 codepoints") == nullptr
+         || std::strstr(buff, "p99") == nullptr) {
+            ++failures;
+            std::printf("wrong dump:\n%s", buff);
+        }
+    }
+
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
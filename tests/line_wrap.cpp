@@ -0,0 +1,200 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width/line_wrap.hpp>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdio>
+
+static int failures = 0;
+
+template <typename CharT>
+static std::vector<std::basic_string<CharT>> wrap
+    ( int max_width
+    , const std::basic_string<CharT>& str
+    , bool hard_breaks = true )
+{
+    std::vector<std::basic_string<CharT>> lines;
+    string_width::wrap_lines
+        ( max_width, str.data(), str.size()
+        , [&](const string_width::line_span<CharT>& line) {
+              lines.emplace_back(line.begin, line.end);
+          }
+        , hard_breaks );
+    return lines;
+}
+
+static void test_case
+    ( int line
+    , int max_width
+    , const std::string& str
+    , const std::vector<std::string>& expected
+    , bool hard_breaks = true )
+{
+    const auto lines = wrap(max_width, str, hard_breaks);
+    if (lines != expected) {
+        ++failures;
+        std::printf("failure at line %d:", line);
+        for (auto& l: lines) {
+            std::printf(" \"%s\"", l.c_str());
+        }
+        std::printf("\n");
+    }
+}
+
+#define TEST(...) test_case(__LINE__, __VA_ARGS__)
+
+// Checks properties that must hold for any input:
+// - the lines are in order, don't overlap, and start and end at grapheme
+//   cluster boundaries;
+// - what is between them is only spaces, tabs and line breaks;
+// - their width is what str_width returns, and is not greater than the
+//   maximum, unless the line has a single grapheme cluster;
+// - a line and the first word of the next one would not fit together.
+template <typename CharT>
+static void test_properties(int max_width, const std::basic_string<CharT>& str, bool hard_breaks)
+{
+    std::vector<string_width::line_span<CharT>> lines(str.size() + 1);
+    const auto count = string_width::wrap_lines
+        (max_width, str.data(), str.size(), lines.data(), lines.size(), hard_breaks);
+    std::vector<const CharT*> boundaries;
+    for (auto& c: string_width::grapheme_clusters<CharT>(str.data(), str.size())) {
+        boundaries.push_back(c.begin);
+    }
+    boundaries.push_back(str.data() + str.size());
+    auto is_boundary = [&](const CharT* p) {
+        for (auto b: boundaries) {
+            if (b == p) {
+                return true;
+            }
+        }
+        return false;
+    };
+    auto is_blank = [](const CharT* b, const CharT* e) {
+        for (; b != e; ++b) {
+            if (*b != ' ' && *b != '\t' && *b != '\r' && *b != '\n') {
+                return false;
+            }
+        }
+        return true;
+    };
+    const CharT* prev_end = str.data();
+    bool ok = count <= lines.size();
+    for (std::size_t i = 0; ok && i < count; ++i) {
+        const auto& l = lines[i];
+        const auto len = static_cast<std::size_t>(l.end - l.begin);
+        const auto width = string_width::str_width(1 << 30, l.begin, len);
+        const auto first_cluster_width = len == 0 ? 0
+            : string_width::grapheme_clusters<CharT>(l.begin, len).begin()->width;
+        ok = l.begin >= prev_end && l.end >= l.begin
+            && is_boundary(l.begin) && is_boundary(l.end)
+            && is_blank(prev_end, l.begin)
+            && width == l.width
+            && (width <= max_width || width == first_cluster_width);
+        if (ok && i + 1 < count && l.end != l.begin && ! is_blank(l.end, lines[i + 1].begin)) {
+            ok = false;
+        }
+        if (ok && i + 1 < count && is_blank(l.end, lines[i + 1].begin)) {
+            bool hard_break = false;
+            for (auto p = l.end; p != lines[i + 1].begin; ++p) {
+                hard_break = hard_break || (hard_breaks && (*p == '\r' || *p == '\n'));
+            }
+            if (! hard_break && l.end != lines[i + 1].begin) {
+                // it was broken at spaces, so the next word
+                // would not fit in this line
+                const auto& next = lines[i + 1];
+                const auto next_len = static_cast<std::size_t>(next.end - next.begin);
+                string_width::width_t word = 0;
+                for (auto& c: string_width::grapheme_clusters<CharT>(next.begin, next_len)) {
+                    if (c.end - c.begin == 1 && (*c.begin == ' ' || *c.begin == '\t')) {
+                        break;
+                    }
+                    word += c.width;
+                }
+                const auto gap = string_width::str_width
+                    (1 << 30, l.end, static_cast<std::size_t>(next.begin - l.end));
+                ok = l.width + gap + word > max_width;
+            }
+        }
+        prev_end = l.end;
+    }
+    ok = ok && is_blank(prev_end, str.data() + str.size());
+    if (! ok) {
+        ++failures;
+        std::printf( "failure ( sizeof(CharT) == %d, length %d, max_width %d )\n"
+                   , (int)sizeof(CharT), (int)str.size(), max_width );
+    }
+}
+
+int main()
+{
+    TEST(10, "", {});
+    TEST(10, "abc", {"abc"});
+    TEST(10, "   ", {"   "});
+    TEST(10, "abc   ", {"abc"});
+    TEST(7, "aaa bbb ccc", {"aaa bbb", "ccc"});
+    TEST(6, "aaa bbb ccc", {"aaa", "bbb", "ccc"});
+    TEST(3, "aaa    bbb", {"aaa", "bbb"});
+    TEST(4, "abcdefghij", {"abcd", "efgh", "ij"});
+    TEST(4, "ab cdefghij", {"ab", "cdef", "ghij"});
+    TEST(5, "  ab cd ef", {"  ab", "cd ef"});
+    TEST(10, "ab\ncd\r\nef\rgh", {"ab", "cd", "ef", "gh"});
+    TEST(10, "ab\n\ncd\n", {"ab", "", "cd"});
+    TEST(10, "ab  \n  cd", {"ab", "  cd"});
+    TEST(2, "   ab", {"  ", " a", "b"});
+    TEST(10, "  \n  ab", {"  ab"}, false);
+    TEST(10, "ab\ncd", {"ab\ncd"}, false);
+    TEST(2, "ab\ncd", {"ab", "cd"}, false);
+    TEST(3, "a\tb\tc", {"a\tb", "c"});
+    // grapheme clusters are never split
+    TEST(2, "e\xCC\x81" "e\xCC\x81" "e\xCC\x81", {"e\xCC\x81" "e\xCC\x81", "e\xCC\x81"});
+    TEST(3, "\xE6\xBC\xA2\xE5\xAD\x97\xE6\xBC\xA2", {"\xE6\xBC\xA2", "\xE5\xAD\x97", "\xE6\xBC\xA2"});
+    TEST(1, "\xE6\xBC\xA2\xE5\xAD\x97", {"\xE6\xBC\xA2", "\xE5\xAD\x97"});
+    TEST(2, "\xF0\x9F\x87\xA7\xF0\x9F\x87\xB7\xF0\x9F\x87\xA7\xF0\x9F\x87\xB7"
+            "\xF0\x9F\x87\xA7\xF0\x9F\x87\xB7"
+         , { "\xF0\x9F\x87\xA7\xF0\x9F\x87\xB7\xF0\x9F\x87\xA7\xF0\x9F\x87\xB7"
+           , "\xF0\x9F\x87\xA7\xF0\x9F\x87\xB7" } );
+
+    {
+        const char16_t str[] = u"ab cd \u6F22\u5B57";
+        string_width::line_span<char16_t> lines[2];
+        auto count = string_width::wrap_lines(4, str, 8, lines, 2);
+        if ( count != 3 || lines[0].end - lines[0].begin != 2 || lines[0].width != 2
+          || lines[1].begin != str + 3 || lines[1].width != 2 ) {
+            ++failures;
+            std::printf("failure with char16_t\n");
+        }
+    }
+
+    const char* const pieces[] = {
+        "a", "bcd", " ", "  ", "\t", "\r\n", "\n", "\r",
+        "\xC3\xA9",          // U+00E9
+        "\xCC\x81",          // U+0301 extend
+        "\xD8\x80",          // U+0600 prepend
+        "\xE6\xBC\xA2",      // U+6F22 wide
+        "\xF0\x9F\x91\xA9\xE2\x80\x8D\xF0\x9F\x92\xBB", // emoji ZWJ sequence
+        "\xF0\x9F\x87\xA7",  // U+1F1E7 regional indicator
+        "\xFF"
+    };
+    const char32_t pieces32[] = { U'a', U' ', U'\n', 0x0301, 0x6F22, 0x1F1E7 };
+    std::mt19937 rng(24680);
+    for (int n = 0; n < 3000; ++n) {
+        std::string str;
+        std::u32string str32;
+        const auto count = rng() % 30;
+        for (unsigned i = 0; i < count; ++i) {
+            str += pieces[rng() % (sizeof(pieces) / sizeof(pieces[0]))];
+            str32 += pieces32[rng() % (sizeof(pieces32) / sizeof(pieces32[0]))];
+        }
+        const int max_width = 1 + static_cast<int>(rng() % 12);
+        test_properties(max_width, str, n % 2 == 0);
+        test_properties(max_width, str32, n % 2 == 0);
+    }
+
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
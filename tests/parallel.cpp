@@ -0,0 +1,129 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width/parallel.hpp>
+#include <string>
+#include <random>
+#include <cstdio>
+
+// Checks that parallel_str_width and parallel_str_width_and_pos give the
+// same results as str_width and str_width_and_pos, splitting the strings
+// into many small parts, with new threads and with a worker_pool.
+
+static void append_utf8(std::string& dest, char32_t ch)
+{
+    if (ch < 0x80) {
+        dest.push_back(static_cast<char>(ch));
+    } else if (ch < 0x800) {
+        dest.push_back(static_cast<char>(0xC0 | (ch >> 6)));
+        dest.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+    } else if (ch < 0x10000) {
+        dest.push_back(static_cast<char>(0xE0 | (ch >> 12)));
+        dest.push_back(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
+        dest.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+    } else {
+        dest.push_back(static_cast<char>(0xF0 | (ch >> 18)));
+        dest.push_back(static_cast<char>(0x80 | ((ch >> 12) & 0x3F)));
+        dest.push_back(static_cast<char>(0x80 | ((ch >> 6) & 0x3F)));
+        dest.push_back(static_cast<char>(0x80 | (ch & 0x3F)));
+    }
+}
+
+static void append_utf16(std::u16string& dest, char32_t ch)
+{
+    if (ch < 0x10000) {
+        dest.push_back(static_cast<char16_t>(ch));
+    } else {
+        dest.push_back(static_cast<char16_t>(0xD7C0 + (ch >> 10)));
+        dest.push_back(static_cast<char16_t>(0xDC00 + (ch & 0x3FF)));
+    }
+}
+
+static int failures = 0;
+
+static string_width::worker_pool pool(3);
+
+template <typename CharT>
+static void test(const std::basic_string<CharT>& str)
+{
+    const string_width::surrogate_policy policies[] =
+        { string_width::surrogate_policy::strict, string_width::surrogate_policy::lax };
+    const std::size_t part_lengths[] = {1, 16};
+    for (auto surr_poli: policies) {
+        const auto total = string_width::str_width(1 << 30, str.data(), str.size(), surr_poli);
+        for (auto part_len: part_lengths) {
+            for (int limit = -1; limit <= total + 1; limit += (limit < 12 ? 1 : 5)) {
+                auto w = string_width::str_width(limit, str.data(), str.size(), surr_poli);
+                auto r = string_width::str_width_and_pos(limit, str.data(), str.size(), surr_poli);
+                auto pw = string_width::parallel_str_width
+                    (limit, str.data(), str.size(), surr_poli, 6, part_len);
+                auto pr = string_width::parallel_str_width_and_pos
+                    (limit, str.data(), str.size(), surr_poli, 6, part_len);
+                if (w != pw || r.width != pr.width || r.pos != pr.pos) {
+                    ++failures;
+                    std::printf( "failure ( sizeof(CharT) == %d, length %d, limit %d, part length %d ):"
+                                 " %d, {%d, %d} (expected %d, {%d, %d})\n"
+                               , (int)sizeof(CharT), (int)str.size(), limit, (int)part_len
+                               , pw, pr.width, (int)pr.pos, w, r.width, (int)r.pos );
+                }
+                pw = string_width::parallel_str_width
+                    (pool, limit, str.data(), str.size(), surr_poli, part_len);
+                pr = string_width::parallel_str_width_and_pos
+                    (pool, limit, str.data(), str.size(), surr_poli, part_len);
+                if (w != pw || r.width != pr.width || r.pos != pr.pos) {
+                    ++failures;
+                    std::printf( "failure with pool ( sizeof(CharT) == %d, length %d, limit %d, "
+                                 "part length %d ): %d, {%d, %d} (expected %d, {%d, %d})\n"
+                               , (int)sizeof(CharT), (int)str.size(), limit, (int)part_len
+                               , pw, pr.width, (int)pr.pos, w, r.width, (int)r.pos );
+                }
+            }
+        }
+    }
+}
+
+int main()
+{
+    const std::u32string pieces[] = {
+        U"a", U"bc", U" ", U"\r", U"\n", U"\r\n", U"\t", U"\u00E9", U"\u0301"
+      , U"\u0600", U"\u0600\u0600", U"\u0903", U"\u200D", U"\u6F22", U"\U0001F469"
+      , U"\U0001F469\u200D\U0001F4BB", U"\U0001F1E7", U"\U0001F1E7\U0001F1F7\U0001F1E7"
+      , U"\u1100", U"\u1160", U"\u11A8", U"\uAC00", U"\uAC01", U"\U000E0001"
+      , std::u32string(1, (char32_t)0xD800), std::u32string(1, (char32_t)0xDC00)
+      , std::u32string(1, (char32_t)0x110000)
+    };
+    const std::size_t pieces_count = sizeof(pieces) / sizeof(pieces[0]);
+    const char* const invalid_utf8[] = { "\xED\xA0\x80", "\xE0\x9F\x80", "\xF0\x90\x80", "\x80", "\xFF" };
+
+    std::mt19937 rng(4321);
+    for (int n = 0; n < 100; ++n) {
+        std::u32string str32;
+        std::string str8;
+        std::u16string str16;
+        const auto count = 1 + rng() % 120;
+        for (unsigned i = 0; i < count; ++i) {
+            const auto& piece = pieces[rng() % pieces_count];
+            str32 += piece;
+            for (auto ch: piece) {
+                if (ch < 0x110000) {
+                    append_utf8(str8, ch);
+                    append_utf16(str16, ch);
+                } else {
+                    str8 += invalid_utf8[rng() % 5];
+                }
+            }
+        }
+        test(str8);
+        test(str16);
+        test(str32);
+    }
+    // long sequences with no split point
+    test(std::u32string(200, U'\U0001F1E7'));
+    test(std::u32string(200, U'\u0301'));
+
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
@@ -0,0 +1,91 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdio>
+
+// Forces each simd_level supported by the CPU and checks that the
+// kernels give the same results as the scalar ones.
+
+static int failures = 0;
+
+static const char* level_name(string_width::simd_level level)
+{
+    switch (level) {
+        case string_width::simd_level::scalar: return "scalar";
+        case string_width::simd_level::sse2:   return "sse2";
+        case string_width::simd_level::sse4_2: return "sse4.2";
+        case string_width::simd_level::avx2:   return "avx2";
+        case string_width::simd_level::avx512: return "avx512";
+    }
+    return "?";
+}
+
+int main()
+{
+    const auto detected = string_width::detected_simd_level();
+    std::printf("detected simd level: %s\n", level_name(detected));
+    if (string_width::active_simd_level() != detected) {
+        ++failures;
+        std::printf("the active level is not the detected one\n");
+    }
+
+    std::mt19937 rng(8642);
+    std::vector<std::vector<std::uint8_t>> buffers;
+    std::vector<std::string> strings;
+    const std::uint8_t stoppers[] = {0x00, 0x09, 0x1F, 0x7F, 0x80, 0xC3, 0xFF};
+    for (int n = 0; n < 2000; ++n) {
+        std::vector<std::uint8_t> buff(rng() % 300);
+        for (auto& ch: buff) {
+            ch = static_cast<std::uint8_t>(0x20 + rng() % 0x5F);
+        }
+        if (! buff.empty() && rng() % 4 != 0) {
+            buff[rng() % buff.size()] = stoppers[rng() % sizeof(stoppers)];
+        }
+        buffers.push_back(buff);
+        strings.emplace_back(buff.begin(), buff.end());
+        strings.back() += "\xE6\xBC\xA2" "abc\xCC\x81" " def";
+    }
+
+    const string_width::simd_level levels[] = {
+        string_width::simd_level::scalar,
+        string_width::simd_level::sse2,
+        string_width::simd_level::sse4_2,
+        string_width::simd_level::avx2,
+        string_width::simd_level::avx512 };
+
+    for (auto level: levels) {
+        const auto set = string_width::set_simd_level(level);
+        const auto expected_set = level > detected ? detected : level;
+        if (set != expected_set || string_width::active_simd_level() != expected_set) {
+            ++failures;
+            std::printf("failed to set level %s\n", level_name(level));
+        }
+        for (std::size_t i = 0; i < buffers.size(); ++i) {
+            const auto* begin = buffers[i].data();
+            const auto* end = begin + buffers[i].size();
+            const auto len = string_width::detail::printable_ascii_run_length(begin, end);
+            const auto expected_len = string_width::detail::printable_ascii_run_length_scalar(begin, end);
+            const auto& str = strings[i];
+            const int width = string_width::str_width(1 << 30, str.data(), str.size());
+            string_width::set_simd_level(string_width::simd_level::scalar);
+            const int expected_width = string_width::str_width(1 << 30, str.data(), str.size());
+            string_width::set_simd_level(level);
+            if (len != expected_len || width != expected_width) {
+                ++failures;
+                std::printf( "failure at level %s with buffer %d: %d ( expected %d )\n"
+                           , level_name(set), (int)i, (int)len, (int)expected_len );
+            }
+        }
+    }
+    string_width::set_simd_level(detected);
+
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
@@ -0,0 +1,128 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdio>
+
+// Checks that str_width_stream gives the same result as str_width_and_pos
+// when the string is split into pieces in many different ways.
+
+static int failures = 0;
+static std::mt19937 rng(9876);
+
+template <typename CharT>
+static string_width::width_and_pos measure_in_pieces
+    ( int limit
+    , const std::basic_string<CharT>& str
+    , const std::vector<std::size_t>& cuts
+    , string_width::surrogate_policy surr_poli )
+{
+    string_width::str_width_stream<CharT> stream(limit, surr_poli);
+    std::size_t prev = 0;
+    for (auto cut: cuts) {
+        stream.feed(str.data() + prev, cut - prev);
+        prev = cut;
+    }
+    stream.feed(str.data() + prev, str.size() - prev);
+    return stream.finish();
+}
+
+template <typename CharT>
+static void test(const std::basic_string<CharT>& str)
+{
+    const string_width::surrogate_policy policies[] =
+        { string_width::surrogate_policy::strict, string_width::surrogate_policy::lax };
+    for (auto surr_poli: policies) {
+        const int total = string_width::str_width(100000, str.data(), str.size(), surr_poli);
+        std::vector<std::vector<std::size_t>> splits;
+        splits.push_back({});
+        std::vector<std::size_t> all;
+        for (std::size_t i = 0; i <= str.size(); ++i) {
+            all.push_back(i);   // including empty pieces
+            splits.push_back({i});
+        }
+        splits.push_back(all);
+        for (int n = 0; n < 10; ++n) {
+            std::vector<std::size_t> cuts;
+            for (std::size_t i = rng() % 4; i < str.size(); i += 1 + rng() % 4) {
+                cuts.push_back(i);
+            }
+            splits.push_back(cuts);
+        }
+        for (int limit = -1; limit <= total + 1; ++limit) {
+            auto expected = string_width::str_width_and_pos(limit, str.data(), str.size(), surr_poli);
+            for (auto& cuts: splits) {
+                auto res = measure_in_pieces(limit, str, cuts, surr_poli);
+                if (res.width != expected.width || res.pos != expected.pos) {
+                    ++failures;
+                    std::printf( "failure ( sizeof(CharT) == %d, length %d, limit %d, %d cuts ):"
+                                 " {%d, %d} (expected {%d, %d})\n"
+                               , (int)sizeof(CharT), (int)str.size(), limit, (int)cuts.size()
+                               , res.width, (int)res.pos, expected.width, (int)expected.pos );
+                }
+            }
+        }
+    }
+}
+
+int main()
+{
+    const char* const pieces[] = {
+        "a", "bc", "\r", "\n", "\t",
+        "\xC3\xA9",          // U+00E9
+        "\xCC\x81",          // U+0301 extend
+        "\xD8\x80",          // U+0600 prepend
+        "\xE2\x80\x8D",      // U+200D zwj
+        "\xE1\x84\x80",      // U+1100 hangul L
+        "\xEA\xB0\x80",      // U+AC00 hangul LV
+        "\xE6\xBC\xA2",      // U+6F22 wide
+        "\xF0\x9F\x98\x80",  // U+1F600 extended pictographic
+        "\xF0\x9F\x87\xA7",  // U+1F1E7 regional indicator
+        "\xED\xA0\x80",      // surrogate
+        "\xE0\x9F\x80",      // overlong
+        "\xF4\x90\x80\x80",  // too large
+        "\xE0\xA0", "\xF0\x90\x80", "\xC3", "\x80", "\xFF"
+    };
+    const std::size_t pieces_count = sizeof(pieces) / sizeof(pieces[0]);
+    const char16_t pieces16[] = { u'a', u'b', 0x0301, 0x0600, 0x6F22, 0xD83D, 0xDE00, 0xD800, 0xDC00, u'\r', u'\n' };
+    const char32_t pieces32[] = { U'a', U'b', 0x0301, 0x0600, 0x6F22, 0x1F600, 0x1F1E7, 0x110000, U'\r', U'\n' };
+
+    for (int n = 0; n < 400; ++n) {
+        std::string str;
+        std::u16string str16;
+        std::u32string str32;
+        const auto count = rng() % 10;
+        for (unsigned i = 0; i < count; ++i) {
+            str += pieces[rng() % pieces_count];
+            str16 += pieces16[rng() % (sizeof(pieces16) / sizeof(pieces16[0]))];
+            str32 += pieces32[rng() % (sizeof(pieces32) / sizeof(pieces32[0]))];
+        }
+        test(str);
+        test(str16);
+        test(str32);
+    }
+    {
+        // the result does not change after the limit is reached
+        string_width::str_width_stream<char> stream(3);
+        stream.feed("ab", 2);
+        const bool reached_early = stream.limit_reached();
+        stream.feed("cd", 2);
+        const bool reached = stream.limit_reached();
+        stream.feed("ef", 2);
+        auto res = stream.finish();
+        if (reached_early || ! reached || res.width != 3 || res.pos != 3) {
+            ++failures;
+            std::printf( "stream past the limit: limit_reached %d, %d, width %d, pos %d "
+                         "( expected 0, 1, 3, 3 )\n"
+                       , (int)reached_early, (int)reached, res.width, (int)res.pos );
+        }
+    }
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
@@ -0,0 +1,153 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width/table.hpp>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdio>
+
+// Compares the output of table_layout with the one of a straightforward
+// implementation based on str_truncate and str_width.
+
+static int failures = 0;
+
+template <typename CharT>
+static std::basic_string<CharT> render(const string_width::table_layout<CharT>& table)
+{
+    std::basic_string<CharT> out;
+    table.write([&](const CharT* str, std::size_t len) { out.append(str, len); });
+    return out;
+}
+
+template <typename CharT>
+static std::basic_string<CharT> reference
+    ( const std::vector<std::basic_string<CharT>>& cells
+    , const std::vector<int>& max_widths
+    , const std::vector<string_width::table_align>& aligns
+    , const std::basic_string<CharT>& ellipsis
+    , const std::basic_string<CharT>& separator )
+{
+    const std::size_t cols = max_widths.size();
+    std::vector<std::basic_string<CharT>> texts;
+    std::vector<int> widths(cols, 0);
+    for (std::size_t i = 0; i < cells.size(); ++i) {
+        CharT buff[200];
+        auto res = string_width::str_truncate
+            ( max_widths[i % cols], cells[i].data(), cells[i].size(), buff, 200
+            , ellipsis.data(), ellipsis.size() );
+        texts.emplace_back(buff, res.size);
+        widths[i % cols] = std::max(widths[i % cols], res.width);
+    }
+    while (texts.size() % cols != 0) {
+        texts.emplace_back();
+    }
+    std::basic_string<CharT> out;
+    for (std::size_t i = 0; i < texts.size(); ++i) {
+        const auto c = i % cols;
+        if (c != 0) {
+            out += separator;
+        }
+        const int w = string_width::str_width(1 << 30, texts[i].data(), texts[i].size());
+        const int padding = widths[c] - w;
+        int left = aligns[c] == string_width::table_align::right ? padding
+                 : aligns[c] == string_width::table_align::center ? padding / 2
+                 : 0;
+        int right = padding - left;
+        if (c + 1 == cols && aligns[c] == string_width::table_align::left) {
+            right = 0;
+        }
+        out.append(left, ' ');
+        out += texts[i];
+        out.append(right, ' ');
+        if (c + 1 == cols) {
+            out += '\n';
+        }
+    }
+    return out;
+}
+
+int main()
+{
+    {
+        string_width::table_layout<char> table(3);
+        table.set_column(0, 1 << 20, string_width::table_align::right);
+        table.set_column(1, 6);
+        table.set_column(2, 1 << 20, string_width::table_align::center);
+        table.set_ellipsis("~", 1);
+        table.set_separator(" | ", 3);
+        const char* row0[] = {"1", "apples", "x"};
+        const char* row1[] = {"200", "\xE6\xBC\xA2\xE5\xAD\x97\xE6\xBC\xA2\xE5\xAD\x97", "yyy"};
+        const std::size_t lens0[] = {1, 6, 1};
+        const std::size_t lens1[] = {3, 12, 3};
+        table.add_row(row0, lens0);
+        table.add_row(row1, lens1);
+        table.add_cell("", 0);
+        const std::string expected =
+            "  1 | apples |  x \n"
+            "200 | \xE6\xBC\xA2\xE5\xAD\x97~  | yyy\n"
+            "    |        |    \n";
+        if (render(table) != expected || table.rows_count() != 3 || table.column_width(1) != 6) {
+            ++failures;
+            std::printf("failure:\n%s", render(table).c_str());
+        }
+    }
+
+    const char* const pieces[] = {
+        "a", "bcd", " ", "\t",
+        "\xC3\xA9",          // U+00E9
+        "\xCC\x81",          // U+0301 extend
+        "\xE6\xBC\xA2",      // U+6F22 wide
+        "\xF0\x9F\x87\xA7",  // U+1F1E7 regional indicator
+        "\xFF"
+    };
+    const char* const ellipses[] = {"", "...", "\xE2\x80\xA6"};
+    const string_width::table_align aligns_all[] = {
+        string_width::table_align::left,
+        string_width::table_align::right,
+        string_width::table_align::center };
+    std::mt19937 rng(13579);
+    for (int n = 0; n < 300; ++n) {
+        const std::size_t cols = 1 + rng() % 4;
+        const std::string ellipsis = ellipses[rng() % 3];
+        const std::string separator = n % 2 ? " " : "||";
+        std::vector<int> max_widths;
+        std::vector<string_width::table_align> aligns;
+        string_width::table_layout<char> table(cols);
+        for (std::size_t c = 0; c < cols; ++c) {
+            max_widths.push_back(rng() % 3 == 0 ? 1 << 20 : static_cast<int>(rng() % 8));
+            aligns.push_back(aligns_all[rng() % 3]);
+            table.set_column(c, max_widths.back(), aligns.back());
+        }
+        table.set_ellipsis(ellipsis.data(), ellipsis.size());
+        table.set_separator(separator.data(), separator.size());
+        std::vector<std::string> cells(rng() % 20);
+        for (auto& cell: cells) {
+            const auto count = rng() % 8;
+            for (unsigned i = 0; i < count; ++i) {
+                cell += pieces[rng() % (sizeof(pieces) / sizeof(pieces[0]))];
+            }
+            table.add_cell(cell.data(), cell.size());
+        }
+        if (render(table) != reference(cells, max_widths, aligns, ellipsis, separator)) {
+            ++failures;
+            std::printf("failure ( columns %d, cells %d )\n", (int)cols, (int)cells.size());
+        }
+    }
+    {
+        string_width::table_layout<char32_t> table(2);
+        table.set_column(0, 3);
+        table.add_cell(U"\u6F22\u5B57", 2);
+        table.add_cell(U"ab", 2);
+        if (render(table) != U"\u6F22 ab\n") {
+            ++failures;
+            std::printf("failure with char32_t\n");
+        }
+    }
+
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
@@ -0,0 +1,104 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <string>
+#include <set>
+#include <vector>
+#include <random>
+#include <cstdio>
+
+// Compares str_tail_width_and_pos against a forward search
+// of the longest suffix that fits.
+
+static int failures = 0;
+
+template <typename CharT>
+static void test(const std::basic_string<CharT>& str, string_width::surrogate_policy surr_poli)
+{
+    const auto big = 1 << 30;
+    const auto total = string_width::str_width(big, str.data(), str.size(), surr_poli);
+
+    // grapheme cluster boundaries
+    std::set<std::size_t> boundaries = {0};
+    for (int limit = 1; limit <= total; ++limit) {
+        boundaries.insert(string_width::str_width_and_pos(limit, str.data(), str.size(), surr_poli).pos);
+    }
+    std::vector<string_width::width_and_pos> suffixes;
+    for (auto b: boundaries) {
+        suffixes.push_back({total - string_width::str_width(big, str.data(), b, surr_poli), b});
+    }
+    for (int limit = -1; limit <= total + 1; ++limit) {
+        string_width::width_and_pos expected{0, str.size()};
+        for (auto& suffix: suffixes) {
+            if (suffix.width <= limit) {
+                expected = suffix;
+                break;
+            }
+        }
+        auto res = string_width::str_tail_width_and_pos(limit, str.data(), str.size(), surr_poli);
+        if (res.width != expected.width || res.pos != expected.pos) {
+            ++failures;
+            std::printf( "failure ( sizeof(CharT) == %d, length %d, limit %d ):"
+                         " {%d, %d} (expected {%d, %d})\n"
+                       , (int)sizeof(CharT), (int)str.size(), limit
+                       , res.width, (int)res.pos, expected.width, (int)expected.pos );
+        }
+    }
+}
+
+int main()
+{
+    const char* const pieces[] = {
+        "a", "bcdefghijklmnopqrstuvwxyz0123456789", "\r", "\n", "\t",
+        "\xC3\xA9",          // U+00E9
+        "\xCC\x81",          // U+0301 extend
+        "\xCC\x81\xCC\x81\xCC\x81\xCC\x81\xCC\x81\xCC\x81\xCC\x81\xCC\x81",
+        "\xD8\x80",          // U+0600 prepend
+        "\xE0\xA4\x83",      // U+0903 spacing mark
+        "\xE2\x80\x8D",      // U+200D zwj
+        "\xE1\x84\x80",      // U+1100 hangul L
+        "\xE1\x85\xA0",      // U+1160 hangul V
+        "\xEA\xB0\x81",      // U+AC01 hangul LVT
+        "\xE6\xBC\xA2",      // U+6F22 wide
+        "\xF0\x9F\x98\x80",  // U+1F600 extended pictographic
+        "\xF0\x9F\x91\xA9\xE2\x80\x8D\xF0\x9F\x92\xBB", // emoji ZWJ sequence
+        "\xF0\x9F\x87\xA7",  // U+1F1E7 regional indicator
+        "\xF0\x9F\x87\xA7\xF0\x9F\x87\xA7\xF0\x9F\x87\xA7\xF0\x9F\x87\xA7\xF0\x9F\x87\xA7",
+        "\xED\xA0\x80", "\xE0\x9F\x80", "\xF0\x90\x80", "\x80", "\xFF"
+    };
+    const std::size_t pieces_count = sizeof(pieces) / sizeof(pieces[0]);
+    const char16_t pieces16[] = { u'a', 0x0301, 0x0600, 0x200D, 0x1100, 0xAC00, 0x6F22, 0xD83C, 0xDDE7, 0xD800, u'\r', u'\n' };
+    const char32_t pieces32[] = { U'a', 0x0301, 0x0600, 0x200D, 0x1100, 0xAC01, 0x6F22, 0x1F469, 0x1F1E7, 0x110000, U'\r', U'\n' };
+
+    std::mt19937 rng(8642);
+    for (int n = 0; n < 600; ++n) {
+        std::string str;
+        std::u16string str16;
+        std::u32string str32;
+        const auto count = rng() % 40;
+        for (unsigned i = 0; i < count; ++i) {
+            str += pieces[rng() % pieces_count];
+        }
+        for (unsigned i = 0; i < count * 4; ++i) {
+            str16 += pieces16[rng() % (sizeof(pieces16) / sizeof(pieces16[0]))];
+            str32 += pieces32[rng() % (sizeof(pieces32) / sizeof(pieces32[0]))];
+        }
+        for (auto surr_poli: {string_width::surrogate_policy::strict, string_width::surrogate_policy::lax}) {
+            test(str, surr_poli);
+            test(str16, surr_poli);
+            test(str32, surr_poli);
+        }
+    }
+    // long sequences without points where the string can be split
+    test(std::u32string(301, U'\U0001F1E7'), string_width::surrogate_policy::strict);
+    test(U"a" + std::u32string(300, U'\U0001F1E7'), string_width::surrogate_policy::strict);
+    test(U"\U0001F469" + std::u32string(200, 0x200D) + U"\U0001F4BB", string_width::surrogate_policy::strict);
+    test(std::u32string(150, 0x0600) + U"abc", string_width::surrogate_policy::strict);
+
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
@@ -0,0 +1,132 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <string_width/grapheme_clusters.hpp>
+#include <string>
+#include <random>
+#include <cstdio>
+#include <cassert>
+
+// Compares str_truncate against a reference implementation
+// based on grapheme_clusters.
+
+static int failures = 0;
+
+template <typename CharT>
+static std::basic_string<CharT> reference
+    ( int limit
+    , const std::basic_string<CharT>& str
+    , const std::basic_string<CharT>& ellipsis
+    , int& width )
+{
+    const int big = 1 << 30;
+    const auto total = string_width::str_width(big, str.data(), str.size());
+    if (total <= (limit < 0 ? 0 : limit)) {
+        width = total;
+        return str;
+    }
+    const auto ellipsis_width = string_width::str_width(big, ellipsis.data(), ellipsis.size());
+    const bool use_ellipsis = ellipsis_width <= limit;
+    const int prefix_limit = use_ellipsis ? limit - ellipsis_width : (limit < 0 ? 0 : limit);
+    width = 0;
+    std::basic_string<CharT> result;
+    for (auto& c: string_width::grapheme_clusters<CharT>(str.data(), str.size())) {
+        if (width + c.width > prefix_limit) {
+            break;
+        }
+        width += c.width;
+        result.append(c.begin, c.end);
+    }
+    if (use_ellipsis) {
+        result += ellipsis;
+        width += ellipsis_width;
+    }
+    return result;
+}
+
+template <typename CharT>
+static void test(const std::basic_string<CharT>& str, const std::basic_string<CharT>& ellipsis)
+{
+    const auto total = string_width::str_width(1 << 30, str.data(), str.size());
+    for (int limit = -1; limit <= total + 1; ++limit) {
+        int expected_width = 0;
+        const auto expected = reference(limit, str, ellipsis, expected_width);
+        CharT buff[200];
+        auto res = string_width::str_truncate
+            ( limit, str.data(), str.size(), buff, sizeof(buff) / sizeof(buff[0])
+            , ellipsis.data(), ellipsis.size() );
+        const std::basic_string<CharT> result(buff, res.size);
+        if ( res.width != expected_width || result != expected
+          || res.truncated != (expected != str) ) {
+            ++failures;
+            std::printf( "failure ( sizeof(CharT) == %d, length %d, limit %d ):"
+                         " width %d, size %d ( expected %d, %d )\n"
+                       , (int)sizeof(CharT), (int)str.size(), limit
+                       , res.width, (int)res.size, expected_width, (int)expected.size() );
+        }
+        // not enough space
+        if (res.size > 0) {
+            buff[0] = 0;
+            auto res2 = string_width::str_truncate
+                ( limit, str.data(), str.size(), buff, res.size - 1
+                , ellipsis.data(), ellipsis.size() );
+            if (res2.size != res.size || res2.width != res.width || buff[0] != 0) {
+                ++failures;
+                std::printf("failure when the destination is too small\n");
+            }
+        }
+    }
+}
+
+int main()
+{
+    const char* const pieces[] = {
+        "a", "bcd", "\r\n", "\t",
+        "\xC3\xA9",          // U+00E9
+        "\xCC\x81",          // U+0301 extend
+        "\xD8\x80",          // U+0600 prepend
+        "\xE2\x80\x8D",      // U+200D zwj
+        "\xEA\xB0\x81",      // U+AC01 hangul LVT
+        "\xE6\xBC\xA2",      // U+6F22 wide
+        "\xF0\x9F\x91\xA9\xE2\x80\x8D\xF0\x9F\x92\xBB", // emoji ZWJ sequence
+        "\xF0\x9F\x87\xA7",  // U+1F1E7 regional indicator
+        "\xE0\x9F\x80", "\xFF"
+    };
+    const std::size_t pieces_count = sizeof(pieces) / sizeof(pieces[0]);
+    const char* const ellipses[] = {"", ".", "...", "\xE2\x80\xA6", "\xE2\x8B\xAF\xE2\x8B\xAF"};
+    const char16_t pieces16[] = { u'a', 0x0301, 0x0600, 0x200D, 0xAC00, 0x6F22, 0xD83C, 0xDDE7, 0xD800 };
+    const char32_t pieces32[] = { U'a', 0x0301, 0x0600, 0x200D, 0xAC01, 0x6F22, 0x1F469, 0x1F1E7, 0x110000 };
+
+    std::mt19937 rng(97531);
+    for (int n = 0; n < 500; ++n) {
+        std::string str;
+        std::u16string str16;
+        std::u32string str32;
+        const auto count = rng() % 12;
+        for (unsigned i = 0; i < count; ++i) {
+            str += pieces[rng() % pieces_count];
+            str16 += pieces16[rng() % (sizeof(pieces16) / sizeof(pieces16[0]))];
+            str32 += pieces32[rng() % (sizeof(pieces32) / sizeof(pieces32[0]))];
+        }
+        for (auto e: ellipses) {
+            test(str, std::string(e));
+        }
+        test(str16, std::u16string(u"…"));
+        test(str32, std::u32string(U"。。"));
+    }
+    {
+        char buff[16];
+        const char str[] = "Hello world";
+        auto res = string_width::str_truncate(8, str, 11, buff, sizeof(buff), "...", 3);
+        assert(res.truncated && res.width == 8 && res.size == 8);
+        assert(std::string(buff, res.size) == "Hello...");
+        res = string_width::str_truncate(11, str, 11, buff, sizeof(buff), "...", 3);
+        assert(! res.truncated && res.width == 11 && res.size == 11);
+    }
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
@@ -0,0 +1,139 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdio>
+
+// Compares the UTF-16 engine ( which measures runs of ASCII characters,
+// CJK ideographs and Hangul syllables in bulk ) against decode() and
+// the width decrementers, at each simd_level supported by the CPU.
+
+static int failures = 0;
+
+static void check_props_of_wide_ranges()
+{
+    using namespace string_width::detail;
+    for (std::uint32_t ch = 0; ch < 0x10000; ++ch) {
+        if (! is_wide_bmp(ch)) {
+            continue;
+        }
+        const auto props = ch32_props(static_cast<char32_t>(ch));
+        const auto cat = props & prop::category_mask;
+        const bool cat_ok = ch < 0xAC00
+            ? cat == prop::other
+            : cat == prop::hangul_lv || cat == prop::hangul_lvt;
+        if (! (props & prop::double_width) || ! cat_ok) {
+            ++failures;
+            std::printf("U+%04X is not a wide non-joining codepoint\n", (unsigned)ch);
+        }
+    }
+}
+
+static std::u16string random_string(std::mt19937& rng)
+{
+    static const char16_t lone_low[] = {0xDC00, 0};
+    static const char16_t lone_high[] = {0xD800, 0};
+    static const char16_t* const pieces[] = {
+        u"abc", u" ", u"xyzw12345", u"\u4E00", u"\u9FFF", u"\u6F22\u5B57\u6F22",
+        u"\uAC00", u"\uD7A3", u"\uAC01\uB098\uB2E4", u"\u1100", u"\u1161", u"\u11A8",
+        u"\u0600", u"\u0301", u"\u200D", u"\U0001F600", u"\U0001F1E7", lone_low,
+        lone_high, u"\r", u"\n", u"\t", u"\u4DFF", u"\uA000", u"\uABFF", u"\uD7A4" };
+    const std::size_t pieces_count = sizeof(pieces) / sizeof(pieces[0]);
+    std::u16string str;
+    const int n = static_cast<int>(rng() % 40);
+    for (int i = 0; i < n; ++i) {
+        const auto* piece = pieces[rng() % pieces_count];
+        // mostly long runs of wide characters
+        const int repeat = (piece[0] >= 0x4E00 && rng() % 2) ? 1 + rng() % 50 : 1;
+        for (int r = 0; r < repeat; ++r) {
+            str += piece;
+        }
+    }
+    return str;
+}
+
+static void check_string(const std::u16string& str, std::size_t index)
+{
+    const int total = string_width::str_width(1 << 30, str.data(), str.size());
+    const int limits[] = { -1, 0, 1, 2, 3, 4, 5, 6, 7, total / 2, total / 2 + 1
+                         , total - 1, total, total + 1, 1 << 30 };
+    for (int limit: limits) {
+        string_width::detail::std_width_decrementer decr{0};
+        string_width::detail::std_width_decrementer_with_pos decr_with_pos{0};
+        const auto expected_width = string_width::detail::str_width
+            (decr, limit, str.data(), str.size(), string_width::surrogate_policy::strict);
+        const auto expected = string_width::detail::str_width_and_pos
+            (decr_with_pos, limit, str.data(), str.size(), string_width::surrogate_policy::strict);
+        const auto width = string_width::str_width(limit, str.data(), str.size());
+        const auto res = string_width::str_width_and_pos(limit, str.data(), str.size());
+        if ( width != expected_width || res.width != expected.width
+          || res.pos != expected.pos ) {
+            ++failures;
+            std::printf( "string %d, limit %d: width %d, %d, pos %d ( expected %d, %d, %d )\n"
+                       , (int)index, limit, width, res.width, (int)res.pos
+                       , expected_width, expected.width, (int)expected.pos );
+        }
+    }
+}
+
+static void check_kernels(const std::u16string& str, std::size_t index)
+{
+    const auto* begin = reinterpret_cast<const std::uint16_t*>(str.data());
+    const auto* end = begin + str.size();
+    for (const auto* it = begin; it < end; it += 1 + (it - begin) % 7) {
+        using namespace string_width::detail;
+        const auto ascii = printable_ascii_run_length(it, end);
+        const auto wide = wide_bmp_run_length(it, end);
+        if ( ascii != printable_ascii_run_length_u16_scalar(it, end)
+          || wide != wide_bmp_run_length_u16_scalar(it, end) ) {
+            ++failures;
+            std::printf( "string %d, offset %d: wrong run lengths %d, %d\n"
+                       , (int)index, (int)(it - begin), (int)ascii, (int)wide );
+        }
+    }
+}
+
+int main()
+{
+    check_props_of_wide_ranges();
+
+    std::mt19937 rng(1357);
+    std::vector<std::u16string> strings;
+    for (int i = 0; i < 1500; ++i) {
+        strings.push_back(random_string(rng));
+    }
+    // a cluster joins the first or the last character of the run
+    strings.push_back(u"\u0600\u6F22\u5B57\u6F22\u5B57");
+    strings.push_back(u"\u1100\uAC00\uAC00\uAC00\uAC00");
+    strings.push_back(u"\uAC00\uAC00\uAC00\uAC00\u11A8\u11A8");
+    strings.push_back(u"\uAC00\uAC00\uAC00\uAC00\u1161");
+    strings.push_back(u"\u6F22\u5B57\u6F22\u5B57\u0301\u200D");
+    strings.push_back(u"\r\u6F22\u5B57\u6F22\u5B57\r\n");
+
+    const string_width::simd_level levels[] = {
+        string_width::simd_level::scalar,
+        string_width::simd_level::sse2,
+        string_width::simd_level::avx2,
+        string_width::simd_level::avx512 };
+    const auto detected = string_width::detected_simd_level();
+    for (auto level: levels) {
+        if (level > detected) {
+            break;
+        }
+        string_width::set_simd_level(level);
+        for (std::size_t i = 0; i < strings.size(); ++i) {
+            check_string(strings[i], i);
+            check_kernels(strings[i], i);
+        }
+    }
+    string_width::set_simd_level(detected);
+
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
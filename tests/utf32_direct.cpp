@@ -0,0 +1,86 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <cstdio>
+
+// Compares the UTF-32 path ( which passes the string to std_width_calc_func
+// without copying it ) against decode() and the width decrementers, and
+// against the path of the other 4-byte code unit types.
+
+static int failures = 0;
+
+static std::u32string random_string(std::mt19937& rng)
+{
+    static const char32_t pieces[] = {
+        U'a', U' ', U'\r', U'\n', U'\t', 0x0301, 0x200D, 0x0600, 0x0903,
+        0x1100, 0x1161, 0x11A8, 0xAC00, 0x6F22, 0x1F469, 0x1F1E7, 0x1F3FD,
+        0xD800, 0xDC00, 0x10FFFF, 0x110000, 0x7FFFFFFF, 0xFFFFFFFF };
+    const std::size_t pieces_count = sizeof(pieces) / sizeof(pieces[0]);
+    std::u32string str;
+    const int n = static_cast<int>(rng() % 600);
+    for (int i = 0; i < n; ++i) {
+        str += pieces[rng() % pieces_count];
+    }
+    return str;
+}
+
+static void check_string(const std::u32string& str, std::size_t index)
+{
+    const std::vector<std::uint32_t> str_u32(str.begin(), str.end());
+    const int total = string_width::str_width(1 << 30, str.data(), str.size());
+    const int limits[] = { -1, 0, 1, 2, 3, total / 3, total / 2, total / 2 + 1
+                         , total - 1, total, total + 1, 1 << 30 };
+    for (int limit: limits) {
+        string_width::detail::std_width_decrementer decr{0};
+        string_width::detail::std_width_decrementer_with_pos decr_with_pos{0};
+        const auto expected_width = string_width::detail::str_width
+            (decr, limit, str.data(), str.size(), string_width::surrogate_policy::strict);
+        const auto expected = string_width::detail::str_width_and_pos
+            (decr_with_pos, limit, str.data(), str.size(), string_width::surrogate_policy::strict);
+        const auto width = string_width::str_width(limit, str.data(), str.size());
+        const auto res = string_width::str_width_and_pos(limit, str.data(), str.size());
+        if ( width != expected_width || res.width != expected.width
+          || res.pos != expected.pos ) {
+            ++failures;
+            std::printf( "string %d, limit %d: width %d, %d, pos %d ( expected %d, %d, %d )\n"
+                       , (int)index, limit, width, res.width, (int)res.pos
+                       , expected_width, expected.width, (int)expected.pos );
+        }
+        const auto width_u32 = string_width::str_width(limit, str_u32.data(), str_u32.size());
+        const auto res_u32 = string_width::str_width_and_pos(limit, str_u32.data(), str_u32.size());
+        if ( width_u32 != expected_width || res_u32.width != expected.width
+          || res_u32.pos != expected.pos ) {
+            ++failures;
+            std::printf( "string %d, limit %d, std::uint32_t: width %d, %d, pos %d "
+                         "( expected %d, %d, %d )\n"
+                       , (int)index, limit, width_u32, res_u32.width, (int)res_u32.pos
+                       , expected_width, expected.width, (int)expected.pos );
+        }
+    }
+}
+
+int main()
+{
+    std::mt19937 rng(2468);
+    std::vector<std::u32string> strings;
+    for (int i = 0; i < 2000; ++i) {
+        strings.push_back(random_string(rng));
+    }
+    // invalid codepoints are measured like U+FFFD
+    strings.push_back(std::u32string{0x110000, 0x0301, U'a', 0xFFFFFFFF});
+    strings.push_back(std::u32string{0x0600, 0x110000, 0x1100, 0x80000000, 0xAC00});
+    for (std::size_t i = 0; i < strings.size(); ++i) {
+        check_string(strings[i], i);
+    }
+
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
@@ -0,0 +1,142 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdio>
+
+// Compares the UTF-8 engine ( which classifies UTF-8 sequences directly
+// from their bytes ) against decode() + std_width_calc_func.
+
+class vector_destination: public string_width::detail::destination<char32_t> {
+public:
+    vector_destination()
+        : string_width::detail::destination<char32_t>(buff_, buff_size_)
+    {
+    }
+    void recycle() noexcept override {
+        codepoints.insert(codepoints.end(), buff_, this->pointer());
+        this->set_pointer(buff_);
+    }
+    std::vector<char32_t> codepoints;
+
+private:
+    static constexpr std::size_t buff_size_ = 16;
+    char32_t buff_[buff_size_];
+};
+
+static string_width::width_and_pos reference_width_and_pos
+    ( int limit
+    , const std::string& str
+    , string_width::surrogate_policy surr_poli )
+{
+    vector_destination dest;
+    string_width::detail::decode(dest, str.data(), str.size(), surr_poli);
+    dest.recycle();
+    const char32_t* begin = dest.codepoints.data();
+    const char32_t* end = begin + dest.codepoints.size();
+    if (limit == 0) {
+        return {0, 0};
+    }
+    auto res = string_width::detail::std_width_calc_func(begin, end, limit, 0, true);
+    auto count = string_width::detail::count_codepoints
+        (str.data(), str.size(), res.ptr - begin, surr_poli);
+    return {limit - res.width, count.pos};
+}
+
+static int reference_width
+    ( int limit
+    , const std::string& str
+    , string_width::surrogate_policy surr_poli )
+{
+    vector_destination dest;
+    string_width::detail::decode(dest, str.data(), str.size(), surr_poli);
+    dest.recycle();
+    const char32_t* begin = dest.codepoints.data();
+    const char32_t* end = begin + dest.codepoints.size();
+    if (limit == 0) {
+        return 0;
+    }
+    auto res = string_width::detail::std_width_calc_func(begin, end, limit, 0, false);
+    return limit - res.width;
+}
+
+static int failures = 0;
+
+static void test(const std::string& str)
+{
+    const string_width::surrogate_policy policies[] =
+        { string_width::surrogate_policy::strict, string_width::surrogate_policy::lax };
+    for (auto surr_poli: policies) {
+        const int total = reference_width(100000, str, surr_poli);
+        for (int limit = -1; limit <= total + 1; ++limit) {
+            auto expected_w = reference_width(limit, str, surr_poli);
+            auto expected = reference_width_and_pos(limit, str, surr_poli);
+            auto w = string_width::str_width(limit, str.data(), str.size(), surr_poli);
+            auto r = string_width::str_width_and_pos(limit, str.data(), str.size(), surr_poli);
+            if (w != expected_w || r.width != expected.width || r.pos != expected.pos) {
+                ++failures;
+                std::printf("failure with limit %d, string \"", limit);
+                for (unsigned char ch: str) {
+                    std::printf("\\x%.2X", ch);
+                }
+                std::printf( "\": str_width: %d (expected %d);"
+                             " str_width_and_pos: {%d, %d} (expected {%d, %d})\n"
+                           , w, expected_w
+                           , r.width, (int)r.pos, expected.width, (int)expected.pos );
+            }
+        }
+    }
+}
+
+int main()
+{
+    // pieces of UTF-8: valid sequences of codepoints of all categories,
+    // truncated, overlong and surrogate sequences, and stray bytes
+    const char* const pieces[] = {
+        "a", "bc", "\r", "\n", "\t", "\x7F",
+        "\xC3\xA9",          // U+00E9
+        "\xCC\x81",          // U+0301 extend
+        "\xD8\x80",          // U+0600 prepend
+        "\xE0\xA4\x83",      // U+0903 spacing mark
+        "\xE2\x80\x8D",      // U+200D zwj
+        "\xE1\x84\x80",      // U+1100 hangul L
+        "\xE1\x85\xA0",      // U+1160 hangul V
+        "\xE1\x86\xA8",      // U+11A8 hangul T
+        "\xEA\xB0\x80",      // U+AC00 hangul LV
+        "\xEA\xB0\x81",      // U+AC01 hangul LVT
+        "\xE6\xBC\xA2",      // U+6F22 wide
+        "\xF0\x9F\x98\x80",  // U+1F600 extended pictographic
+        "\xF0\x9F\x87\xA7",  // U+1F1E7 regional indicator
+        "\xF3\xA0\x80\x81",  // U+E0001 control
+        "\xED\xA0\x80",      // surrogate
+        "\xE0\x9F\x80",      // overlong
+        "\xC0\xAF",          // overlong
+        "\xF4\x90\x80\x80",  // too large
+        "\xE0\xA0", "\xF0\x90\x80", "\xC3", "\x80", "\xBF", "\xF5", "\xFF"
+    };
+    const std::size_t pieces_count = sizeof(pieces) / sizeof(pieces[0]);
+
+    for (std::size_t i = 0; i < pieces_count; ++i) {
+        for (std::size_t j = 0; j < pieces_count; ++j) {
+            test(std::string(pieces[i]) + pieces[j]);
+            test(std::string(pieces[i]) + "abcdefghijklmnopq" + pieces[j] + "xyz");
+        }
+    }
+    std::mt19937 rng(12345);
+    for (int n = 0; n < 3000; ++n) {
+        std::string str;
+        const auto count = rng() % 12;
+        for (unsigned i = 0; i < count; ++i) {
+            str += pieces[rng() % pieces_count];
+        }
+        test(str);
+    }
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
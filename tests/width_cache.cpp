@@ -0,0 +1,158 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width/width_cache.hpp>
+#include <string>
+#include <vector>
+#include <thread>
+#include <random>
+#include <cstdio>
+
+// Checks that width_cache always returns the same as str_width_and_pos,
+// including when many threads use a cache too small to hold all strings.
+
+static int failures = 0;
+
+template <typename CharT>
+static std::vector<std::basic_string<CharT>> make_strings(unsigned seed, std::size_t count);
+
+template <>
+std::vector<std::string> make_strings<char>(unsigned seed, std::size_t count)
+{
+    const char* const pieces[] = {
+        "a", "bcd", " ", "\r\n",
+        "\xC3\xA9",          // U+00E9
+        "\xCC\x81",          // U+0301 extend
+        "\xD8\x80",          // U+0600 prepend
+        "\xE6\xBC\xA2",      // U+6F22 wide
+        "\xF0\x9F\x87\xA7",  // U+1F1E7 regional indicator
+        "\xED\xA0\x80",      // surrogate
+        "\xFF"
+    };
+    std::mt19937 rng(seed);
+    std::vector<std::string> strings;
+    for (std::size_t n = 0; n < count; ++n) {
+        std::string str;
+        const auto len = rng() % 20;
+        for (unsigned i = 0; i < len; ++i) {
+            str += pieces[rng() % (sizeof(pieces) / sizeof(pieces[0]))];
+        }
+        strings.push_back(str);
+    }
+    return strings;
+}
+
+template <>
+std::vector<std::u16string> make_strings<char16_t>(unsigned seed, std::size_t count)
+{
+    const char16_t pieces[] = { u'a', u' ', 0x0301, 0x0600, 0x6F22, 0xD83C, 0xDDE7, 0xDC00 };
+    std::mt19937 rng(seed);
+    std::vector<std::u16string> strings;
+    for (std::size_t n = 0; n < count; ++n) {
+        std::u16string str;
+        const auto len = rng() % 30;
+        for (unsigned i = 0; i < len; ++i) {
+            str += pieces[rng() % (sizeof(pieces) / sizeof(pieces[0]))];
+        }
+        strings.push_back(str);
+    }
+    return strings;
+}
+
+template <typename CharT>
+static bool check
+    ( string_width::width_cache<CharT>& cache
+    , int limit
+    , const std::basic_string<CharT>& str
+    , string_width::surrogate_policy surr_poli )
+{
+    const auto expected = string_width::str_width_and_pos(limit, str.data(), str.size(), surr_poli);
+    const auto res = cache.str_width_and_pos(limit, str.data(), str.size(), surr_poli);
+    const auto width = cache.str_width(limit, str.data(), str.size(), surr_poli);
+    return res.width == expected.width && res.pos == expected.pos && width == expected.width;
+}
+
+template <typename CharT>
+static void test_single_thread()
+{
+    const auto strings = make_strings<CharT>(1234, 200);
+    string_width::width_cache<CharT> cache;
+    for (int round = 0; round < 2; ++round) {
+        for (auto& str: strings) {
+            for (int limit = -1; limit < 12; ++limit) {
+                for (auto surr_poli: { string_width::surrogate_policy::strict
+                                     , string_width::surrogate_policy::lax }) {
+                    if (! check(cache, limit, str, surr_poli)) {
+                        ++failures;
+                        std::printf( "failure ( sizeof(CharT) == %d, length %d, limit %d )\n"
+                                   , (int)sizeof(CharT), (int)str.size(), limit );
+                    }
+                }
+            }
+        }
+    }
+    const auto stats = cache.stats();
+    if (stats.hits == 0 || stats.misses == 0 || stats.bypassed == 0
+     || stats.hits + stats.misses + stats.bypassed != strings.size() * 13 * 2 * 2 * 2) {
+        ++failures;
+        std::printf( "unexpected statistics: %d hits, %d misses, %d bypassed\n"
+                   , (int)stats.hits, (int)stats.misses, (int)stats.bypassed );
+    }
+}
+
+static void test_ascii_bypass()
+{
+    string_width::width_cache<char> cache;
+    auto res = cache.str_width_and_pos(3, "hello", 5);
+    auto res2 = cache.str_width_and_pos(10, "hello", 5);
+    if ( res.width != 3 || res.pos != 3 || res2.width != 5 || res2.pos != 5
+      || cache.stats().bypassed != 2 || cache.stats().misses != 0 ) {
+        ++failures;
+        std::printf("failure with ASCII strings\n");
+    }
+}
+
+static void test_concurrent()
+{
+    // a small cache, so that entries are often replaced while being read
+    string_width::width_cache<char> cache(4096, 4);
+    const auto strings = make_strings<char>(777, 300);
+    std::vector<int> thread_failures(8, 0);
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < thread_failures.size(); ++t) {
+        threads.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            for (int i = 0; i < 20000; ++i) {
+                const auto& str = strings[rng() % strings.size()];
+                const int limit = 1 + static_cast<int>(rng() % 10);
+                if (! check(cache, limit, str, string_width::surrogate_policy::strict)) {
+                    ++thread_failures[t];
+                }
+            }
+        });
+    }
+    for (auto& t: threads) {
+        t.join();
+    }
+    for (auto f: thread_failures) {
+        failures += f;
+    }
+    if (cache.stats().evictions == 0) {
+        ++failures;
+        std::printf("no evictions in the concurrent test\n");
+    }
+}
+
+int main()
+{
+    test_single_thread<char>();
+    test_single_thread<char16_t>();
+    test_ascii_bypass();
+    test_concurrent();
+
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
@@ -0,0 +1,136 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+#include <string_width.hpp>
+#include <string>
+#include <cstdio>
+
+// Checks that, for each width_profile, the tree ( or the tables, with
+// STRING_WIDTH_USE_PROP_TABLES ) used for UTF-32 and the tables used for
+// UTF-8 and UTF-16 give the same width to every codepoint.
+
+using string_width::width_profile;
+
+static int failures = 0;
+
+static std::string to_utf8(char32_t ch)
+{
+    std::string s;
+    if (ch < 0x80) {
+        s += static_cast<char>(ch);
+    } else if (ch < 0x800) {
+        s += static_cast<char>(0xC0 | (ch >> 6));
+        s += static_cast<char>(0x80 | (ch & 0x3F));
+    } else if (ch < 0x10000) {
+        s += static_cast<char>(0xE0 | (ch >> 12));
+        s += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+        s += static_cast<char>(0x80 | (ch & 0x3F));
+    } else {
+        s += static_cast<char>(0xF0 | (ch >> 18));
+        s += static_cast<char>(0x80 | ((ch >> 12) & 0x3F));
+        s += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+        s += static_cast<char>(0x80 | (ch & 0x3F));
+    }
+    return s;
+}
+
+static std::u16string to_utf16(char32_t ch)
+{
+    std::u16string s;
+    if (ch < 0x10000) {
+        s += static_cast<char16_t>(ch);
+    } else {
+        s += static_cast<char16_t>(0xD800 + ((ch - 0x10000) >> 10));
+        s += static_cast<char16_t>(0xDC00 + ((ch - 0x10000) & 0x3FF));
+    }
+    return s;
+}
+
+template <width_profile Profile>
+static void check_all_codepoints(const char* name)
+{
+    int errors = 0;
+    for (char32_t ch = 0; ch < 0x110000; ++ch) {
+        if (0xD800 <= ch && ch <= 0xDFFF) {
+            continue;
+        }
+        const auto props = string_width::detail::ch32_props<Profile>(ch);
+        const int expected = (props & string_width::detail::prop::double_width) ? 2 : 1;
+        const std::string u8 = to_utf8(ch);
+        const std::u16string u16 = to_utf16(ch);
+        const int w8 = string_width::str_width<Profile>(10, u8.data(), u8.size());
+        const int w16 = string_width::str_width<Profile>(10, u16.data(), u16.size());
+        const int w32 = string_width::str_width<Profile>(10, &ch, 1);
+        if (w8 != expected || w16 != expected || w32 != expected) {
+            if (++errors <= 10) {
+                std::printf( "%s: U+%04X has width %d, %d, %d ( expected %d )\n"
+                           , name, (unsigned)ch, w8, w16, w32, expected );
+            }
+        }
+        if (string_width::detail::is_wide_bmp(ch) && expected != 2) {
+            ++errors;
+            std::printf("%s: U+%04X is not wide\n", name, (unsigned)ch);
+        }
+    }
+    failures += errors;
+}
+
+template <width_profile Profile>
+static void check_width(const char* name, int expected, const std::u32string& str)
+{
+    const int w32 = string_width::str_width<Profile>(100, str.data(), str.size());
+    std::string u8;
+    for (auto ch: str) {
+        u8 += to_utf8(ch < 0x110000 ? ch : 0xFFFD);
+    }
+    const int w8 = string_width::str_width<Profile>(100, u8.data(), u8.size());
+    const auto pos = string_width::str_width_and_pos<Profile>(expected, u8.data(), u8.size());
+    if (w32 != expected || w8 != expected || pos.width != expected || pos.pos != u8.size()) {
+        ++failures;
+        std::printf( "%s: width of U+%04X... is %d, %d, %d ( expected %d )\n"
+                   , name, (unsigned)str[0], w32, w8, pos.width, expected );
+    }
+}
+
+int main()
+{
+    check_all_codepoints<width_profile::std_format>("std_format");
+    check_all_codepoints<width_profile::east_asian_wide>("east_asian_wide");
+    check_all_codepoints<width_profile::wcwidth>("wcwidth");
+
+    // PLUS-MINUS SIGN ( Ambiguous )
+    check_width<width_profile::std_format>     ("std_format",      1, U"\u00B1");
+    check_width<width_profile::east_asian_wide>("east_asian_wide", 2, U"\u00B1");
+    check_width<width_profile::wcwidth>        ("wcwidth",         1, U"\u00B1");
+
+    // ROCKET ( Wide, but not in the ranges of std::format )
+    check_width<width_profile::std_format>     ("std_format",      1, U"\U0001F680");
+    check_width<width_profile::east_asian_wide>("east_asian_wide", 1, U"\U0001F680");
+    check_width<width_profile::wcwidth>        ("wcwidth",         2, U"\U0001F680");
+
+    // GREEK SMALL LETTER ALPHA ( Ambiguous ) with a combining acute accent
+    // ( Ambiguous too, but never wide )
+    check_width<width_profile::east_asian_wide>("east_asian_wide", 2, U"\u03B1\u0301");
+    check_width<width_profile::east_asian_wide>("east_asian_wide", 1, U"\u0301");
+
+    // Hangul syllables and CJK ideographs are wide in all profiles
+    check_width<width_profile::std_format>     ("std_format",      6, U"\uD55C\u6F22\u5B57");
+    check_width<width_profile::east_asian_wide>("east_asian_wide", 6, U"\uD55C\u6F22\u5B57");
+    check_width<width_profile::wcwidth>        ("wcwidth",         6, U"\uD55C\u6F22\u5B57");
+
+    // Invalid codepoints are measured like U+FFFD, which is Ambiguous
+    check_width<width_profile::std_format>     ("std_format",      2, std::u32string{0x110000, 'a'});
+    check_width<width_profile::east_asian_wide>("east_asian_wide", 3, std::u32string{0x110000, 'a'});
+    check_width<width_profile::wcwidth>        ("wcwidth",         2, std::u32string{0x110000, 'a'});
+    const char invalid_utf8[] = "\xFF" "a";
+    if (string_width::str_width<width_profile::east_asian_wide>(100, invalid_utf8, 2) != 3) {
+        ++failures;
+        std::printf("east_asian_wide: wrong width of an invalid UTF-8 sequence\n");
+    }
+
+    if (failures == 0) {
+        std::printf("%s", "All tests passed!\n");
+    }
+    return failures;
+}
@@ -0,0 +1,65 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+// Counts the codepoints of UTF-8 files ( or of the standard input ) and
+// prints, for each one that occurs, a line with the codepoint in
+// hexadecimal and its count. This is what
+// generate_ch32_width_gcb_prop_tree --weights reads:
+//
+//     codepoint_histogram corpus/*.txt > histogram.txt
+//     generate_ch32_width_gcb_prop_tree --weights histogram.txt
+//
+// Invalid sequences are skipped.
+
+#include <unicode/utf8.h>
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+
+static void count_codepoints(std::FILE* f, std::vector<unsigned long long>& counts)
+{
+    std::vector<std::uint8_t> data;
+    char buff[1 << 16];
+    std::size_t n;
+    while ((n = std::fread(buff, 1, sizeof(buff), f)) != 0) {
+        data.insert(data.end(), buff, buff + n);
+    }
+    const std::int32_t len = static_cast<std::int32_t>(data.size());
+    std::int32_t i = 0;
+    while (i < len) {
+        UChar32 ch;
+        U8_NEXT(data.data(), i, len, ch);
+        if (ch >= 0) {
+            ++counts[static_cast<std::size_t>(ch)];
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<unsigned long long> counts(0x110000, 0);
+    if (argc < 2) {
+        count_codepoints(stdin, counts);
+    }
+    for (int i = 1; i < argc; ++i) {
+        std::FILE* f = std::fopen(argv[i], "rb");
+        if (f == nullptr) {
+            std::fprintf(stderr, "could not open %s\n", argv[i]);
+            return 1;
+        }
+        count_codepoints(f, counts);
+        std::fclose(f);
+    }
+    unsigned long long total = 0;
+    for (auto c: counts) {
+        total += c;
+    }
+    std::printf("# %llu codepoints\n", total);
+    for (std::size_t ch = 0; ch < counts.size(); ++ch) {
+        if (counts[ch] != 0) {
+            std::printf("%04X %llu\n", static_cast<unsigned>(ch), counts[ch]);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+//  Distributed under the Boost Software License, Version 1.0.
+//  (See accompanying file LICENSE_1_0.txt or copy at
+//  http://www.boost.org/LICENSE_1_0.txt)
+
+// Measures the throughput of std_width_calc_func over UTF-32 strings of
+// several scripts. This file is compiled twice: once with the generated
+// branch tree ( the default ) and once with STRING_WIDTH_USE_PROP_TABLES
+// defined, so that both ways of looking up the codepoint properties
+// can be compared.
+
+#include <string_width.hpp>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct corpus {
+    const char* name;
+    std::u32string text;
+};
+
+static std::u32string repeat(const std::u32string& piece, std::size_t size)
+{
+    std::u32string str;
+    while (str.size() < size) {
+        str += piece;
+    }
+    return str;
+}
+
+static std::u32string range_text(char32_t first, char32_t last, std::size_t size)
+{
+    std::u32string str;
+    for (char32_t ch = first; str.size() < size; ch = (ch == last ? first : ch + 1)) {
+        str.push_back(ch);
+    }
+    return str;
+}
+
+// Returns the best of several rounds, in millions of codepoints per second
+static double measure(const std::u32string& str)
+{
+    using clock = std::chrono::steady_clock;
+    const char32_t* begin = str.data();
+    const char32_t* end = begin + str.size();
+    long long total = 0;
+    double best = 0;
+    for (int round = 0; round < 5; ++round) {
+        int repetitions = 0;
+        const auto t0 = clock::now();
+        auto t1 = t0;
+        do {
+            auto res = string_width::detail::std_width_calc_func(begin, end, 1 << 30, 0, false);
+            total += res.width;
+            ++repetitions;
+            t1 = clock::now();
+        } while (t1 - t0 < std::chrono::milliseconds(50));
+        const double seconds = std::chrono::duration<double>(t1 - t0).count();
+        const double speed = static_cast<double>(str.size()) * repetitions / seconds / 1e6;
+        best = speed > best ? speed : best;
+    }
+    if (total == 0) {
+        std::printf("unexpected result\n");
+    }
+    return best;
+}
+
+int main()
+{
+    constexpr std::size_t size = 1 << 16;
+    const std::vector<corpus> corpora = {
+        {"Latin accents", repeat(U"Cr\u00E8me br\u00FBl\u00E9e, na\u00EFve fa\u00E7ade. ", size)},
+        {"Cyrillic",      repeat(U"\u0421\u044A\u0435\u0448\u044C \u0436\u0435 \u0435\u0449\u0451 ", size)},
+        {"CJK",           range_text(0x4E00, 0x9FFF, size)},
+        {"Hangul",        range_text(0xAC00, 0xD7A3, size)},
+        {"Devanagari",    repeat(U"\u0915\u094D\u0937\u093F \u0928\u092E\u0938\u094D\u0924\u0947 ", size)},
+        {"Emoji ZWJ",     repeat(U"\U0001F469\u200D\U0001F4BB\U0001F44D\U0001F3FD\U0001F1E7\U0001F1F7", size)},
+        {"Mixed planes",  range_text(0x10000, 0x1FFFF, size)},
+    };
+#if defined(STRING_WIDTH_USE_PROP_TABLES)
+    using tables = string_width::detail::prop_tables;
+    std::printf( "property lookup: tables ( %d bytes of data )\n"
+               , (int)(sizeof(tables::stage1) + sizeof(tables::stage2) + sizeof(tables::stage3)) );
+#else
+    std::printf("property lookup: tree\n");
+#endif
+    for (auto& c: corpora) {
+        std::printf("%-14s %8.1f million codepoints / s\n", c.name, measure(c.text));
+    }
+    return 0;
+}
@@ -8,6 +8,9 @@
 
 #include <vector>
 #include <map>
+#include <cstdio>
+#include <cstring>
+#include <string>
 #include <strf/to_cfile.hpp>
 #include "unicode/uchar.h"
 
@@ -16,6 +19,30 @@
 
 constexpr int indentation_factor = 4;
 
+// The rules that decide which codepoints have width 2, selected by
+// the --profile option. Each profile is emitted into its own files.
+enum class width_profile {
+    std_format,       // http://eel.is/c++draft/format.string.std#11
+    east_asian_wide,  // std_format, plus East Asian Width Ambiguous
+    wcwidth           // East Asian Width Wide or Fullwidth, like glibc
+};
+
+width_profile profile = width_profile::std_format;
+
+const char* to_str(width_profile p) {
+    switch(p) {
+        case width_profile::std_format: return "std_format";
+        case width_profile::east_asian_wide: return "east_asian_wide";
+        case width_profile::wcwidth: return "wcwidth";
+    }
+    return "INVALID_PROFILE";
+}
+
+// The suffix of the names of the files and tables of the profile
+std::string profile_suffix() {
+    return profile == width_profile::std_format ? "" : std::string("_") + to_str(profile);
+}
+
 enum class category {
 
     invalid = 0,
@@ -210,7 +237,7 @@ void ensure_no_more_than_one_category_per_char(strf::outbuff& out) {
     }
 }
 
-bool is_double_width(UChar32 ch) {
+bool is_std_format_double_width(UChar32 ch) {
     // from http://eel.is/c++draft/format.string.std#11
     return (0x1100 <= ch && ch <= 0x115F)
         || (0x2329 <= ch && ch <= 0x232A)
@@ -228,6 +255,33 @@ bool is_double_width(UChar32 ch) {
         || (0x30000 <= ch && ch <= 0x3FFFD);
 }
 
+bool is_east_asian_wide_or_fullwidth(UChar32 ch) {
+    auto eaw = static_cast<UEastAsianWidth>(u_getIntPropertyValue(ch, UCHAR_EAST_ASIAN_WIDTH));
+    return eaw == U_EA_WIDE || eaw == U_EA_FULLWIDTH;
+}
+
+bool is_east_asian_ambiguous(UChar32 ch) {
+    auto eaw = static_cast<UEastAsianWidth>(u_getIntPropertyValue(ch, UCHAR_EAST_ASIAN_WIDTH));
+    auto gencat = static_cast<UCharCategory>(u_getIntPropertyValue(ch, UCHAR_GENERAL_CATEGORY));
+    // Combining marks are Ambiguous too, but they are not meant to be
+    // rendered on their own
+    return eaw == U_EA_AMBIGUOUS
+        && gencat != U_NON_SPACING_MARK
+        && gencat != U_ENCLOSING_MARK
+        && gencat != U_COMBINING_SPACING_MARK;
+}
+
+bool is_double_width(UChar32 ch) {
+    switch (profile) {
+        case width_profile::east_asian_wide:
+            return is_std_format_double_width(ch) || is_east_asian_ambiguous(ch);
+        case width_profile::wcwidth:
+            return is_east_asian_wide_or_fullwidth(ch);
+        default:
+            return is_std_format_double_width(ch);
+    }
+}
+
 category category_widthout_width_mask(UChar32 ch) {
     int is_control = ::is_control(ch);
     int is_extend = ::is_extend(ch);
@@ -541,6 +595,184 @@ bool all_double_width
 }
 
 
+// Codepoint frequencies, read with --weights from a file printed by
+// tools/codepoint_histogram.cpp. When given, print_branches does not split
+// the ranges in the middle, but where the expected number of comparisons
+// per codepoint is minimal ( like in an optimal binary search tree ), so
+// that the frequent codepoints are resolved near the root.
+
+std::vector<double> codepoint_counts;
+
+// Recorded in the header of the generated file, so that a weighted tree
+// can be reproduced: the name of the histogram file ( without directories )
+// and the 64-bit FNV-1a hash of its content
+std::string weights_file_name;
+std::uint64_t weights_file_hash = 0;
+
+// The share of the weight that is spread evenly among the ranges, so
+// that the ranges absent from the histogram are not placed too deep
+constexpr double uniform_share = 0.05;
+
+bool read_weights(const char* filename)
+{
+    std::FILE* f = std::fopen(filename, "r");
+    if (f == nullptr) {
+        std::fprintf(stderr, "could not open %s\n", filename);
+        return false;
+    }
+    codepoint_counts.assign(0x110000, 0.0);
+    const char* base_name = std::strrchr(filename, '/');
+    weights_file_name = base_name ? base_name + 1 : filename;
+    weights_file_hash = 0xcbf29ce484222325ULL;
+    char line[256];
+    while (std::fgets(line, sizeof(line), f)) {
+        for (const char* it = line; *it; ++it) {
+            weights_file_hash ^= static_cast<unsigned char>(*it);
+            weights_file_hash *= 0x100000001b3ULL;
+        }
+        unsigned long ch;
+        double count;
+        if (line[0] == '#' || std::sscanf(line, "%lx %lf", &ch, &count) != 2) {
+            continue;
+        }
+        if (ch < 0x110000) {
+            codepoint_counts[ch] += count;
+        }
+    }
+    std::fclose(f);
+    return true;
+}
+
+// tree_splits[i * n + j] is the index where print_branches splits the
+// ranges [i, j) of the tree. It is empty when there are no weights.
+const chars_range_with_exceptions* tree_begin = nullptr;
+std::size_t tree_size = 0;
+std::vector<std::uint32_t> tree_splits;
+
+std::vector<double> range_weights
+    ( const chars_range_with_exceptions* begin
+    , const chars_range_with_exceptions* end )
+{
+    const std::size_t n = end - begin;
+    std::vector<double> w(n, 0.0);
+    double total = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        for (auto ch = begin[i].first; ch <= begin[i].last; ++ch) {
+            w[i] += codepoint_counts[ch];
+        }
+        total += w[i];
+    }
+    for (auto& x: w) {
+        x = (1 - uniform_share) * (total > 0 ? x / total : 0) + uniform_share / n;
+    }
+    return w;
+}
+
+// Dynamic programming with Knuth's bounds on the position of the
+// optimal split, which take it from O(n^3) to O(n^2).
+void plan_weighted_tree
+    ( const chars_range_with_exceptions* begin
+    , const chars_range_with_exceptions* end )
+{
+    const std::size_t n = end - begin;
+    const auto w = range_weights(begin, end);
+    std::vector<double> prefix(n + 1, 0.0);
+    for (std::size_t i = 0; i < n; ++i) {
+        prefix[i + 1] = prefix[i] + w[i];
+    }
+    const std::size_t stride = n + 1;
+    std::vector<double> cost(stride * stride, 0.0);
+    tree_begin = begin;
+    tree_size = n;
+    tree_splits.assign(stride * stride, 0);
+    for (std::size_t i = 0; i + 2 <= n; ++i) {
+        cost[i * stride + i + 2] = prefix[i + 2] - prefix[i];
+        tree_splits[i * stride + i + 2] = static_cast<std::uint32_t>(i + 1);
+    }
+    for (std::size_t len = 3; len <= n; ++len) {
+        for (std::size_t i = 0; i + len <= n; ++i) {
+            const std::size_t j = i + len;
+            const std::size_t lo = tree_splits[i * stride + j - 1];
+            const std::size_t hi = tree_splits[(i + 1) * stride + j];
+            double best = -1;
+            std::size_t best_split = lo;
+            for (std::size_t k = lo; k <= hi; ++k) {
+                const double c = cost[i * stride + k] + cost[k * stride + j];
+                if (best < 0 || c < best) {
+                    best = c;
+                    best_split = k;
+                }
+            }
+            cost[i * stride + j] = best + prefix[j] - prefix[i];
+            tree_splits[i * stride + j] = static_cast<std::uint32_t>(best_split);
+        }
+    }
+}
+
+const chars_range_with_exceptions* branch_split
+    ( const chars_range_with_exceptions* begin
+    , const chars_range_with_exceptions* end )
+{
+    if (tree_splits.empty()) {
+        return begin + (end - begin) / 2;
+    }
+    const std::size_t i = begin - tree_begin;
+    const std::size_t j = end - tree_begin;
+    return tree_begin + tree_splits[i * (tree_size + 1) + j];
+}
+
+// Adds the number of comparisons to reach each range, times its weight
+void sum_comparisons
+    ( const chars_range_with_exceptions* begin
+    , const chars_range_with_exceptions* end
+    , const std::vector<double>& w
+    , int depth
+    , double& weighted_sum
+    , int& max_depth )
+{
+    if (end - begin == 1) {
+        weighted_sum += depth * w[begin - tree_begin];
+        max_depth = std::max(max_depth, depth);
+        return;
+    }
+    const auto middle = branch_split(begin, end);
+    sum_comparisons(begin, middle, w, depth + 1, weighted_sum, max_depth);
+    sum_comparisons(middle, end, w, depth + 1, weighted_sum, max_depth);
+}
+
+// Prints to stderr how many comparisons the codepoints of the histogram
+// take on average, with the balanced tree and with the weighted one
+void print_weighted_tree_stats
+    ( const chars_range_with_exceptions* begin
+    , const chars_range_with_exceptions* end )
+{
+    std::vector<double> w(end - begin, 0.0);
+    double total = 0;
+    for (auto it = begin; it != end; ++it) {
+        for (auto ch = it->first; ch <= it->last; ++ch) {
+            w[it - begin] += codepoint_counts[ch];
+        }
+        total += w[it - begin];
+    }
+    if (total == 0) {
+        std::fprintf(stderr, "the histogram has no codepoint in the tree\n");
+        return;
+    }
+    for (auto& x: w) {
+        x /= total;
+    }
+    double weighted_avg = 0, balanced_avg = 0;
+    int weighted_max = 0, balanced_max = 0;
+    sum_comparisons(begin, end, w, 0, weighted_avg, weighted_max);
+    const auto splits = std::move(tree_splits);
+    tree_splits.clear();
+    sum_comparisons(begin, end, w, 0, balanced_avg, balanced_max);
+    tree_splits = std::move(splits);
+    std::fprintf( stderr, "%d ranges; comparisons per codepoint of the histogram: "
+                  "%.2f ( balanced tree: %.2f ); maximum depth: %d ( balanced tree: %d )\n"
+                , (int)(end - begin), weighted_avg, balanced_avg, weighted_max, balanced_max );
+}
+
 void print_branches
     ( strf::outbuff& dest
     , int indent_level
@@ -568,7 +800,7 @@ void print_branches
             }
             print(indentation, "goto handle_", to_str(remove_dw_flag(begin->cat)), ";\n");
         } else {
-            auto half_count = count / 2;
+            auto half_count = branch_split(begin, end) - begin;
             auto& boundary = begin[half_count - 1];
             print(strf::join_left(62)
                       ( indentation, "if (ch <= ", *strf::hex(boundary.last), ") {")
@@ -585,8 +817,226 @@ void print_branches
 }
 
 
-int main()
+void print_file_header(strf::outbuff& dest, bool tables)
 {
+    auto print = strf::to(dest);
+    print( "//  Copyright (C) (See commit logs on github.com/robhz786/strf)\n"
+           "//  Distributed under the Boost Software License, Version 1.0.\n"
+           "//  (See accompanying file LICENSE_1_0.txt or copy at\n"
+           "//  http://www.boost.org/LICENSE_1_0.txt)\n"
+           "\n"
+           "// ( Include guard intentionally ommited )\n"
+           "\n"
+           "// Generated by tools/generate_ch32_width_gcb_prop_tree.cpp"
+         , (tables ? " --tables" : "") );
+    if (profile != width_profile::std_format) {
+        print(" --profile ", to_str(profile));
+    }
+    if (! tables && ! codepoint_counts.empty()) {
+        print( " --weights ", weights_file_name
+             , " ( FNV-1a hash: ", strf::hex(weights_file_hash).p(16), " )" );
+    }
+    print('\n');
+}
+
+// Values of the properties byte in the tables emitted by print_prop_tables.
+// They must match the constants in namespace string_width::detail::prop.
+
+enum class prop_category {
+    other = 0,
+    control,
+    extend,
+    zwj,
+    spacing_mark,
+    prepend,
+    hangul_l,
+    hangul_v,
+    hangul_t,
+    hangul_lv,
+    hangul_lvt,
+    regional_indicator,
+    extended_picto,
+    cr,
+    lf
+};
+
+constexpr unsigned prop_double_width = 0x10;
+
+prop_category to_prop_category(category cat, UChar32 ch)
+{
+    switch(remove_dw_flag(cat)) {
+        case category::extend:
+        case category::extend_and_control:
+            return prop_category::extend;
+        case category::control:
+            return ch == 0x0D ? prop_category::cr
+                 : ch == 0x0A ? prop_category::lf
+                 : prop_category::control;
+        case category::zwj: return prop_category::zwj;
+        case category::spacing_mark: return prop_category::spacing_mark;
+        case category::prepend: return prop_category::prepend;
+        case category::hangul_l: return prop_category::hangul_l;
+        case category::hangul_v: return prop_category::hangul_v;
+        case category::hangul_t: return prop_category::hangul_t;
+        case category::hangul_lv_or_lvt:
+            return (ch - 0xAC00) % 28 == 0 ? prop_category::hangul_lv : prop_category::hangul_lvt;
+        case category::regional_indicator: return prop_category::regional_indicator;
+        case category::extended_picto: return prop_category::extended_picto;
+        default: return prop_category::other;
+    }
+}
+
+std::vector<std::uint8_t> map_props(const chars_range* begin, const chars_range* end)
+{
+    std::vector<std::uint8_t> props(0x110000, 0);
+    for (auto it = begin; it != end; ++it) {
+        for (auto ch = it->first; ch <= it->last; ++ch) {
+            unsigned p = (unsigned)to_prop_category(it->cat, ch);
+            if (is_double_width(it->cat)) {
+                p |= prop_double_width;
+            }
+            props[ch] = static_cast<std::uint8_t>(p);
+        }
+    }
+    return props;
+}
+
+// Splits `values` in blocks of 64 elements, and returns the index of each
+// block in `unique_blocks`, where identical blocks are stored only once.
+
+template <typename T>
+std::vector<unsigned> deduplicate_blocks
+    ( const std::vector<T>& values
+    , std::vector<T>& unique_blocks )
+{
+    std::map<std::vector<T>, unsigned> ids;
+    std::vector<unsigned> indexes;
+    for (std::size_t i = 0; i < values.size(); i += 64) {
+        std::vector<T> block(values.begin() + i, values.begin() + i + 64);
+        auto found = ids.find(block);
+        if (found != ids.end()) {
+            indexes.push_back(found->second);
+        } else {
+            unsigned id = static_cast<unsigned>(ids.size());
+            ids.emplace(block, id);
+            unique_blocks.insert(unique_blocks.end(), block.begin(), block.end());
+            indexes.push_back(id);
+        }
+    }
+    return indexes;
+}
+
+template <typename T>
+void print_array
+    ( strf::outbuff& dest
+    , const char* name
+    , const std::vector<T>& values
+    , unsigned max_value )
+{
+    auto print = strf::to(dest).with(strf::mixedcase);
+    const char* type = max_value < 0x100 ? "std::uint8_t" : "std::uint16_t";
+    const int digits = max_value < 0x100 ? 2 : 4;
+    print("    static constexpr ", type, ' ', name, '[', values.size(), "] = {\n");
+    for (std::size_t i = 0; i < values.size(); ) {
+        std::size_t count = std::min((std::size_t)(digits == 2 ? 16 : 12), (values.size() - i));
+        const auto* it = &values[i];
+        print( "        "
+             , *strf::fmt_separated_range(it, it + count, ", ").hex().p(digits)
+             , ",\n" );
+        i += count;
+    }
+    print("    };\n");
+}
+
+// Prints the width and grapheme cluster break category of all codepoints in
+// a three-stage table that is indexed by the 6-bit groups of the codepoint,
+// which are also the payload bits of the UTF-8 encoding:
+//
+//     stage1[ch >> 12]                                  -> row in stage2
+//     stage2[row * 64 + ((ch >> 6) & 0x3F)]             -> block in stage3
+//     stage3[block * 64 + (ch & 0x3F)]                  -> properties
+//
+// This way a UTF-8 sequence can be classified by walking its bytes, without
+// reconstructing the codepoint.
+
+void print_prop_tables(strf::outbuff& dest, const chars_range* begin, const chars_range* end)
+{
+    const auto props = map_props(begin, end);
+    std::vector<std::uint8_t> stage3;
+    const auto blocks = deduplicate_blocks(props, stage3);
+    std::vector<unsigned> stage2;
+    const auto rows = deduplicate_blocks(blocks, stage2);
+    const unsigned blocks_count = static_cast<unsigned>(stage3.size() / 64);
+    const unsigned rows_count = static_cast<unsigned>(stage2.size() / 64);
+
+    std::vector<unsigned> stage1(rows.begin(), rows.end());
+    std::vector<unsigned> stage3_(stage3.begin(), stage3.end());
+
+    auto print = strf::to(dest).with(strf::mixedcase);
+    const auto name = "width_and_gcb_prop_tables" + profile_suffix();
+    print_file_header(dest, true);
+    print( "//\n"
+           "//     stage1[ch >> 12]                       -> row in stage2\n"
+           "//     stage2[row * 64 + ((ch >> 6) & 0x3F)]  -> block in stage3\n"
+           "//     stage3[block * 64 + (ch & 0x3F)]       -> properties\n"
+           "//\n"
+           "// ", rows_count, " rows, ", blocks_count, " blocks, "
+         , stage1.size() + stage2.size() * (blocks_count <= 0x100 ? 1 : 2) + stage3.size()
+         , " bytes\n\n"
+           "template <typename T = void>\n"
+           "struct ", name, "\n"
+           "{\n" );
+    print_array(dest, "stage1", stage1, rows_count - 1);
+    print_array(dest, "stage2", stage2, blocks_count - 1);
+    print_array(dest, "stage3", stage3_, 0xFF);
+    const char* stage2_type = blocks_count <= 0x100 ? "std::uint8_t" : "std::uint16_t";
+    print( "};\n"
+           "\n"
+           "#if ! defined(__cpp_inline_variables)\n"
+           "template <typename T>\n"
+           "constexpr std::uint8_t ", name, "<T>::stage1[];\n"
+           "template <typename T>\n"
+           "constexpr ", stage2_type, ' ', name, "<T>::stage2[];\n"
+           "template <typename T>\n"
+           "constexpr std::uint8_t ", name, "<T>::stage3[];\n"
+           "#endif\n" );
+}
+
+
+// Usage: generate_ch32_width_gcb_prop_tree [--tables] [--profile NAME] [--weights FILE]
+//
+// Prints the tree of branches ( include/string_width/detail/ch32_width_and_gcb_prop )
+// or, with --tables, the three-stage tables ( detail/width_and_gcb_prop_tables ).
+// NAME is std_format ( the default ), east_asian_wide or wcwidth; the output
+// of the other profiles goes into the files with the "_NAME" suffix.
+// FILE is a histogram of codepoints that shapes the tree ( see read_weights ).
+int main(int argc, char** argv)
+{
+    bool tables = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--tables") == 0) {
+            tables = true;
+        } else if (std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            const char* name = argv[++i];
+            if (std::strcmp(name, "std_format") == 0) {
+                profile = width_profile::std_format;
+            } else if (std::strcmp(name, "east_asian_wide") == 0) {
+                profile = width_profile::east_asian_wide;
+            } else if (std::strcmp(name, "wcwidth") == 0) {
+                profile = width_profile::wcwidth;
+            } else {
+                std::fprintf(stderr, "unknown profile: %s\n", name);
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--weights") == 0 && i + 1 < argc) {
+            if (! read_weights(argv[++i])) {
+                return 1;
+            }
+        } else {
+            std::fprintf(stderr, "usage: %s [--tables] [--profile NAME] [--weights FILE]\n", argv[0]);
+            return 1;
+        }
+    }
     strf::narrow_cfile_writer<char, 1000> out(stdout);
 
     //ensure_no_more_than_one_category_per_char(out);
@@ -597,7 +1047,17 @@ int main()
     verify(out, &c[0], &*c.end());
 
     // print_categories_boundaries(out, &c[0], &*c.end());
-    print_branches(out, 1, &c[2], &*c.end());
+    if (tables) {
+        print_prop_tables(out, &v[0], &*v.end());
+    } else {
+        if (! codepoint_counts.empty()) {
+            plan_weighted_tree(&c[2], &*c.end());
+            print_weighted_tree_stats(&c[2], &*c.end());
+        }
+        print_file_header(out, false);
+        strf::to(out)('\n');
+        print_branches(out, 1, &c[2], &*c.end());
+    }
     // v0::print_branches(out, 0, &v[0], &*v.end());
     out.finish();
     return 0;